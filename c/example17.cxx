@@ -0,0 +1,44 @@
+#include <texcaller.h>
+#include <iostream>
+#include <vector>
+
+int main()
+{
+    //
+    //  Generate a PDF document
+    //
+
+    std::string latex =
+        "\\documentclass{article}"
+        "\\begin{document}";
+    texcaller::escape_latex_append(latex, "Téxt → \"with\" $peciäl <characters>", "LaTeX");
+    latex += "\\end{document}";
+
+    try {
+        const texcaller::document pdf = texcaller::convert(latex, "LaTeX", "PDF", 5);
+
+        std::cout << "Generated PDF of " << pdf.size() << " bytes.";
+        std::cout << " Details:" << std::endl << std::endl << pdf.info();
+    } catch (std::domain_error &e) {
+        std::cout << "Error: " << e.what() << std::endl;
+    }
+
+
+    //
+    //  Generate multiple PDF documents concurrently
+    //
+
+    std::vector<std::future<texcaller::document>> pdfs;
+    for (int i = 0; i < 4; i++) {
+        pdfs.push_back(texcaller::convert_async(latex, "LaTeX", "PDF", 5));
+    }
+    for (auto &pdf : pdfs) {
+        try {
+            std::cout << "Generated PDF of " << pdf.get().size() << " bytes." << std::endl;
+        } catch (std::domain_error &e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+/* See doc/index.html for copyright information and documentation. */
+
+/*
+ *  Benchmark of the process spawn backends of texcaller_convert().
+ *
+ *  Measures the latency of starting and waiting for a trivial command
+ *  with the fork() and posix_spawn() backends,
+ *  while the calling process holds an increasing amount of memory
+ *  (as does e.g. a PostgreSQL backend or a large Python worker).
+ *
+ *  Usage: spawn_benchmark [MAX_RSS_MB [ITERATIONS]]
+ */
+
+#include "texcaller.c"
+
+#include <time.h>
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double measure(int (*spawn)(char **, pid_t *, const char *, const char *, int, char *const [], char *const []),
+                      int iterations)
+{
+    char *argv[2];
+    char *error;
+    double start;
+    int i;
+    argv[0] = (char *)"true";
+    argv[1] = NULL;
+    start = now();
+    for (i = 0; i < iterations; i++) {
+        pid_t pid;
+        if (spawn(&error, &pid, "/", NULL, -1, argv, NULL) != 0) {
+            fprintf(stderr, "%s\n", error == NULL ? "Unsupported." : error);
+            free(error);
+            return -1;
+        }
+        if (wait_command(&error, pid, argv[0]) != 0) {
+            fprintf(stderr, "%s\n", error == NULL ? "Out of memory." : error);
+            free(error);
+            return -1;
+        }
+    }
+    return (now() - start) / iterations * 1e3;
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t mb = 1024 * 1024;
+    size_t max_rss_mb = argc > 1 ? (size_t)atol(argv[1]) : 2048;
+    int iterations = argc > 2 ? atoi(argv[2]) : 200;
+    size_t rss_mb;
+    char *ballast = NULL;
+    printf("%10s %16s %16s\n", "RSS (MB)", "fork (ms)", "posix_spawn (ms)");
+    /* don't let forked children flush our buffered output */
+    fflush(stdout);
+    for (rss_mb = 0; rss_mb <= max_rss_mb; rss_mb = rss_mb == 0 ? 64 : rss_mb * 2) {
+        free(ballast);
+        ballast = NULL;
+        if (rss_mb > 0) {
+            ballast = (char *)malloc(rss_mb * mb);
+            if (ballast == NULL) {
+                fprintf(stderr, "Out of memory.\n");
+                return 1;
+            }
+            /* touch all pages, so they are actually mapped */
+            memset(ballast, 1, rss_mb * mb);
+        }
+        printf("%10lu %16.3f %16.3f\n", (unsigned long)rss_mb,
+               measure(spawn_command_fork, iterations),
+               TEXCALLER_HAVE_POSIX_SPAWN_CHDIR
+               ? measure(spawn_command_posix_spawn, iterations) : -1.0);
+        fflush(stdout);
+    }
+    free(ballast);
+    return 0;
+}
@@ -0,0 +1,144 @@
+/* See doc/index.html for copyright information and documentation. */
+
+/*
+ *  Stress test of concurrent texcaller_convert() calls.
+ *
+ *  Runs many conversions on many threads at once,
+ *  and checks that every conversion returns its own document,
+ *  and that no file descriptors, temporary directories
+ *  or child processes are left behind.
+ *
+ *  Usage: stress [THREADS [CONVERSIONS_PER_THREAD]]
+ */
+
+#include <texcaller.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int conversions_per_thread = 4;
+
+static int count_entries(const char *dirname)
+{
+    DIR *dir = opendir(dirname);
+    struct dirent *entry;
+    int count = 0;
+    if (dir == NULL) {
+        return -1;
+    }
+    for (entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+static void *run(void *arg)
+{
+    const long thread = (long)arg;
+    long failures = 0;
+    int i;
+    for (i = 0; i < conversions_per_thread; i++) {
+        char latex[256];
+        char title[64];
+        char *pdf;
+        size_t pdf_size;
+        char *info;
+        sprintf(title, "stress-%li-%i", thread, i);
+        sprintf(latex,
+                "\\pdfinfo{/Title (%s)}"
+                "\\documentclass{article}"
+                "\\begin{document}"
+                "Document %s, see page~\\pageref{end}."
+                "\\label{end}"
+                "\\end{document}",
+                title, title);
+        texcaller_convert(&pdf, &pdf_size, &info, latex, strlen(latex), "LaTeX", "PDF", 5);
+        if (pdf == NULL) {
+            fprintf(stderr, "%s: %s\n", title, info == NULL ? "Out of memory." : info);
+            failures++;
+        } else {
+            size_t pos;
+            int found = 0;
+            for (pos = 0; pos + strlen(title) <= pdf_size; pos++) {
+                if (memcmp(pdf + pos, title, strlen(title)) == 0) {
+                    found = 1;
+                    break;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "%s: Got the wrong document.\n", title);
+                failures++;
+            }
+        }
+        free(pdf);
+        free(info);
+    }
+    return (void *)failures;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads_count = argc > 1 ? atoi(argv[1]) : 64;
+    pthread_t *threads;
+    char tmpdir[] = "/tmp/texcaller-stress-XXXXXX";
+    int fds_before;
+    int fds_after;
+    long failures = 0;
+    int i;
+    if (argc > 2) {
+        conversions_per_thread = atoi(argv[2]);
+    }
+    /* use a separate TMPDIR to detect leftover temporary directories */
+    if (mkdtemp(tmpdir) == NULL || setenv("TMPDIR", tmpdir, 1) != 0) {
+        fprintf(stderr, "Unable to create %s: %s.\n", tmpdir, strerror(errno));
+        return 1;
+    }
+    fds_before = count_entries("/proc/self/fd");
+    /* run all conversions */
+    threads = (pthread_t *)malloc(threads_count * sizeof(pthread_t));
+    if (threads == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    for (i = 0; i < threads_count; i++) {
+        if (pthread_create(&threads[i], NULL, run, (void *)(long)i) != 0) {
+            fprintf(stderr, "Unable to create thread %i.\n", i);
+            return 1;
+        }
+    }
+    for (i = 0; i < threads_count; i++) {
+        void *thread_failures;
+        pthread_join(threads[i], &thread_failures);
+        failures += (long)thread_failures;
+    }
+    free(threads);
+    /* check for leftovers */
+    fds_after = count_entries("/proc/self/fd");
+    if (fds_after != fds_before) {
+        fprintf(stderr, "Leaked %i file descriptors.\n", fds_after - fds_before);
+        failures++;
+    }
+    if (count_entries(tmpdir) != 0) {
+        fprintf(stderr, "Left temporary directories behind in %s.\n", tmpdir);
+        failures++;
+    } else {
+        rmdir(tmpdir);
+    }
+    if (waitpid(-1, NULL, WNOHANG) != -1 || errno != ECHILD) {
+        fprintf(stderr, "Left child processes behind.\n");
+        failures++;
+    }
+    printf("%i conversions on %i threads, %li failures.\n",
+           threads_count * conversions_per_thread, threads_count, failures);
+    return failures == 0 ? 0 : 1;
+}
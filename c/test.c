@@ -0,0 +1,81 @@
+/* See doc/index.html for copyright information and documentation. */
+
+/*
+ *  Regression tests of texcaller corner cases.
+ *
+ *  Usage: test
+ */
+
+#include <texcaller.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+static void test_escape(const char *s, const char *expected)
+{
+    char *escaped = texcaller_escape_latex_for(s, "LaTeX");
+    if (escaped == NULL || strcmp(escaped, expected) != 0) {
+        fprintf(stderr, "Escaped \"%s\" to \"%s\" instead of \"%s\".\n",
+                s, escaped == NULL ? "(null)" : escaped, expected);
+        failures++;
+    }
+    free(escaped);
+}
+
+static void test_symlink_source(void)
+{
+    const char *latex =
+        "\\documentclass{article}"
+        "\\begin{document}"
+        "Hello world!"
+        "\\end{document}";
+    char dirname[] = "/tmp/texcaller-test-XXXXXX";
+    char source[64];
+    char link[64];
+    FILE *file;
+    char *pdf;
+    size_t pdf_size;
+    char *info;
+    if (mkdtemp(dirname) == NULL) {
+        fprintf(stderr, "Unable to create %s: %s.\n", dirname, strerror(errno));
+        failures++;
+        return;
+    }
+    sprintf(source, "%s/source.tex", dirname);
+    sprintf(link, "%s/link.tex", dirname);
+    file = fopen(source, "w");
+    if (file == NULL || fputs(latex, file) == EOF || fclose(file) != 0
+        || symlink("source.tex", link) != 0) {
+        fprintf(stderr, "Unable to create %s: %s.\n", link, strerror(errno));
+        failures++;
+    } else {
+        /* a relative symlink must not be linked as is into the temporary directory */
+        texcaller_convert_path(&pdf, &pdf_size, &info, link, "LaTeX", "PDF", 5, NULL);
+        if (pdf == NULL) {
+            fprintf(stderr, "Symlinked source: %s\n", info == NULL ? "Out of memory." : info);
+            failures++;
+        }
+        free(pdf);
+        free(info);
+    }
+    unlink(link);
+    unlink(source);
+    rmdir(dirname);
+}
+
+int main()
+{
+    /* unicode quotes and dashes must not form ligatures with their neighbours */
+    test_escape("!\xe2\x80\x98x\xe2\x80\x99", "!{}`x{'}");
+    test_escape("?\xe2\x80\x9cx\xe2\x80\x9d", "?{}``x{''}");
+    test_escape("\xe2\x80\x93-", "{--}-");
+    test_escape("-\xe2\x80\x94\xe2\x80\x93", "-{---}{--}");
+    test_symlink_source();
+    printf("%i failures.\n", failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -11,18 +11,111 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*! Whether \c posix_spawn() is able to change the working directory
+ *  of the child process.
+ *
+ *  This is the case for glibc ≥ 2.29, which provides
+ *  \c posix_spawn_file_actions_addchdir_np().
+ *  Define \c TEXCALLER_NO_POSIX_SPAWN to always use the
+ *  \c fork() based backend.
+ */
+#if !defined(TEXCALLER_NO_POSIX_SPAWN) && defined(__GLIBC__) \
+    && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#define TEXCALLER_HAVE_POSIX_SPAWN_CHDIR 1
+#else
+#define TEXCALLER_HAVE_POSIX_SPAWN_CHDIR 0
+#endif
+
+/*! Whether \c copy_file_range() is available,
+ *  which is the case for glibc ≥ 2.27.
+ */
+#if defined(__linux__) && defined(__GLIBC__) \
+    && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define TEXCALLER_HAVE_COPY_FILE_RANGE 1
+#else
+#define TEXCALLER_HAVE_COPY_FILE_RANGE 0
+#endif
+
+/*! Additional mode for \c fopen() to set the close-on-exec flag,
+ *  so that file descriptors don't leak into commands
+ *  started concurrently by other threads.
+ */
+#ifdef __GLIBC__
+#define FOPEN_CLOEXEC "e"
+#else
+#define FOPEN_CLOEXEC ""
+#endif
+
+/*! Ensures that environment_init() is called only once. */
+static pthread_once_t environment_once = PTHREAD_ONCE_INIT;
+
+/*! Value of \c TMPDIR, or \c "/tmp" if not set. */
+static const char *environment_tmpdir = "/tmp";
+
+/*! Value of \c PATH, or \c "" if not set. */
+static const char *environment_path = "";
+
+/*! Read the environment variables used by this library.
+ *
+ *  This is done only once,
+ *  because \c getenv() is not thread-safe
+ *  with regard to concurrent modifications of the environment.
+ *  Call via \c pthread_once() with \c environment_once.
+ */
+static void environment_init(void)
+{
+    const char *tmpdir = getenv("TMPDIR");
+    const char *path = getenv("PATH");
+    char *copy;
+    if (tmpdir != NULL && strcmp(tmpdir, "") != 0) {
+        copy = (char *)malloc(strlen(tmpdir) + 1);
+        if (copy != NULL) {
+            strcpy(copy, tmpdir);
+            environment_tmpdir = copy;
+        }
+    }
+    if (path != NULL) {
+        copy = (char *)malloc(strlen(path) + 1);
+        if (copy != NULL) {
+            strcpy(copy, path);
+            environment_path = copy;
+        }
+    }
+}
+
 /*! Escape a single character for LaTeX.
  *
  *  \param c
@@ -57,6 +150,497 @@ static const char *escape_latex_char(char c)
     }
 }
 
+/*! Classification of bytes for escape_latex().
+ *
+ *  - 0: ASCII character that is copied verbatim
+ *  - 1: ASCII character that is replaced via escape_latex_char()
+ *  - 2: part of a non-ASCII UTF-8 sequence
+ */
+static const unsigned char escape_latex_byte_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1,
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 0,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2
+};
+
+/*! A LaTeX replacement of a unicode character.
+ */
+typedef struct unicode_latex_macro
+{
+    /*! the unicode code point */
+    unsigned long code_point;
+    /*! the LaTeX replacement */
+    const char *macro;
+} unicode_latex_macro;
+
+/*! LaTeX replacements of unicode characters, sorted by code point.
+ *
+ *  This covers the Latin-1 Supplement, the accented letters of
+ *  Latin Extended-A, Greek letters, typographic punctuation
+ *  and common symbols.
+ *  A few of these, such as \c \\k or \c \\guillemotleft,
+ *  need the T1 font encoding.
+ */
+static const unicode_latex_macro unicode_latex_macros[] = {
+    {0x00A0, "~"},
+    {0x00A1, "\\textexclamdown{}"},
+    {0x00A2, "\\textcent{}"},
+    {0x00A3, "\\pounds{}"},
+    {0x00A5, "\\textyen{}"},
+    {0x00A7, "\\S{}"},
+    {0x00A9, "\\copyright{}"},
+    {0x00AA, "\\textordfeminine{}"},
+    {0x00AB, "\\guillemotleft{}"},
+    {0x00AC, "\\ensuremath{\\neg}"},
+    {0x00AD, "\\-"},
+    {0x00AE, "\\textregistered{}"},
+    {0x00B0, "\\textdegree{}"},
+    {0x00B1, "\\ensuremath{\\pm}"},
+    {0x00B2, "\\ensuremath{^2}"},
+    {0x00B3, "\\ensuremath{^3}"},
+    {0x00B5, "\\textmu{}"},
+    {0x00B6, "\\P{}"},
+    {0x00B7, "\\textperiodcentered{}"},
+    {0x00B9, "\\ensuremath{^1}"},
+    {0x00BA, "\\textordmasculine{}"},
+    {0x00BB, "\\guillemotright{}"},
+    {0x00BC, "\\textonequarter{}"},
+    {0x00BD, "\\textonehalf{}"},
+    {0x00BE, "\\textthreequarters{}"},
+    {0x00BF, "\\textquestiondown{}"},
+    {0x00C0, "\\`{A}"},
+    {0x00C1, "\\'{A}"},
+    {0x00C2, "\\^{A}"},
+    {0x00C3, "\\~{A}"},
+    {0x00C4, "\\\"{A}"},
+    {0x00C5, "\\AA{}"},
+    {0x00C6, "\\AE{}"},
+    {0x00C7, "\\c{C}"},
+    {0x00C8, "\\`{E}"},
+    {0x00C9, "\\'{E}"},
+    {0x00CA, "\\^{E}"},
+    {0x00CB, "\\\"{E}"},
+    {0x00CC, "\\`{I}"},
+    {0x00CD, "\\'{I}"},
+    {0x00CE, "\\^{I}"},
+    {0x00CF, "\\\"{I}"},
+    {0x00D0, "\\DH{}"},
+    {0x00D1, "\\~{N}"},
+    {0x00D2, "\\`{O}"},
+    {0x00D3, "\\'{O}"},
+    {0x00D4, "\\^{O}"},
+    {0x00D5, "\\~{O}"},
+    {0x00D6, "\\\"{O}"},
+    {0x00D7, "\\texttimes{}"},
+    {0x00D8, "\\O{}"},
+    {0x00D9, "\\`{U}"},
+    {0x00DA, "\\'{U}"},
+    {0x00DB, "\\^{U}"},
+    {0x00DC, "\\\"{U}"},
+    {0x00DD, "\\'{Y}"},
+    {0x00DE, "\\TH{}"},
+    {0x00DF, "\\ss{}"},
+    {0x00E0, "\\`{a}"},
+    {0x00E1, "\\'{a}"},
+    {0x00E2, "\\^{a}"},
+    {0x00E3, "\\~{a}"},
+    {0x00E4, "\\\"{a}"},
+    {0x00E5, "\\aa{}"},
+    {0x00E6, "\\ae{}"},
+    {0x00E7, "\\c{c}"},
+    {0x00E8, "\\`{e}"},
+    {0x00E9, "\\'{e}"},
+    {0x00EA, "\\^{e}"},
+    {0x00EB, "\\\"{e}"},
+    {0x00EC, "\\`{\\i}"},
+    {0x00ED, "\\'{\\i}"},
+    {0x00EE, "\\^{\\i}"},
+    {0x00EF, "\\\"{\\i}"},
+    {0x00F0, "\\dh{}"},
+    {0x00F1, "\\~{n}"},
+    {0x00F2, "\\`{o}"},
+    {0x00F3, "\\'{o}"},
+    {0x00F4, "\\^{o}"},
+    {0x00F5, "\\~{o}"},
+    {0x00F6, "\\\"{o}"},
+    {0x00F7, "\\textdiv{}"},
+    {0x00F8, "\\o{}"},
+    {0x00F9, "\\`{u}"},
+    {0x00FA, "\\'{u}"},
+    {0x00FB, "\\^{u}"},
+    {0x00FC, "\\\"{u}"},
+    {0x00FD, "\\'{y}"},
+    {0x00FE, "\\th{}"},
+    {0x00FF, "\\\"{y}"},
+    {0x0100, "\\={A}"},
+    {0x0101, "\\={a}"},
+    {0x0102, "\\u{A}"},
+    {0x0103, "\\u{a}"},
+    {0x0104, "\\k{A}"},
+    {0x0105, "\\k{a}"},
+    {0x0106, "\\'{C}"},
+    {0x0107, "\\'{c}"},
+    {0x0108, "\\^{C}"},
+    {0x0109, "\\^{c}"},
+    {0x010A, "\\.{C}"},
+    {0x010B, "\\.{c}"},
+    {0x010C, "\\v{C}"},
+    {0x010D, "\\v{c}"},
+    {0x010E, "\\v{D}"},
+    {0x010F, "\\v{d}"},
+    {0x0110, "\\DJ{}"},
+    {0x0111, "\\dj{}"},
+    {0x0112, "\\={E}"},
+    {0x0113, "\\={e}"},
+    {0x0114, "\\u{E}"},
+    {0x0115, "\\u{e}"},
+    {0x0116, "\\.{E}"},
+    {0x0117, "\\.{e}"},
+    {0x0118, "\\k{E}"},
+    {0x0119, "\\k{e}"},
+    {0x011A, "\\v{E}"},
+    {0x011B, "\\v{e}"},
+    {0x011C, "\\^{G}"},
+    {0x011D, "\\^{g}"},
+    {0x011E, "\\u{G}"},
+    {0x011F, "\\u{g}"},
+    {0x0120, "\\.{G}"},
+    {0x0121, "\\.{g}"},
+    {0x0122, "\\c{G}"},
+    {0x0123, "\\c{g}"},
+    {0x0124, "\\^{H}"},
+    {0x0125, "\\^{h}"},
+    {0x0128, "\\~{I}"},
+    {0x0129, "\\~{\\i}"},
+    {0x012A, "\\={I}"},
+    {0x012B, "\\={\\i}"},
+    {0x012C, "\\u{I}"},
+    {0x012D, "\\u{\\i}"},
+    {0x012E, "\\k{I}"},
+    {0x012F, "\\k{i}"},
+    {0x0130, "\\.{I}"},
+    {0x0131, "\\i{}"},
+    {0x0134, "\\^{J}"},
+    {0x0135, "\\^{\\j}"},
+    {0x0136, "\\c{K}"},
+    {0x0137, "\\c{k}"},
+    {0x0139, "\\'{L}"},
+    {0x013A, "\\'{l}"},
+    {0x013B, "\\c{L}"},
+    {0x013C, "\\c{l}"},
+    {0x013D, "\\v{L}"},
+    {0x013E, "\\v{l}"},
+    {0x0141, "\\L{}"},
+    {0x0142, "\\l{}"},
+    {0x0143, "\\'{N}"},
+    {0x0144, "\\'{n}"},
+    {0x0145, "\\c{N}"},
+    {0x0146, "\\c{n}"},
+    {0x0147, "\\v{N}"},
+    {0x0148, "\\v{n}"},
+    {0x014C, "\\={O}"},
+    {0x014D, "\\={o}"},
+    {0x014E, "\\u{O}"},
+    {0x014F, "\\u{o}"},
+    {0x0150, "\\H{O}"},
+    {0x0151, "\\H{o}"},
+    {0x0152, "\\OE{}"},
+    {0x0153, "\\oe{}"},
+    {0x0154, "\\'{R}"},
+    {0x0155, "\\'{r}"},
+    {0x0156, "\\c{R}"},
+    {0x0157, "\\c{r}"},
+    {0x0158, "\\v{R}"},
+    {0x0159, "\\v{r}"},
+    {0x015A, "\\'{S}"},
+    {0x015B, "\\'{s}"},
+    {0x015C, "\\^{S}"},
+    {0x015D, "\\^{s}"},
+    {0x015E, "\\c{S}"},
+    {0x015F, "\\c{s}"},
+    {0x0160, "\\v{S}"},
+    {0x0161, "\\v{s}"},
+    {0x0162, "\\c{T}"},
+    {0x0163, "\\c{t}"},
+    {0x0164, "\\v{T}"},
+    {0x0165, "\\v{t}"},
+    {0x0168, "\\~{U}"},
+    {0x0169, "\\~{u}"},
+    {0x016A, "\\={U}"},
+    {0x016B, "\\={u}"},
+    {0x016C, "\\u{U}"},
+    {0x016D, "\\u{u}"},
+    {0x016E, "\\r{U}"},
+    {0x016F, "\\r{u}"},
+    {0x0170, "\\H{U}"},
+    {0x0171, "\\H{u}"},
+    {0x0172, "\\k{U}"},
+    {0x0173, "\\k{u}"},
+    {0x0174, "\\^{W}"},
+    {0x0175, "\\^{w}"},
+    {0x0176, "\\^{Y}"},
+    {0x0177, "\\^{y}"},
+    {0x0178, "\\\"{Y}"},
+    {0x0179, "\\'{Z}"},
+    {0x017A, "\\'{z}"},
+    {0x017B, "\\.{Z}"},
+    {0x017C, "\\.{z}"},
+    {0x017D, "\\v{Z}"},
+    {0x017E, "\\v{z}"},
+    {0x0393, "\\ensuremath{\\Gamma}"},
+    {0x0394, "\\ensuremath{\\Delta}"},
+    {0x0398, "\\ensuremath{\\Theta}"},
+    {0x039B, "\\ensuremath{\\Lambda}"},
+    {0x039E, "\\ensuremath{\\Xi}"},
+    {0x03A0, "\\ensuremath{\\Pi}"},
+    {0x03A3, "\\ensuremath{\\Sigma}"},
+    {0x03A5, "\\ensuremath{\\Upsilon}"},
+    {0x03A6, "\\ensuremath{\\Phi}"},
+    {0x03A8, "\\ensuremath{\\Psi}"},
+    {0x03A9, "\\ensuremath{\\Omega}"},
+    {0x03B1, "\\ensuremath{\\alpha}"},
+    {0x03B2, "\\ensuremath{\\beta}"},
+    {0x03B3, "\\ensuremath{\\gamma}"},
+    {0x03B4, "\\ensuremath{\\delta}"},
+    {0x03B5, "\\ensuremath{\\epsilon}"},
+    {0x03B6, "\\ensuremath{\\zeta}"},
+    {0x03B7, "\\ensuremath{\\eta}"},
+    {0x03B8, "\\ensuremath{\\theta}"},
+    {0x03B9, "\\ensuremath{\\iota}"},
+    {0x03BA, "\\ensuremath{\\kappa}"},
+    {0x03BB, "\\ensuremath{\\lambda}"},
+    {0x03BC, "\\ensuremath{\\mu}"},
+    {0x03BD, "\\ensuremath{\\nu}"},
+    {0x03BE, "\\ensuremath{\\xi}"},
+    {0x03BF, "\\ensuremath{o}"},
+    {0x03C0, "\\ensuremath{\\pi}"},
+    {0x03C1, "\\ensuremath{\\rho}"},
+    {0x03C2, "\\ensuremath{\\varsigma}"},
+    {0x03C3, "\\ensuremath{\\sigma}"},
+    {0x03C4, "\\ensuremath{\\tau}"},
+    {0x03C5, "\\ensuremath{\\upsilon}"},
+    {0x03C6, "\\ensuremath{\\phi}"},
+    {0x03C7, "\\ensuremath{\\chi}"},
+    {0x03C8, "\\ensuremath{\\psi}"},
+    {0x03C9, "\\ensuremath{\\omega}"},
+    /* grouped to avoid ?` and !`, and ligatures with adjacent dashes and quotes */
+    {0x2013, "{--}"},
+    {0x2014, "{---}"},
+    {0x2018, "{}`"},
+    {0x2019, "{'}"},
+    {0x201A, "\\quotesinglbase{}"},
+    {0x201C, "{}``"},
+    {0x201D, "{''}"},
+    {0x201E, "\\quotedblbase{}"},
+    {0x2020, "\\dag{}"},
+    {0x2021, "\\ddag{}"},
+    {0x2022, "\\textbullet{}"},
+    {0x2026, "\\dots{}"},
+    {0x2030, "\\textperthousand{}"},
+    {0x2039, "\\guilsinglleft{}"},
+    {0x203A, "\\guilsinglright{}"},
+    {0x20AC, "\\texteuro{}"},
+    {0x2122, "\\texttrademark{}"},
+    {0x2190, "\\ensuremath{\\leftarrow}"},
+    {0x2191, "\\ensuremath{\\uparrow}"},
+    {0x2192, "\\ensuremath{\\rightarrow}"},
+    {0x2193, "\\ensuremath{\\downarrow}"},
+    {0x2194, "\\ensuremath{\\leftrightarrow}"},
+    {0x21D2, "\\ensuremath{\\Rightarrow}"},
+    {0x21D4, "\\ensuremath{\\Leftrightarrow}"},
+    {0x2200, "\\ensuremath{\\forall}"},
+    {0x2202, "\\ensuremath{\\partial}"},
+    {0x2203, "\\ensuremath{\\exists}"},
+    {0x2205, "\\ensuremath{\\emptyset}"},
+    {0x2207, "\\ensuremath{\\nabla}"},
+    {0x2208, "\\ensuremath{\\in}"},
+    {0x2209, "\\ensuremath{\\notin}"},
+    {0x2211, "\\ensuremath{\\sum}"},
+    {0x2212, "\\ensuremath{-}"},
+    {0x2217, "\\ensuremath{\\ast}"},
+    {0x221A, "\\ensuremath{\\surd}"},
+    {0x221E, "\\ensuremath{\\infty}"},
+    {0x2227, "\\ensuremath{\\wedge}"},
+    {0x2228, "\\ensuremath{\\vee}"},
+    {0x2229, "\\ensuremath{\\cap}"},
+    {0x222A, "\\ensuremath{\\cup}"},
+    {0x222B, "\\ensuremath{\\int}"},
+    {0x2248, "\\ensuremath{\\approx}"},
+    {0x2260, "\\ensuremath{\\neq}"},
+    {0x2261, "\\ensuremath{\\equiv}"},
+    {0x2264, "\\ensuremath{\\leq}"},
+    {0x2265, "\\ensuremath{\\geq}"},
+    {0x2282, "\\ensuremath{\\subset}"},
+    {0x2283, "\\ensuremath{\\supset}"},
+    {0x2286, "\\ensuremath{\\subseteq}"},
+    {0x2287, "\\ensuremath{\\supseteq}"},
+    {0x22C5, "\\ensuremath{\\cdot}"}
+};
+
+/*! Look up the LaTeX replacement of a unicode character.
+ *
+ *  \param code_point
+ *      the unicode code point
+ *
+ *  \return
+ *      a string constant (not to be freed)
+ *      containing the character's replacement,
+ *      or \c NULL if there is none.
+ */
+static const char *unicode_latex_macro_lookup(unsigned long code_point)
+{
+    size_t low = 0;
+    size_t high = sizeof(unicode_latex_macros) / sizeof(unicode_latex_macros[0]);
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (unicode_latex_macros[middle].code_point < code_point) {
+            low = middle + 1;
+        } else if (unicode_latex_macros[middle].code_point > code_point) {
+            high = middle;
+        } else {
+            return unicode_latex_macros[middle].macro;
+        }
+    }
+    return NULL;
+}
+
+/*! Decode a single UTF-8 sequence.
+ *
+ *  \param code_point
+ *      will be set to the decoded unicode code point
+ *
+ *  \param s
+ *      the UTF-8 sequence
+ *
+ *  \param size
+ *      number of available bytes in \c s
+ *
+ *  \return
+ *      the length of the UTF-8 sequence,
+ *      or 0 if \c s doesn't start with a valid UTF-8 sequence.
+ */
+static size_t decode_utf8(unsigned long *code_point, const char *s, size_t size)
+{
+    const unsigned char *u = (const unsigned char *)s;
+    size_t length;
+    size_t i;
+    if (u[0] >= 0xc2 && u[0] <= 0xdf) {
+        length = 2;
+        *code_point = u[0] & 0x1f;
+    } else if (u[0] >= 0xe0 && u[0] <= 0xef) {
+        length = 3;
+        *code_point = u[0] & 0x0f;
+    } else if (u[0] >= 0xf0 && u[0] <= 0xf4) {
+        length = 4;
+        *code_point = u[0] & 0x07;
+    } else {
+        return 0;
+    }
+    if (length > size) {
+        return 0;
+    }
+    for (i = 1; i < length; i++) {
+        if ((u[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        *code_point = (*code_point << 6) | (u[i] & 0x3f);
+    }
+    /* reject overlong sequences, surrogates and values beyond unicode */
+    if (   (length == 3 && *code_point < 0x800)
+        || (length == 4 && (*code_point < 0x10000 || *code_point > 0x10ffff))
+        || (*code_point >= 0xd800 && *code_point <= 0xdfff)) {
+        return 0;
+    }
+    return length;
+}
+
+/*! Escape a buffer for direct use in LaTeX.
+ *
+ *  Runs of characters that don't need to be replaced
+ *  are copied as a whole.
+ *
+ *  \param result
+ *      buffer that receives the escaped value,
+ *      which must be large enough,
+ *      or \c NULL to only calculate the size of the escaped value.
+ *      No \c '\\0' is added.
+ *
+ *  \param s
+ *      the buffer to escape
+ *
+ *  \param size
+ *      size of \c s
+ *
+ *  \param unicode_macros
+ *      whether to replace non-ASCII characters by LaTeX macros
+ *      (see unicode_latex_macros) where possible,
+ *      rather than keeping them as they are
+ *
+ *  \return
+ *      the size of the escaped value
+ */
+static size_t escape_latex(char *result, const char *s, size_t size, int unicode_macros)
+{
+    const unsigned char mask = unicode_macros ? 3 : 1;
+    size_t pos = 0;
+    size_t i = 0;
+    for (;;) {
+        const char *replacement = NULL;
+        size_t length = 1;
+        size_t span_end = i;
+        /* copy characters that don't need to be replaced */
+        while (span_end < size && (escape_latex_byte_class[(unsigned char)s[span_end]] & mask) == 0) {
+            span_end++;
+        }
+        if (result != NULL) {
+            memcpy(result + pos, s + i, span_end - i);
+        }
+        pos += span_end - i;
+        i = span_end;
+        if (i == size) {
+            return pos;
+        }
+        /* replace the next character */
+        if (escape_latex_byte_class[(unsigned char)s[i]] == 1) {
+            replacement = escape_latex_char(s[i]);
+        } else {
+            unsigned long code_point;
+            length = decode_utf8(&code_point, s + i, size - i);
+            if (length == 0) {
+                /* keep invalid UTF-8 as it is */
+                length = 1;
+            } else {
+                replacement = unicode_latex_macro_lookup(code_point);
+            }
+        }
+        if (replacement == NULL) {
+            if (result != NULL) {
+                memcpy(result + pos, s + i, length);
+            }
+            pos += length;
+        } else {
+            const size_t replacement_length = strlen(replacement);
+            if (result != NULL) {
+                memcpy(result + pos, replacement, replacement_length);
+            }
+            pos += replacement_length;
+        }
+        i += length;
+    }
+}
+
 /*! Variant of \c sprintf() that allocates the needed memory automatically.
  *
  *  \param format
@@ -99,6 +683,172 @@ static char *sprintf_alloc(const char *format, ...)
     return result;
 }
 
+/*! Append a formatted string to a newly allocated string.
+ *
+ *  \param s
+ *      a newly allocated string, which will be freed,
+ *      or \c NULL
+ *
+ *  \param format
+ *      format string for sprintf()
+ *
+ *  \param ...
+ *      further arguments to sprintf()
+ *
+ *  \return
+ *      a newly allocated string containing \c s
+ *      followed by the result of \c sprintf(),
+ *      or \c NULL when out of memory, sprintf() failed,
+ *      or \c s was \c NULL.
+ */
+static char *append_alloc(char *s, const char *format, ...)
+{
+    va_list ap;
+    char tmp_result[1];
+    char *result;
+    size_t s_len;
+    int len;
+    int len_written;
+    if (s == NULL) {
+        return NULL;
+    }
+    s_len = strlen(s);
+    /* calculate result size */
+    va_start(ap, format);
+    len = vsnprintf(tmp_result, sizeof(tmp_result), format, ap);
+    va_end(ap);
+    if (len < 0) {
+        free(s);
+        return NULL;
+    }
+    /* allocate memory for result */
+    result = (char *)realloc(s, s_len + len + 1);
+    if (result == NULL) {
+        free(s);
+        return NULL;
+    }
+    /* calculate result */
+    va_start(ap, format);
+    len_written = vsnprintf(result + s_len, len + 1, format, ap);
+    va_end(ap);
+    if (len_written != len) {
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*! Get the current time of a monotonic clock.
+ *
+ *  \return
+ *      the current time in seconds,
+ *      relative to an unspecified starting point
+ */
+static double monotonic_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*! Find the first occurence of a string within a buffer.
+ *
+ *  This is similar to \c strstr(),
+ *  but the buffer doesn't need to be terminated by \c '\\0'.
+ *
+ *  \param haystack
+ *      the buffer to search in
+ *
+ *  \param haystack_size
+ *      size of \c haystack
+ *
+ *  \param needle
+ *      the string to search for
+ *
+ *  \return
+ *      a pointer to the first occurence of \c needle within \c haystack,
+ *      or \c NULL if there is none.
+ */
+static const char *find_string(const char *haystack, size_t haystack_size, const char *needle)
+{
+    const size_t needle_size = strlen(needle);
+    size_t i;
+    if (needle_size > haystack_size) {
+        return NULL;
+    }
+    for (i = 0; i <= haystack_size - needle_size; i++) {
+        if (haystack[i] == needle[0] && memcmp(haystack + i, needle, needle_size) == 0) {
+            return haystack + i;
+        }
+    }
+    return NULL;
+}
+
+/*! Initial value for hash_bytes(). */
+#define HASH_BYTES_INIT 2166136261UL
+
+/*! Calculate the 32 bit FNV-1a hash of a buffer.
+ *
+ *  \param hash
+ *      \c HASH_BYTES_INIT,
+ *      or the result of a previous call to continue hashing
+ *
+ *  \param data
+ *      the buffer to hash
+ *
+ *  \param size
+ *      size of \c data
+ *
+ *  \return
+ *      the hash value
+ */
+static unsigned long hash_bytes(unsigned long hash, const char *data, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash = ((hash ^ (unsigned char)data[i]) * 16777619UL) & 0xffffffffUL;
+    }
+    return hash;
+}
+
+/*! Calculate a hash of the structure of a TeX document.
+ *
+ *  The hash covers the sequence of all control words
+ *  (such as \c \\section or \c \\label),
+ *  but not the text in between.
+ *  Documents generated from the same template
+ *  usually have the same structure,
+ *  and thus lead to similar auxiliary files.
+ *
+ *  \param source
+ *      the TeX document
+ *
+ *  \param source_size
+ *      size of \c source
+ *
+ *  \return
+ *      the hash value
+ */
+static unsigned long hash_structure(const char *source, size_t source_size)
+{
+    unsigned long hash = HASH_BYTES_INIT;
+    size_t i;
+    for (i = 0; i < source_size; i++) {
+        size_t end;
+        if (source[i] != '\\') {
+            continue;
+        }
+        for (end = i + 1;
+             end < source_size && (   (source[end] >= 'a' && source[end] <= 'z')
+                                   || (source[end] >= 'A' && source[end] <= 'Z'));
+             end++) {
+        }
+        hash = hash_bytes(hash, source + i, end - i);
+        i = end - 1;
+    }
+    return hash;
+}
+
 /*! Remove a directory recursively like <tt>rm -r</tt>.
  *
  *  \return
@@ -165,354 +915,7544 @@ static int remove_directory_recursively(char **error, const char *dirname)
     return 0;
 }
 
-/*! Read a file completely into a buffer that can be used as a string.
+/*! Remove the contents of a directory recursively,
+ *  using only paths relative to the directory's file descriptor.
  *
- *  \param result
- *      will be set to a newly allocated buffer that contains
- *      the complete content of the file,
- *      with a \c '\\0' added to the end.
- *      If an error occured,
- *      \c result will be set to \c NULL.
- *
- *  \param result_size
- *      will be set to the size of \c result,
- *      not counting the added \c '\\0'.
- *      If an error occured,
- *      \c result_size will be set to \c 0.
+ *  Unlike remove_directory_recursively(),
+ *  this doesn't build any path strings,
+ *  and isn't affected by the directory being renamed meanwhile.
+ *  Symbolic links are removed, but never followed.
  *
- *  \param error
- *      On failure, \c error will be set to a newly allocated string
- *      that contains the error message.
- *      On success, or when out of memory,
- *      \c error will be set to \c NULL.
+ *  \return
+ *      0 on success, -1 on failure
  *
- *  \param path
- *      path of the file to read
+ *  \param fd
+ *      file descriptor of the directory,
+ *      which remains open
  */
-static void read_file(char **result, size_t *result_size, char **error, const char *path)
+static int remove_directory_contents_at(int fd)
 {
-    FILE *file;
-    long file_size;
-    size_t read_size;
-    *result = NULL;
-    *error = NULL;
-    file = fopen(path, "rb");
-    if (file == NULL) {
-        *error = sprintf_alloc("Unable to open file \"%s\" for reading: %s.",
-                               path, strerror(errno));
-        goto error_cleanup;
-    }
-    if (fseek(file, 0, SEEK_END) != 0) {
-        *error = sprintf_alloc("Unable to seek to end of file \"%s\": %s.",
-                               path, strerror(errno));
-        goto error_cleanup;
-    }
-    file_size = ftell(file);
-    if (file_size == -1) {
-        *error = sprintf_alloc("Unable to obtain size of file \"%s\": %s.",
-                               path, strerror(errno));
-        goto error_cleanup;
-    }
-    *result_size = file_size;
-    if (fseek(file, 0, SEEK_SET) != 0) {
-        *error = sprintf_alloc("Unable to seek back to start of file \"%s\": %s.",
-                               path, strerror(errno));
-        goto error_cleanup;
-    }
-    *result = (char *)malloc(*result_size + 1);
-    if (*result == NULL) {
-        *error = sprintf_alloc("Unable to allocate buffer for reading file \"%s\": %s.",
-                               path, strerror(errno));
-        goto error_cleanup;
+    DIR *dir;
+    struct dirent *entry;
+    int dir_fd;
+    int result = 0;
+    dir_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dir_fd == -1) {
+        return -1;
     }
-    (*result)[*result_size] = '\0';
-    read_size = fread(*result, 1, *result_size, file);
-    if (ferror(file)) {
-        *error = sprintf_alloc("Unable to read %lu bytes from file \"%s\": %s.",
-                               (unsigned long)*result_size, path, strerror(errno));
-        goto error_cleanup;
+    dir = fdopendir(dir_fd);
+    if (dir == NULL) {
+        close(dir_fd);
+        return -1;
     }
-    if (read_size != *result_size) {
-        *error = sprintf_alloc("Unable to read %lu bytes from file \"%s\": Got only %lu bytes.",
-                               (unsigned long)*result_size, path, (unsigned long)read_size);
-        goto error_cleanup;
+    for (entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        if (   strcmp(entry->d_name, ".") == 0
+            || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (entry->d_type != DT_DIR && unlinkat(fd, entry->d_name, 0) == 0) {
+            continue;
+        }
+        if (entry->d_type == DT_DIR || errno == EISDIR) {
+            int sub_fd = openat(fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (sub_fd != -1) {
+                if (remove_directory_contents_at(sub_fd) != 0) {
+                    result = -1;
+                }
+                close(sub_fd);
+            }
+            if (unlinkat(fd, entry->d_name, AT_REMOVEDIR) == 0) {
+                continue;
+            }
+        }
+        result = -1;
     }
-    if (fclose(file) != 0) {
-        *error = sprintf_alloc("Unable to close file \"%s\" after reading: %s.",
-                               path, strerror(errno));
-        file = NULL;
+    closedir(dir);
+    return result;
+}
+
+/*! \name Workspace manager
+ *
+ *  Removing a temporary directory costs several system calls per file.
+ *  To keep this off the latency path of texcaller_convert_with_options(),
+ *  the workspace manager moves finished temporary directories
+ *  into a trash directory via a single \c rename(),
+ *  and reclaims them in a background thread.
+ *  If requested, emptied temporary directories are kept
+ *  in a pool for reuse instead of being removed.
+ *
+ *  When the workspace manager starts,
+ *  it also reclaims the trash left behind by crashed processes,
+ *  as well as temporary directories that are no longer in use.
+ *  For that purpose, temporary directories are named
+ *  <tt>texcaller-temp-PID-XXXXXX</tt>,
+ *  and whoever uses one holds an exclusive \c flock() on it,
+ *  which the kernel releases when the process dies.
+ *  Process IDs alone can't tell that,
+ *  since they are reused, and differ between PID namespaces.
+ *
+ *  @{
+ */
+
+/*! Maximum number of emptied temporary directories kept for reuse. */
+#define WORKSPACE_POOL_SIZE 16
+
+/*! Seconds after its last change before an unlocked temporary directory
+ *  is recovered, which covers the gap between \c mkdtemp() and locking it.
+ */
+#define WORKSPACE_RECOVERY_DELAY 60
+
+/*! Protects all \c workspace_* variables. */
+static pthread_mutex_t workspace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*! Signaled when there is new trash to reclaim. */
+static pthread_cond_t workspace_cond = PTHREAD_COND_INITIALIZER;
+
+/*! Process that started the workspace manager, or 0 if not started. */
+static pid_t workspace_pid = 0;
+
+/*! Directory containing the temporary directories. */
+static char *workspace_tmpdir = NULL;
+
+/*! Trash directory, a subdirectory of \c workspace_tmpdir. */
+static char *workspace_trash = NULL;
+
+/*! Whether there is trash that hasn't been reclaimed yet. */
+static int workspace_trash_pending = 0;
+
+/*! Whether emptied temporary directories should be kept for reuse. */
+static int workspace_recycle = 0;
+
+/*! Emptied temporary directories ready for reuse. */
+static char *workspace_pool[WORKSPACE_POOL_SIZE];
+
+/*! Locks of the elements in \c workspace_pool, see lock_workspace(). */
+static int workspace_pool_lock_fds[WORKSPACE_POOL_SIZE];
+
+/*! Number of elements in \c workspace_pool. */
+static int workspace_pool_size = 0;
+
+/*! Lock a temporary directory while it is in use.
+ *
+ *  \return
+ *      the file descriptor holding the lock, to be closed when done,
+ *      or -1 on failure
+ *
+ *  \param dir
+ *      the temporary directory
+ */
+static int lock_workspace(const char *dir)
+{
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd != -1 && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/*! Move temporary directories that are no longer in use
+ *  into the trash.
+ *
+ *  Only directories owned by the current user are considered,
+ *  and only if their lock can be taken
+ *  and they haven't changed for \c WORKSPACE_RECOVERY_DELAY seconds.
+ *
+ *  \param tmpdir
+ *      directory containing the temporary directories
+ *
+ *  \param trash
+ *      the trash directory
+ */
+static void recover_workspaces(const char *tmpdir, const char *trash)
+{
+    DIR *dir;
+    struct dirent *entry;
+    dir = opendir(tmpdir);
+    if (dir == NULL) {
+        return;
+    }
+    for (entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        char *name;
+        char *trash_name;
+        struct stat st;
+        int lock_fd;
+        if (strncmp(entry->d_name, "texcaller-temp-", strlen("texcaller-temp-")) != 0) {
+            continue;
+        }
+        name = sprintf_alloc("%s/%s", tmpdir, entry->d_name);
+        trash_name = sprintf_alloc("%s/%s", trash, entry->d_name);
+        lock_fd = name == NULL ? -1 : lock_workspace(name);
+        /* the lock is released after the rename,
+           so the trash can be reclaimed by any process */
+        if (   lock_fd != -1 && trash_name != NULL
+            && fstat(lock_fd, &st) == 0 && st.st_uid == getuid()
+            && time(NULL) - st.st_ctime >= WORKSPACE_RECOVERY_DELAY) {
+            rename(name, trash_name);
+        }
+        if (lock_fd != -1) {
+            close(lock_fd);
+        }
+        free(name);
+        free(trash_name);
+    }
+    closedir(dir);
+}
+
+/*! Reclaim all temporary directories within the trash.
+ *
+ *  Emptied temporary directories of the current process
+ *  are put into \c workspace_pool if recycling is enabled
+ *  and the pool isn't full, still locked.
+ *  All others are removed,
+ *  except for those locked by other processes reclaiming them.
+ *
+ *  \param tmpdir
+ *      directory containing the temporary directories
+ *
+ *  \param trash
+ *      the trash directory
+ */
+static void reclaim_trash(const char *tmpdir, const char *trash)
+{
+    DIR *dir;
+    struct dirent *entry;
+    int trash_fd;
+    char *own_prefix;
+    trash_fd = open(trash, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (trash_fd == -1) {
+        return;
+    }
+    dir = opendir(trash);
+    own_prefix = sprintf_alloc("texcaller-temp-%lu-", (unsigned long)getpid());
+    if (dir == NULL || own_prefix == NULL) {
+        if (dir != NULL) {
+            closedir(dir);
+        }
+        free(own_prefix);
+        close(trash_fd);
+        return;
+    }
+    for (entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        int fd;
+        if (   strcmp(entry->d_name, ".") == 0
+            || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        fd = openat(trash_fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd == -1) {
+            /* tolerate entries being reclaimed by other processes */
+            unlinkat(trash_fd, entry->d_name, 0);
+            continue;
+        }
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            close(fd);
+            continue;
+        }
+        if (remove_directory_contents_at(fd) == 0
+            && strncmp(entry->d_name, own_prefix, strlen(own_prefix)) == 0) {
+            char *name = sprintf_alloc("%s/%s", tmpdir, entry->d_name);
+            int recycled = 0;
+            pthread_mutex_lock(&workspace_mutex);
+            if (   name != NULL
+                && workspace_recycle
+                && workspace_pool_size < WORKSPACE_POOL_SIZE
+                && renameat(trash_fd, entry->d_name, AT_FDCWD, name) == 0) {
+                workspace_pool[workspace_pool_size] = name;
+                workspace_pool_lock_fds[workspace_pool_size] = fd;
+                workspace_pool_size++;
+                recycled = 1;
+            }
+            pthread_mutex_unlock(&workspace_mutex);
+            if (recycled) {
+                continue;
+            }
+            free(name);
+        }
+        close(fd);
+        unlinkat(trash_fd, entry->d_name, AT_REMOVEDIR);
+    }
+    closedir(dir);
+    free(own_prefix);
+    close(trash_fd);
+}
+
+/*! Background thread of the workspace manager.
+ *
+ *  \param arg
+ *      unused
+ */
+static void *workspace_reclaimer(void *arg)
+{
+    (void)arg;
+    recover_workspaces(workspace_tmpdir, workspace_trash);
+    for (;;) {
+        pthread_mutex_lock(&workspace_mutex);
+        while (!workspace_trash_pending) {
+            pthread_cond_wait(&workspace_cond, &workspace_mutex);
+        }
+        workspace_trash_pending = 0;
+        pthread_mutex_unlock(&workspace_mutex);
+        reclaim_trash(workspace_tmpdir, workspace_trash);
+    }
+    return NULL;
+}
+
+/*! Start the workspace manager, unless already running.
+ *
+ *  The workspace manager serves only a single \c tmpdir,
+ *  the one it was first started with.
+ *
+ *  \return
+ *      0 if the workspace manager is running for \c tmpdir, -1 otherwise
+ *
+ *  \param tmpdir
+ *      directory containing the temporary directories
+ *
+ *  \param recycle
+ *      whether emptied temporary directories should be kept for reuse
+ */
+static int start_workspace_manager(const char *tmpdir, int recycle)
+{
+    int result = -1;
+    pthread_mutex_lock(&workspace_mutex);
+    if (workspace_pid != getpid()) {
+        /* not started yet, or started by the parent of a forked process */
+        pthread_t thread;
+        pthread_attr_t attr;
+        struct stat st;
+        free(workspace_tmpdir);
+        free(workspace_trash);
+        while (workspace_pool_size > 0) {
+            workspace_pool_size--;
+            free(workspace_pool[workspace_pool_size]);
+            close(workspace_pool_lock_fds[workspace_pool_size]);
+        }
+        workspace_pid = 0;
+        workspace_tmpdir = sprintf_alloc("%s", tmpdir);
+        workspace_trash = sprintf_alloc("%s/texcaller-trash-%lu", tmpdir, (unsigned long)getuid());
+        if (   workspace_tmpdir != NULL && workspace_trash != NULL
+            && (mkdir(workspace_trash, 0700) == 0 || errno == EEXIST)
+            && lstat(workspace_trash, &st) == 0
+            && S_ISDIR(st.st_mode) && st.st_uid == getuid()
+            && pthread_attr_init(&attr) == 0) {
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+            if (pthread_create(&thread, &attr, workspace_reclaimer, NULL) == 0) {
+                workspace_pid = getpid();
+                /* reclaim trash left behind by crashed processes */
+                workspace_trash_pending = 1;
+            }
+            pthread_attr_destroy(&attr);
+        }
+    }
+    if (workspace_pid == getpid() && strcmp(workspace_tmpdir, tmpdir) == 0) {
+        workspace_recycle |= recycle;
+        result = 0;
+    }
+    pthread_mutex_unlock(&workspace_mutex);
+    return result;
+}
+
+/*! Take an emptied temporary directory from the pool.
+ *
+ *  \return
+ *      a newly allocated string containing the path
+ *      of the temporary directory,
+ *      or \c NULL if the pool is empty.
+ *
+ *  \param lock_fd
+ *      will be set to the lock of the temporary directory,
+ *      see lock_workspace()
+ */
+static char *acquire_workspace(int *lock_fd)
+{
+    char *dir = NULL;
+    pthread_mutex_lock(&workspace_mutex);
+    if (workspace_pid == getpid() && workspace_pool_size > 0) {
+        workspace_pool_size--;
+        dir = workspace_pool[workspace_pool_size];
+        *lock_fd = workspace_pool_lock_fds[workspace_pool_size];
+    }
+    pthread_mutex_unlock(&workspace_mutex);
+    return dir;
+}
+
+/*! Move a temporary directory into the trash,
+ *  to be reclaimed by the background thread.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param dir
+ *      the temporary directory,
+ *      which must be located within the workspace manager's \c tmpdir
+ *
+ *  \param lock_fd
+ *      the lock of the temporary directory, see lock_workspace(),
+ *      which is closed on success
+ */
+static int trash_workspace(const char *dir, int lock_fd)
+{
+    const char *name = strrchr(dir, '/') + 1;
+    char *trash_name;
+    int result;
+    trash_name = sprintf_alloc("%s/%s", workspace_trash, name);
+    if (trash_name == NULL) {
+        return -1;
+    }
+    result = rename(dir, trash_name);
+    free(trash_name);
+    if (result != 0) {
+        return -1;
+    }
+    close(lock_fd);
+    pthread_mutex_lock(&workspace_mutex);
+    workspace_trash_pending = 1;
+    pthread_cond_signal(&workspace_cond);
+    pthread_mutex_unlock(&workspace_mutex);
+    return 0;
+}
+
+/*! @} */
+
+/*! \name Scheduler
+ *
+ *  The scheduler limits the number of concurrent conversions
+ *  within the current process,
+ *  as configured via texcaller_scheduler_configure().
+ *  Waiting conversions are started strictly by priority class
+ *  (see texcaller_options::priority).
+ *  Within the same priority class,
+ *  the tenants (see texcaller_options::tenant)
+ *  share the available slots via start-time fair queuing:
+ *  Each waiting conversion gets a virtual start tag
+ *  that advances per tenant by the reciprocal of the tenant's weight,
+ *  and the conversion with the smallest tag is started first.
+ *
+ *  Synchronous conversions wait on a condition variable.
+ *  Asynchronous conversions must not block,
+ *  so they wait in the same queue with a pipe instead,
+ *  which becomes readable when it's worth trying again to start.
+ *
+ *  @{
+ */
+
+/*! A conversion waiting in the scheduler's queue.
+ */
+typedef struct scheduler_job
+{
+    /*! priority class, see texcaller_options::priority */
+    int priority;
+    /*! virtual start tag */
+    double tag;
+    /*! enqueue order, to break ties */
+    unsigned long sequence;
+    /*! nonblocking pipe of an asynchronous conversion,
+        written to when it may start, or -1 for synchronous ones */
+    int wake_fds[2];
+    /*! next waiting conversion */
+    struct scheduler_job *next;
+} scheduler_job;
+
+/*! Virtual time of a tenant.
+ */
+typedef struct scheduler_tenant
+{
+    /*! name of the tenant */
+    char *name;
+    /*! virtual start tag of the tenant's most recently enqueued conversion */
+    double last_tag;
+} scheduler_tenant;
+
+/*! Protects all \c scheduler_* variables. */
+static pthread_mutex_t scheduler_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*! Signaled when a conversion finished or was started. */
+static pthread_cond_t scheduler_cond = PTHREAD_COND_INITIALIZER;
+
+/*! Maximum number of running conversions, or 0 for no limit. */
+static int scheduler_max_running = 0;
+
+/*! Maximum number of waiting conversions, or 0 for no limit. */
+static int scheduler_max_queued = 0;
+
+/*! Number of running conversions. */
+static int scheduler_running = 0;
+
+/*! Number of waiting conversions. */
+static int scheduler_queued = 0;
+
+/*! Waiting conversions, in no particular order. */
+static scheduler_job *scheduler_queue = NULL;
+
+/*! Number of conversions enqueued so far. */
+static unsigned long scheduler_sequence = 0;
+
+/*! Virtual start tag of the most recently started conversion. */
+static double scheduler_virtual_time = 0;
+
+/*! Virtual times of all tenants ahead of \c scheduler_virtual_time. */
+static scheduler_tenant *scheduler_tenants = NULL;
+
+/*! Number of elements in \c scheduler_tenants. */
+static size_t scheduler_tenants_count = 0;
+
+/*! Find the waiting conversion that should be started next.
+ *
+ *  \return
+ *      the next waiting conversion,
+ *      or \c NULL if there are none.
+ */
+static scheduler_job *scheduler_next(void)
+{
+    scheduler_job *best = NULL;
+    scheduler_job *job;
+    for (job = scheduler_queue; job != NULL; job = job->next) {
+        if (   best == NULL
+            || job->priority < best->priority
+            || (job->priority == best->priority && job->tag < best->tag)
+            || (job->priority == best->priority && job->tag == best->tag
+                && job->sequence < best->sequence)) {
+            best = job;
+        }
+    }
+    return best;
+}
+
+/*! Calculate the virtual start tag of a new conversion,
+ *  and advance the virtual time of its tenant.
+ *
+ *  Tenants whose virtual time has fallen behind \c scheduler_virtual_time
+ *  are forgotten, as a new entry would get the same tags.
+ *  That includes all tenants without waiting conversions,
+ *  so \c scheduler_tenants doesn't grow with every tenant ever seen.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param tag
+ *      will be set to the virtual start tag
+ *
+ *  \param tenant
+ *      name of the tenant
+ *
+ *  \param weight
+ *      weight of the tenant, must be > 0
+ */
+static int scheduler_tag(double *tag, const char *tenant, int weight)
+{
+    scheduler_tenant *entry = NULL;
+    size_t count = 0;
+    size_t i;
+    /* evict idle tenants */
+    for (i = 0; i < scheduler_tenants_count; i++) {
+        if (scheduler_tenants[i].last_tag <= scheduler_virtual_time) {
+            free(scheduler_tenants[i].name);
+        } else {
+            scheduler_tenants[count++] = scheduler_tenants[i];
+        }
+    }
+    scheduler_tenants_count = count;
+    if (scheduler_tenants_count == 0) {
+        free(scheduler_tenants);
+        scheduler_tenants = NULL;
+    }
+    for (i = 0; i < scheduler_tenants_count; i++) {
+        if (strcmp(scheduler_tenants[i].name, tenant) == 0) {
+            entry = &scheduler_tenants[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        scheduler_tenant *new_tenants;
+        char *name = sprintf_alloc("%s", tenant);
+        if (name == NULL) {
+            return -1;
+        }
+        new_tenants = (scheduler_tenant *)realloc(scheduler_tenants,
+                                                  (scheduler_tenants_count + 1) * sizeof(scheduler_tenant));
+        if (new_tenants == NULL) {
+            free(name);
+            return -1;
+        }
+        scheduler_tenants = new_tenants;
+        entry = &scheduler_tenants[scheduler_tenants_count++];
+        entry->name = name;
+        entry->last_tag = 0;
+    }
+    *tag = (entry->last_tag > scheduler_virtual_time ? entry->last_tag : scheduler_virtual_time)
+           + 1.0 / weight;
+    entry->last_tag = *tag;
+    return 0;
+}
+
+/*! Check whether a waiting conversion may start.
+ *
+ *  Must be called with \c scheduler_mutex locked.
+ *
+ *  \param job
+ *      the waiting conversion
+ */
+static int scheduler_may_start(const scheduler_job *job)
+{
+    return    scheduler_max_running == 0
+           || (scheduler_running < scheduler_max_running && scheduler_next() == job);
+}
+
+/*! Notify the waiting conversions that one of them may start.
+ *
+ *  Must be called with \c scheduler_mutex locked.
+ */
+static void scheduler_wake(void)
+{
+    const scheduler_job *next = scheduler_next();
+    pthread_cond_broadcast(&scheduler_cond);
+    if (next != NULL && next->wake_fds[1] != -1 && scheduler_may_start(next)) {
+        /* a full pipe is readable anyway */
+        const unsigned char byte = 0;
+        while (write(next->wake_fds[1], &byte, 1) == -1 && errno == EINTR) {
+        }
+    }
+}
+
+/*! Put a conversion into the queue.
+ *
+ *  Must be called with \c scheduler_mutex locked.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param job
+ *      the conversion, with \c wake_fds set
+ *
+ *  \param options
+ *      options of the conversion
+ */
+static int scheduler_enqueue(char **error, scheduler_job *job, const texcaller_options *options)
+{
+    if (scheduler_max_queued != 0 && scheduler_queued >= scheduler_max_queued) {
+        *error = sprintf_alloc("Unable to queue conversion: %i conversions are already waiting.",
+                               scheduler_max_queued);
+        return -1;
+    }
+    job->priority = options->priority;
+    job->sequence = scheduler_sequence++;
+    if (scheduler_tag(&job->tag, options->tenant == NULL ? "" : options->tenant,
+                      options->tenant_weight > 0 ? options->tenant_weight : 1) != 0) {
+        return -1;
+    }
+    job->next = scheduler_queue;
+    scheduler_queue = job;
+    scheduler_queued++;
+    return 0;
+}
+
+/*! Remove a conversion from the queue.
+ *
+ *  Must be called with \c scheduler_mutex locked.
+ *
+ *  \param job
+ *      the waiting conversion
+ */
+static void scheduler_dequeue(scheduler_job *job)
+{
+    if (scheduler_queue == job) {
+        scheduler_queue = job->next;
+    } else {
+        scheduler_job *prev;
+        for (prev = scheduler_queue; prev->next != job; prev = prev->next) {
+        }
+        prev->next = job->next;
+    }
+    scheduler_queued--;
+}
+
+/*! Start a waiting conversion that may start.
+ *
+ *  Must be called with \c scheduler_mutex locked.
+ *
+ *  \param job
+ *      the waiting conversion
+ */
+static void scheduler_start(scheduler_job *job)
+{
+    scheduler_dequeue(job);
+    scheduler_running++;
+    scheduler_virtual_time = job->tag;
+    /* let the next waiting conversion check whether it may start, too */
+    scheduler_wake();
+}
+
+/*! Wait until the scheduler allows a conversion to start.
+ *
+ *  Each successful call must be followed by a call of scheduler_release().
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param options
+ *      options of the conversion
+ */
+static int scheduler_acquire(char **error, const texcaller_options *options)
+{
+    scheduler_job job;
+    *error = NULL;
+    pthread_mutex_lock(&scheduler_mutex);
+    if (scheduler_max_running == 0 || (scheduler_running < scheduler_max_running && scheduler_queue == NULL)) {
+        scheduler_running++;
+        pthread_mutex_unlock(&scheduler_mutex);
+        return 0;
+    }
+    job.wake_fds[0] = -1;
+    job.wake_fds[1] = -1;
+    if (scheduler_enqueue(error, &job, options) != 0) {
+        pthread_mutex_unlock(&scheduler_mutex);
+        return -1;
+    }
+    while (!scheduler_may_start(&job)) {
+        pthread_cond_wait(&scheduler_cond, &scheduler_mutex);
+    }
+    scheduler_start(&job);
+    pthread_mutex_unlock(&scheduler_mutex);
+    return 0;
+}
+
+/*! Queue an asynchronous conversion without waiting.
+ *
+ *  Unless the conversion may start right away,
+ *  it has to be started via scheduler_try_start(),
+ *  or removed via scheduler_cancel().
+ *  Once started, it must be followed by a call of scheduler_release().
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param job
+ *      will be set to the newly allocated waiting conversion,
+ *      or to \c NULL if the conversion has started right away
+ *
+ *  \param options
+ *      options of the conversion
+ */
+static int scheduler_acquire_async(char **error, scheduler_job **job, const texcaller_options *options)
+{
+    *error = NULL;
+    *job = NULL;
+    pthread_mutex_lock(&scheduler_mutex);
+    if (scheduler_max_running == 0 || (scheduler_running < scheduler_max_running && scheduler_queue == NULL)) {
+        scheduler_running++;
+        pthread_mutex_unlock(&scheduler_mutex);
+        return 0;
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+    *job = (scheduler_job *)malloc(sizeof(scheduler_job));
+    if (*job == NULL) {
+        return -1;
+    }
+    if (pipe2((*job)->wake_fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+        *error = sprintf_alloc("Unable to create pipe: %s.", strerror(errno));
+        free(*job);
+        *job = NULL;
+        return -1;
+    }
+    pthread_mutex_lock(&scheduler_mutex);
+    if (scheduler_enqueue(error, *job, options) != 0) {
+        pthread_mutex_unlock(&scheduler_mutex);
+        close((*job)->wake_fds[0]);
+        close((*job)->wake_fds[1]);
+        free(*job);
+        *job = NULL;
+        return -1;
+    }
+    /* it may come first, even if others are waiting */
+    scheduler_wake();
+    pthread_mutex_unlock(&scheduler_mutex);
+    return 0;
+}
+
+/*! Free a waiting asynchronous conversion.
+ *
+ *  \param job
+ *      the conversion, no longer in the queue
+ */
+static void scheduler_free(scheduler_job *job)
+{
+    close(job->wake_fds[0]);
+    close(job->wake_fds[1]);
+    free(job);
+}
+
+/*! Try to start an asynchronous conversion
+ *  queued via scheduler_acquire_async(), without waiting.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param wait_fd
+ *      will be set to -1 if the conversion has started,
+ *      in which case \c job has been freed.
+ *      Otherwise, it will be set to a newly created file descriptor
+ *      that becomes readable when to try again.
+ *
+ *  \param job
+ *      the waiting conversion
+ */
+static int scheduler_try_start(char **error, int *wait_fd, scheduler_job *job)
+{
+    char buffer[64];
+    *error = NULL;
+    *wait_fd = -1;
+    pthread_mutex_lock(&scheduler_mutex);
+    while (read(job->wake_fds[0], buffer, sizeof(buffer)) > 0) {
+    }
+    if (scheduler_may_start(job)) {
+        scheduler_start(job);
+        pthread_mutex_unlock(&scheduler_mutex);
+        scheduler_free(job);
+        return 0;
+    }
+    pthread_mutex_unlock(&scheduler_mutex);
+    *wait_fd = fcntl(job->wake_fds[0], F_DUPFD_CLOEXEC, 0);
+    if (*wait_fd == -1) {
+        *error = sprintf_alloc("Unable to duplicate scheduler pipe: %s.", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*! Remove an asynchronous conversion
+ *  queued via scheduler_acquire_async() that hasn't started.
+ *
+ *  \param job
+ *      the waiting conversion, which is freed
+ */
+static void scheduler_cancel(scheduler_job *job)
+{
+    pthread_mutex_lock(&scheduler_mutex);
+    scheduler_dequeue(job);
+    /* pass on a notification meant for this conversion */
+    scheduler_wake();
+    pthread_mutex_unlock(&scheduler_mutex);
+    scheduler_free(job);
+}
+
+/*! Notify the scheduler that a conversion has finished.
+ */
+static void scheduler_release(void)
+{
+    pthread_mutex_lock(&scheduler_mutex);
+    scheduler_running--;
+    scheduler_wake();
+    pthread_mutex_unlock(&scheduler_mutex);
+}
+
+/*! @} */
+
+/*! \name Jobserver
+ *
+ *  The scheduler limits the concurrent conversions within a process.
+ *  To limit the concurrent TeX runs of all processes on a machine,
+ *  each TeX run holds a token of a jobserver
+ *  configured via texcaller_jobserver_configure().
+ *
+ *  The jobserver is either that of GNU make,
+ *  a pipe or FIFO containing one byte per token,
+ *  or a directory of slot files.
+ *  As with GNU make, each process owns an implicit token,
+ *  so the first concurrent TeX run of a process
+ *  doesn't need to read a byte from the pipe,
+ *  whereas all others have to write back the byte they read.
+ *  Within make without <tt>-j</tt>, there is no pipe,
+ *  so only the implicit token is available.
+ *  A slot is held via \c flock(),
+ *  which the kernel releases when its holder dies,
+ *  so no token is ever lost.
+ *
+ *  Asynchronous conversions must not block,
+ *  so they try to acquire a token without waiting.
+ *  If none is available, they watch a file descriptor
+ *  that becomes readable when it's worth trying again:
+ *  a nonblocking duplicate of the pipe,
+ *  or a timer where there is nothing to watch.
+ *
+ *  @{
+ */
+
+/*! No jobserver is used. */
+#define JOBSERVER_NONE 0
+
+/*! The jobserver is a pipe or FIFO. */
+#define JOBSERVER_PIPE 1
+
+/*! The jobserver is a directory of slot files. */
+#define JOBSERVER_SLOTS 2
+
+/*! Delay before trying again to acquire a slot, in milliseconds. */
+#define JOBSERVER_RETRY_MS 20
+
+/*! A jobserver.
+ */
+typedef struct jobserver_state
+{
+    /*! kind of the jobserver */
+    int kind;
+    /*! file descriptor to read tokens from, for \c JOBSERVER_PIPE,
+        or -1 if only the implicit token is available */
+    int read_fd;
+    /*! file descriptor to write tokens to, for \c JOBSERVER_PIPE */
+    int write_fd;
+    /*! nonblocking file descriptor to read tokens from, for \c JOBSERVER_PIPE,
+        or -1 if not available */
+    int poll_fd;
+    /*! directory of the slot files, for \c JOBSERVER_SLOTS */
+    char *slots_dir;
+    /*! number of slot files, for \c JOBSERVER_SLOTS */
+    int slots_count;
+} jobserver_state;
+
+/*! A token held during a TeX run.
+ */
+typedef struct jobserver_token
+{
+    /*! kind of the jobserver, or \c JOBSERVER_NONE if no token is held */
+    int kind;
+    /*! file descriptor to write the byte back to, for \c JOBSERVER_PIPE,
+        or the locked slot file, for \c JOBSERVER_SLOTS */
+    int fd;
+    /*! the byte read from the pipe, or -1 for the implicit token */
+    int byte;
+} jobserver_token;
+
+/*! Protects all \c jobserver_* variables. */
+static pthread_mutex_t jobserver_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*! Signaled when the implicit token has been released. */
+static pthread_cond_t jobserver_cond = PTHREAD_COND_INITIALIZER;
+
+/*! Ensures that jobserver_init() is called only once. */
+static pthread_once_t jobserver_once = PTHREAD_ONCE_INIT;
+
+/*! Whether texcaller_jobserver_configure() has been called. */
+static int jobserver_configured = 0;
+
+/*! The jobserver. */
+static jobserver_state jobserver_current = {JOBSERVER_NONE, -1, -1, -1, NULL, 0};
+
+/*! Whether the implicit token of this process is available. */
+static int jobserver_implicit = 1;
+
+/*! Error of an invalid \c TEXCALLER_JOBSERVER,
+ *  reported by the next conversion, or \c NULL.
+ */
+static char *jobserver_error = NULL;
+
+/*! Number of slots tried so far, to spread the processes over the slots. */
+static unsigned int jobserver_slots_tried = 0;
+
+/*! Check whether an inherited descriptor is an end of make's jobserver pipe.
+ *
+ *  Descriptors named in \c MAKEFLAGS may have been closed
+ *  or reused for something else, such as a socket or a log file,
+ *  when make didn't pass its pipe to this process.
+ *
+ *  \return
+ *      1 if \c fd is a pipe opened with access mode \c mode, 0 otherwise
+ *
+ *  \param fd
+ *      the descriptor
+ *
+ *  \param mode
+ *      \c O_RDONLY for the read end, \c O_WRONLY for the write end
+ */
+static int jobserver_pipe_end(int fd, int mode)
+{
+    struct stat st;
+    int flags;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        return 0;
+    }
+    flags = fcntl(fd, F_GETFL);
+    return flags != -1 && (flags & O_ACCMODE) == mode;
+}
+
+/*! Open a jobserver.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param state
+ *      will be set to the jobserver
+ *
+ *  \param jobserver
+ *      the jobserver, see texcaller_jobserver_configure()
+ */
+static int jobserver_open(char **error, jobserver_state *state, const char *jobserver)
+{
+    const char *auth = NULL;
+    char *path = NULL;
+    int fds[2];
+    *error = NULL;
+    state->kind = JOBSERVER_NONE;
+    state->read_fd = -1;
+    state->write_fd = -1;
+    state->poll_fd = -1;
+    state->slots_dir = NULL;
+    state->slots_count = 0;
+    if (jobserver == NULL) {
+        return 0;
+    }
+    if (strcmp(jobserver, "make") == 0) {
+        /* the last option wins, as in GNU make */
+        const char *makeflags = getenv("MAKEFLAGS");
+        const char *p;
+        for (p = makeflags; p != NULL && (p = strstr(p, "--jobserver-")) != NULL; p++) {
+            if (strncmp(p, "--jobserver-auth=", 17) == 0) {
+                auth = p + 17;
+            } else if (strncmp(p, "--jobserver-fds=", 16) == 0) {
+                auth = p + 16;
+            }
+        }
+        /* not running within make at all */
+        if (makeflags == NULL) {
+            return 0;
+        }
+        /* running within make without -j */
+        if (auth == NULL) {
+            state->kind = JOBSERVER_PIPE;
+            return 0;
+        }
+    } else if (strncmp(jobserver, "fifo:", 5) == 0) {
+        auth = jobserver;
+    } else if (strncmp(jobserver, "slots:", 6) == 0) {
+        const char *dir = jobserver + 6;
+        const char *limit = strrchr(dir, ':');
+        if (limit == NULL || limit == dir || atoi(limit + 1) < 1) {
+            *error = sprintf_alloc("Invalid jobserver \"%s\", expected slots:DIRECTORY:LIMIT.", jobserver);
+            return -1;
+        }
+        state->slots_dir = sprintf_alloc("%.*s", (int)(limit - dir), dir);
+        if (state->slots_dir == NULL) {
+            return -1;
+        }
+        if (mkdir(state->slots_dir, 0777) != 0 && errno != EEXIST) {
+            *error = sprintf_alloc("Unable to create jobserver directory \"%s\": %s.",
+                                   state->slots_dir, strerror(errno));
+            free(state->slots_dir);
+            state->slots_dir = NULL;
+            return -1;
+        }
+        state->slots_count = atoi(limit + 1);
+        state->kind = JOBSERVER_SLOTS;
+        return 0;
+    } else {
+        *error = sprintf_alloc("Invalid jobserver \"%s\".", jobserver);
+        return -1;
+    }
+    if (strncmp(auth, "fifo:", 5) == 0) {
+        path = sprintf_alloc("%.*s", (int)strcspn(auth + 5, " "), auth + 5);
+        if (path == NULL) {
+            return -1;
+        }
+        state->read_fd = open(path, O_RDWR | O_CLOEXEC);
+        if (state->read_fd == -1) {
+            *error = sprintf_alloc("Unable to open jobserver FIFO \"%s\": %s.", path, strerror(errno));
+            free(path);
+            return -1;
+        }
+        state->write_fd = state->read_fd;
+        state->poll_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        free(path);
+    } else {
+        /* the pipe is only inherited by commands that make considers recursive,
+           and is duplicated to leave the inherited descriptors untouched */
+        if (   sscanf(auth, "%d,%d", &fds[0], &fds[1]) != 2
+            || !jobserver_pipe_end(fds[0], O_RDONLY)
+            || !jobserver_pipe_end(fds[1], O_WRONLY)
+            || (state->read_fd = fcntl(fds[0], F_DUPFD_CLOEXEC, 0)) == -1
+            || (state->write_fd = fcntl(fds[1], F_DUPFD_CLOEXEC, 0)) == -1) {
+            *error = sprintf_alloc("Unable to use jobserver of make: \"%.*s\" is not available,"
+                                   " perhaps the command is not marked as recursive via \"+\".",
+                                   (int)strcspn(auth, " "), auth);
+            if (state->read_fd != -1) {
+                close(state->read_fd);
+            }
+            state->read_fd = -1;
+            state->write_fd = -1;
+            return -1;
+        }
+        /* reopening the pipe yields a nonblocking descriptor
+           without changing the flags of make's one */
+        path = sprintf_alloc("/proc/self/fd/%d", fds[0]);
+        if (path != NULL) {
+            state->poll_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            free(path);
+        }
+    }
+    state->kind = JOBSERVER_PIPE;
+    return 0;
+}
+
+/*! Use the jobserver given by \c TEXCALLER_JOBSERVER,
+ *  unless texcaller_jobserver_configure() has been called.
+ *
+ *  Call via \c pthread_once() with \c jobserver_once.
+ *  An invalid jobserver is kept in \c jobserver_error,
+ *  so the next conversion reports it.
+ */
+static void jobserver_init(void)
+{
+    const char *jobserver = getenv("TEXCALLER_JOBSERVER");
+    char *error;
+    pthread_mutex_lock(&jobserver_mutex);
+    if (!jobserver_configured && jobserver != NULL
+        && jobserver_open(&error, &jobserver_current, jobserver) != 0) {
+        jobserver_error = sprintf_alloc("Invalid environment variable TEXCALLER_JOBSERVER: %s",
+                                        error == NULL ? "Out of memory." : error);
+        free(error);
+    }
+    pthread_mutex_unlock(&jobserver_mutex);
+}
+
+/*! Create a file descriptor that becomes readable
+ *  after \c JOBSERVER_RETRY_MS milliseconds.
+ *
+ *  \return
+ *      the file descriptor, or -1 if not supported
+ */
+static int jobserver_retry_fd(void)
+{
+#ifdef __linux__
+    struct itimerspec timer;
+    const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_nsec = JOBSERVER_RETRY_MS * 1000000L;
+    if (timerfd_settime(fd, 0, &timer, NULL) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+/*! Try to lock one of the slot files of a jobserver.
+ *
+ *  \return
+ *      the file descriptor of the locked slot file,
+ *      or -1 if all slots are locked
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      If all slots are locked, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param dir
+ *      the directory of the slot files
+ *
+ *  \param count
+ *      the number of slot files
+ */
+static int jobserver_lock_slot(char **error, const char *dir, int count)
+{
+    unsigned int first;
+    int fd;
+    int i;
+    *error = NULL;
+    pthread_mutex_lock(&jobserver_mutex);
+    first = (unsigned int)getpid() + jobserver_slots_tried++;
+    pthread_mutex_unlock(&jobserver_mutex);
+    for (i = 0; i < count; i++) {
+        char *path = sprintf_alloc("%s/slot-%u", dir, (first + i) % (unsigned int)count);
+        if (path == NULL) {
+            return -1;
+        }
+        fd = open(path, O_RDONLY | O_CREAT | O_CLOEXEC, 0666);
+        if (fd == -1) {
+            *error = sprintf_alloc("Unable to open jobserver slot \"%s\": %s.", path, strerror(errno));
+            free(path);
+            return -1;
+        }
+        free(path);
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+            return fd;
+        }
+        close(fd);
+        if (errno != EWOULDBLOCK && errno != EINTR) {
+            *error = sprintf_alloc("Unable to lock jobserver slot: %s.", strerror(errno));
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/*! Acquire a token from the jobserver.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param token
+ *      will be set to the token,
+ *      to be released via jobserver_release()
+ *
+ *  \param wait_fd
+ *      \c NULL to wait until a token is available.
+ *      Otherwise, this doesn't block,
+ *      and if no token is available,
+ *      \c wait_fd will be set to a newly created file descriptor
+ *      that becomes readable when to try again,
+ *      and to -1 otherwise.
+ */
+static int jobserver_acquire(char **error, jobserver_token *token, int *wait_fd)
+{
+    unsigned char byte;
+    int read_fd;
+    int poll_fd;
+    const char *slots_dir;
+    int slots_count;
+    int delay_ms = 1;
+    ssize_t n;
+    *error = NULL;
+    token->kind = JOBSERVER_NONE;
+    token->fd = -1;
+    token->byte = -1;
+    if (wait_fd != NULL) {
+        *wait_fd = -1;
+    }
+    pthread_once(&jobserver_once, jobserver_init);
+    pthread_mutex_lock(&jobserver_mutex);
+    if (jobserver_error != NULL) {
+        *error = jobserver_error;
+        jobserver_error = NULL;
+        pthread_mutex_unlock(&jobserver_mutex);
+        return -1;
+    }
+    read_fd = jobserver_current.read_fd;
+    poll_fd = jobserver_current.poll_fd;
+    slots_dir = jobserver_current.slots_dir;
+    slots_count = jobserver_current.slots_count;
+    if (jobserver_current.kind == JOBSERVER_PIPE && read_fd == -1 && !jobserver_implicit) {
+        if (wait_fd != NULL) {
+            *wait_fd = jobserver_retry_fd();
+        }
+        while (!jobserver_implicit && (wait_fd == NULL || *wait_fd == -1)) {
+            pthread_cond_wait(&jobserver_cond, &jobserver_mutex);
+        }
+        if (!jobserver_implicit) {
+            pthread_mutex_unlock(&jobserver_mutex);
+            return 0;
+        }
+    }
+    if (jobserver_current.kind == JOBSERVER_PIPE && jobserver_implicit) {
+        jobserver_implicit = 0;
+        token->kind = JOBSERVER_PIPE;
+        pthread_mutex_unlock(&jobserver_mutex);
+        return 0;
+    }
+    token->kind = jobserver_current.kind;
+    token->fd = jobserver_current.write_fd;
+    pthread_mutex_unlock(&jobserver_mutex);
+    switch (token->kind) {
+        case JOBSERVER_PIPE:
+            if (wait_fd != NULL && poll_fd != -1) {
+                while ((n = read(poll_fd, &byte, 1)) == -1 && errno == EINTR) {
+                }
+                if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    /* the pipe becomes readable when a token is returned */
+                    token->kind = JOBSERVER_NONE;
+                    *wait_fd = fcntl(poll_fd, F_DUPFD_CLOEXEC, 0);
+                    if (*wait_fd == -1) {
+                        *error = sprintf_alloc("Unable to duplicate jobserver pipe: %s.", strerror(errno));
+                        return -1;
+                    }
+                    return 0;
+                }
+                break;
+            }
+            /* GNU make ≥ 4.3 makes the pipe nonblocking,
+               and other processes may take the byte first */
+            while ((n = read(read_fd, &byte, 1)) == -1 && (errno == EINTR || errno == EAGAIN)) {
+                if (errno == EAGAIN) {
+                    struct pollfd pfd;
+                    pfd.fd = read_fd;
+                    pfd.events = POLLIN;
+                    poll(&pfd, 1, -1);
+                }
+            }
+            break;
+        case JOBSERVER_SLOTS:
+            /* flock() can't wait for any one of several files,
+               so poll them with an increasing delay */
+            while ((token->fd = jobserver_lock_slot(error, slots_dir, slots_count)) == -1) {
+                if (*error != NULL) {
+                    token->kind = JOBSERVER_NONE;
+                    return -1;
+                }
+                if (wait_fd != NULL) {
+                    *wait_fd = jobserver_retry_fd();
+                    if (*wait_fd != -1) {
+                        token->kind = JOBSERVER_NONE;
+                        return 0;
+                    }
+                }
+                poll(NULL, 0, delay_ms);
+                if (delay_ms < JOBSERVER_RETRY_MS) {
+                    delay_ms *= 2;
+                }
+            }
+            return 0;
+        default:
+            return 0;
+    }
+    if (n == -1 || n == 0) {
+        *error = sprintf_alloc("Unable to acquire jobserver token: %s.",
+                               n == 0 ? "Jobserver has terminated" : strerror(errno));
+        token->kind = JOBSERVER_NONE;
+        return -1;
+    }
+    token->byte = byte;
+    return 0;
+}
+
+/*! Release a token acquired via jobserver_acquire(), if any.
+ *
+ *  \param token
+ *      the token
+ */
+static void jobserver_release(jobserver_token *token)
+{
+    switch (token->kind) {
+        case JOBSERVER_PIPE:
+            if (token->byte == -1) {
+                pthread_mutex_lock(&jobserver_mutex);
+                jobserver_implicit = 1;
+                pthread_cond_broadcast(&jobserver_cond);
+                pthread_mutex_unlock(&jobserver_mutex);
+            } else {
+                const unsigned char byte = (unsigned char)token->byte;
+                while (write(token->fd, &byte, 1) == -1 && errno == EINTR) {
+                }
+            }
+            break;
+        case JOBSERVER_SLOTS:
+            /* closing the slot file releases its lock */
+            close(token->fd);
+            break;
+    }
+    token->kind = JOBSERVER_NONE;
+}
+
+/*! @} */
+
+/*! Read a file completely into a buffer that can be used as a string.
+ *
+ *  \param result
+ *      will be set to a newly allocated buffer that contains
+ *      the complete content of the file,
+ *      with a \c '\\0' added to the end.
+ *      If an error occured,
+ *      \c result will be set to \c NULL.
+ *
+ *  \param result_size
+ *      will be set to the size of \c result,
+ *      not counting the added \c '\\0'.
+ *      If an error occured,
+ *      \c result_size will be set to \c 0.
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param path
+ *      path of the file to read
+ */
+static void read_file(char **result, size_t *result_size, char **error, const char *path)
+{
+    FILE *file;
+    long file_size;
+    size_t read_size;
+    *result = NULL;
+    *error = NULL;
+    file = fopen(path, "rb" FOPEN_CLOEXEC);
+    if (file == NULL) {
+        *error = sprintf_alloc("Unable to open file \"%s\" for reading: %s.",
+                               path, strerror(errno));
+        goto error_cleanup;
+    }
+    if (fseek(file, 0, SEEK_END) != 0) {
+        *error = sprintf_alloc("Unable to seek to end of file \"%s\": %s.",
+                               path, strerror(errno));
+        goto error_cleanup;
+    }
+    file_size = ftell(file);
+    if (file_size == -1) {
+        *error = sprintf_alloc("Unable to obtain size of file \"%s\": %s.",
+                               path, strerror(errno));
+        goto error_cleanup;
+    }
+    *result_size = file_size;
+    if (fseek(file, 0, SEEK_SET) != 0) {
+        *error = sprintf_alloc("Unable to seek back to start of file \"%s\": %s.",
+                               path, strerror(errno));
+        goto error_cleanup;
+    }
+    *result = (char *)malloc(*result_size + 1);
+    if (*result == NULL) {
+        *error = sprintf_alloc("Unable to allocate buffer for reading file \"%s\": %s.",
+                               path, strerror(errno));
+        goto error_cleanup;
+    }
+    (*result)[*result_size] = '\0';
+    read_size = fread(*result, 1, *result_size, file);
+    if (ferror(file)) {
+        *error = sprintf_alloc("Unable to read %lu bytes from file \"%s\": %s.",
+                               (unsigned long)*result_size, path, strerror(errno));
+        goto error_cleanup;
+    }
+    if (read_size != *result_size) {
+        *error = sprintf_alloc("Unable to read %lu bytes from file \"%s\": Got only %lu bytes.",
+                               (unsigned long)*result_size, path, (unsigned long)read_size);
+        goto error_cleanup;
+    }
+    if (fclose(file) != 0) {
+        *error = sprintf_alloc("Unable to close file \"%s\" after reading: %s.",
+                               path, strerror(errno));
+        file = NULL;
+        goto error_cleanup;
+    }
+    return;
+error_cleanup:
+    free(*result);
+    *result = NULL;
+    *result_size = 0;
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+/*! Write a buffer completely into a file.
+ *
+ *  If the file already exists, it will be overwritten.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param path
+ *      path of the file to write to
+ *
+ *  \param source
+ *      buffer to write
+ *
+ *  \param source_size
+ *      size of \c source
+ */
+static int write_file(char **error, const char *path, const char *source, size_t source_size)
+{
+    FILE *file;
+    size_t written_size;
+    *error = NULL;
+    file = fopen(path, "wb" FOPEN_CLOEXEC);
+    if (file == NULL) {
+        *error = sprintf_alloc("Unable to open file \"%s\" for writing: %s.",
+                               path, strerror(errno));
+        goto error_cleanup;
+    }
+    written_size = fwrite(source, 1, source_size, file);
+    if (ferror(file)) {
+        *error = sprintf_alloc("Unable to write %lu bytes to file \"%s\": %s.",
+                               (unsigned long)source_size, path, strerror(errno));
+        goto error_cleanup;
+    }
+    if (written_size != source_size) {
+        *error = sprintf_alloc("Unable to write %lu bytes to file \"%s\": Only %lu bytes were written.",
+                               (unsigned long)source_size, path, (unsigned long)written_size);
+        goto error_cleanup;
+    }
+    if (fclose(file) != 0) {
+        *error = sprintf_alloc("Unable to close file \"%s\" after writing: %s.",
+                               path, strerror(errno));
+        file = NULL;
+        goto error_cleanup;
+    }
+    return 0;
+error_cleanup:
+    if (file != NULL) {
+        fclose(file);
+    }
+    return -1;
+}
+
+/*! Copy the rest of a file descriptor into a new file.
+ *
+ *  The data doesn't pass through this process where possible:
+ *  A regular file that is read from its beginning
+ *  shares its blocks with the new file via \c FICLONE
+ *  on filesystems with reflinks,
+ *  otherwise the kernel copies it via \c copy_file_range().
+ *  Anything else, such as a pipe,
+ *  is streamed in chunks.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param size
+ *      will be set to the number of bytes copied
+ *
+ *  \param path
+ *      path of the file to create
+ *
+ *  \param fd
+ *      file descriptor to read from until end of file
+ */
+static int copy_file(char **error, size_t *size, const char *path, int fd)
+{
+    char buffer[16384];
+    ssize_t n;
+    int out;
+    *error = NULL;
+    *size = 0;
+    out = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out == -1) {
+        *error = sprintf_alloc("Unable to open file \"%s\" for writing: %s.",
+                               path, strerror(errno));
+        return -1;
+    }
+#ifdef FICLONE
+    {
+        struct stat st;
+        if (   fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) == 0
+            && ioctl(out, FICLONE, fd) == 0) {
+            lseek(fd, 0, SEEK_END);
+            *size = (size_t)st.st_size;
+            goto close_file;
+        }
+    }
+#endif
+#if TEXCALLER_HAVE_COPY_FILE_RANGE
+    for (;;) {
+        n = copy_file_range(fd, NULL, out, NULL, 1 << 30, 0);
+        if (n > 0) {
+            *size += (size_t)n;
+        } else if (n == 0) {
+            goto close_file;
+        } else if (errno != EINTR) {
+            /* not supported for these files,
+               so stream the rest, which reports actual read errors */
+            break;
+        }
+    }
+#endif
+    for (;;) {
+        char *data = buffer;
+        n = read(fd, buffer, sizeof(buffer));
+        if (n == 0) {
+            break;
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            *error = sprintf_alloc("Unable to read source: %s.", strerror(errno));
+            goto error_cleanup;
+        }
+        *size += (size_t)n;
+        while (n > 0) {
+            const ssize_t written = write(out, data, (size_t)n);
+            if (written == -1 && errno == EINTR) {
+                continue;
+            }
+            if (written == -1) {
+                *error = sprintf_alloc("Unable to write to file \"%s\": %s.",
+                                       path, strerror(errno));
+                goto error_cleanup;
+            }
+            data += written;
+            n -= written;
+        }
+    }
+close_file:
+    if (close(out) != 0) {
+        *error = sprintf_alloc("Unable to close file \"%s\" after writing: %s.",
+                               path, strerror(errno));
+        return -1;
+    }
+    return 0;
+error_cleanup:
+    close(out);
+    return -1;
+}
+
+/*! Create the source file of a job,
+ *  from texcaller_job::source_path, texcaller_job::source_fd
+ *  or texcaller_job::source.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param size
+ *      will be set to the size of the source
+ *
+ *  \param path
+ *      path of the file to create, which must not exist yet
+ *
+ *  \param job
+ *      the job
+ */
+static int write_source(char **error, size_t *size, const char *path, const texcaller_job *job)
+{
+    struct stat st;
+    int fd;
+    int status;
+    *error = NULL;
+    *size = 0;
+    if (job->source_path != NULL) {
+        /* a hard link within the same filesystem avoids any copying,
+           and is never written to, as TeX only reads its source;
+           symlinks are followed, as a link to a relative symlink
+           would dangle within the temporary directory */
+        if (linkat(AT_FDCWD, job->source_path, AT_FDCWD, path, AT_SYMLINK_FOLLOW) == 0) {
+            if (stat(path, &st) == 0) {
+                *size = (size_t)st.st_size;
+                return 0;
+            }
+            /* fall back to copying */
+            unlink(path);
+        }
+        fd = open(job->source_path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            *error = sprintf_alloc("Unable to open file \"%s\" for reading: %s.",
+                                   job->source_path, strerror(errno));
+            return -1;
+        }
+        status = copy_file(error, size, path, fd);
+        close(fd);
+        return status;
+    }
+    if (job->source_fd != -1) {
+        return copy_file(error, size, path, job->source_fd);
+    }
+    *size = job->source_size;
+    return write_file(error, path, job->source, job->source_size);
+}
+
+/*! Read the source of a job from a file descriptor or path into memory.
+ *
+ *  This is needed where the source has to be sent elsewhere,
+ *  such as to a remote worker.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param source
+ *      will be set to a newly allocated buffer
+ *      that contains the complete source
+ *
+ *  \param size
+ *      will be set to the size of \c source
+ *
+ *  \param job
+ *      the job, whose texcaller_job::source_path
+ *      or texcaller_job::source_fd is set
+ */
+static int read_source(char **error, char **source, size_t *size, const texcaller_job *job)
+{
+    size_t capacity;
+    char *buffer;
+    ssize_t n;
+    *error = NULL;
+    *source = NULL;
+    *size = 0;
+    if (job->source_path != NULL) {
+        read_file(source, size, error, job->source_path);
+        return *source == NULL ? -1 : 0;
+    }
+    capacity = 16384;
+    *source = (char *)malloc(capacity);
+    if (*source == NULL) {
+        *error = sprintf_alloc("Unable to allocate buffer for reading source: %s.", strerror(errno));
+        return -1;
+    }
+    for (;;) {
+        if (*size == capacity) {
+            buffer = (char *)realloc(*source, capacity * 2);
+            if (buffer == NULL) {
+                *error = sprintf_alloc("Unable to allocate buffer for reading source: %s.", strerror(errno));
+                goto error_cleanup;
+            }
+            *source = buffer;
+            capacity *= 2;
+        }
+        n = read(job->source_fd, *source + *size, capacity - *size);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            *error = sprintf_alloc("Unable to read source: %s.", strerror(errno));
+            goto error_cleanup;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        *size += (size_t)n;
+    }
+error_cleanup:
+    free(*source);
+    *source = NULL;
+    *size = 0;
+    return -1;
+}
+
+/*! Replace a file atomically by a buffer.
+ *
+ *  The buffer is written into a temporary file
+ *  within the same directory,
+ *  which is then renamed to \c path.
+ *  That way, concurrent readers see either the old or the new content,
+ *  but never a partially written file.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param path
+ *      path of the file to replace
+ *
+ *  \param source
+ *      buffer to write
+ *
+ *  \param source_size
+ *      size of \c source
+ */
+static int replace_file(char **error, const char *path, const char *source, size_t source_size)
+{
+    char *tmp_path;
+    int fd;
+    *error = NULL;
+    tmp_path = sprintf_alloc("%s.XXXXXX", path);
+    if (tmp_path == NULL) {
+        return -1;
+    }
+    fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        *error = sprintf_alloc("Unable to create temporary file from template \"%s\": %s.",
+                               tmp_path, strerror(errno));
+        free(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (write_file(error, tmp_path, source, source_size) != 0) {
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    if (rename(tmp_path, path) != 0) {
+        *error = sprintf_alloc("Unable to rename file \"%s\" to \"%s\": %s.",
+                               tmp_path, path, strerror(errno));
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    free(tmp_path);
+    return 0;
+}
+
+/*! Maximum number of files in a prefetch list.
+ *  When exceeded, the files read least recently are dropped.
+ */
+#define PREFETCH_MAX_FILES 1024
+
+/*! Count the bytes of a file that are not in the page cache.
+ *
+ *  \return
+ *      the number of bytes, rounded up to whole pages,
+ *      or 0 if that can't be determined
+ *
+ *  \param fd
+ *      the file
+ */
+static unsigned long uncached_bytes(int fd)
+{
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    struct stat st;
+    void *map;
+    unsigned char *pages;
+    size_t pages_count;
+    size_t i;
+    unsigned long bytes = 0;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return 0;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    pages_count = ((size_t)st.st_size + page_size - 1) / page_size;
+    pages = (unsigned char *)malloc(pages_count);
+    if (pages != NULL && mincore(map, (size_t)st.st_size, pages) == 0) {
+        for (i = 0; i < pages_count; i++) {
+            if ((pages[i] & 1) == 0) {
+                bytes += page_size;
+            }
+        }
+    }
+    free(pages);
+    munmap(map, (size_t)st.st_size);
+    return bytes;
+}
+
+/*! Prefetch files into the page cache.
+ *
+ *  The files are only announced to the kernel via \c posix_fadvise(),
+ *  so they are read in the background while the caller continues.
+ *  Missing or unreadable files are silently skipped.
+ *
+ *  \param uncached
+ *      will be set to the number of bytes
+ *      that were not in the page cache yet,
+ *      i.e. the reads moved ahead of the TeX interpreter
+ *
+ *  \param list
+ *      list of paths, one per line
+ *
+ *  \return
+ *      the number of prefetched files
+ */
+static int prefetch_files(unsigned long *uncached, const char *list)
+{
+    const char *line;
+    const char *line_end;
+    int count = 0;
+    *uncached = 0;
+    for (line = list; *line != '\0'; line = line_end + (*line_end == '\n')) {
+        char *path;
+        int fd;
+        line_end = strchr(line, '\n');
+        if (line_end == NULL) {
+            line_end = line + strlen(line);
+        }
+        if (line_end == line) {
+            continue;
+        }
+        path = sprintf_alloc("%.*s", (int)(line_end - line), line);
+        if (path == NULL) {
+            break;
+        }
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd != -1) {
+            const unsigned long bytes = uncached_bytes(fd);
+            if (posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0) {
+                *uncached += bytes;
+                count++;
+            }
+            close(fd);
+        }
+        free(path);
+    }
+    return count;
+}
+
+/*! A set of lines within a buffer, via open addressing.
+ */
+typedef struct line_set
+{
+    /*! the lines, or \c NULL for empty slots */
+    const char **lines;
+    /*! sizes of \c lines */
+    size_t *sizes;
+    /*! number of slots, a power of 2 */
+    size_t capacity;
+} line_set;
+
+/*! Create an empty set of lines.
+ *
+ *  \return
+ *      0 on success, -1 when out of memory
+ *
+ *  \param set
+ *      the set, to be freed via line_set_free()
+ *
+ *  \param max_count
+ *      maximum number of lines to be added
+ */
+static int line_set_init(line_set *set, size_t max_count)
+{
+    set->capacity = 16;
+    while (set->capacity < 2 * max_count) {
+        set->capacity *= 2;
+    }
+    set->lines = (const char **)calloc(set->capacity, sizeof(const char *));
+    set->sizes = (size_t *)malloc(set->capacity * sizeof(size_t));
+    if (set->lines == NULL || set->sizes == NULL) {
+        free((void *)set->lines);
+        free(set->sizes);
+        return -1;
+    }
+    return 0;
+}
+
+/*! Free a set of lines created via line_set_init().
+ *
+ *  \param set
+ *      the set
+ */
+static void line_set_free(line_set *set)
+{
+    free((void *)set->lines);
+    free(set->sizes);
+}
+
+/*! Add a line to a set, unless it's already contained.
+ *
+ *  \return
+ *      1 if the line has been added, 0 if it was already contained
+ *
+ *  \param set
+ *      the set
+ *
+ *  \param line
+ *      the line, which must remain valid as long as the set
+ *
+ *  \param line_size
+ *      size of \c line
+ *
+ *  \param add
+ *      whether to add the line, or only check for it
+ */
+static int line_set_add(line_set *set, const char *line, size_t line_size, int add)
+{
+    size_t i = hash_bytes(HASH_BYTES_INIT, line, line_size) & (set->capacity - 1);
+    while (set->lines[i] != NULL) {
+        if (set->sizes[i] == line_size && memcmp(set->lines[i], line, line_size) == 0) {
+            return 0;
+        }
+        i = (i + 1) & (set->capacity - 1);
+    }
+    if (add) {
+        set->lines[i] = line;
+        set->sizes[i] = line_size;
+    }
+    return 1;
+}
+
+/*! Merge the input files reported by the TeX interpreter into a prefetch list.
+ *
+ *  Only absolute paths are added,
+ *  because relative paths refer to the temporary directory.
+ *  The files read by this run come first,
+ *  followed by the other files of the old list,
+ *  up to \c PREFETCH_MAX_FILES.
+ *  The list is only rewritten if this run read new files,
+ *  or the old list is too long.
+ *  The prefetch list file is replaced atomically via replace_file(),
+ *  so concurrent conversions never see a partially written list.
+ *  Since prefetching is merely an optimization,
+ *  all errors are silently ignored.
+ *
+ *  \return
+ *      the number of files of the old list read by this run,
+ *      or -1 if the files read are unknown
+ *
+ *  \param list_filename
+ *      path of the prefetch list file
+ *
+ *  \param list
+ *      current content of the prefetch list file,
+ *      or \c NULL if there is none
+ *
+ *  \param fls_filename
+ *      path of the file written by the TeX interpreter's \c -recorder option
+ */
+static int update_prefetch_list(const char *list_filename, const char *list, const char *fls_filename)
+{
+    char *fls;
+    size_t fls_size;
+    char *error;
+    char *new_list;
+    char *end;
+    line_set read_files;
+    line_set old_files;
+    const char *line;
+    const char *line_end;
+    size_t list_size = list == NULL ? 0 : strlen(list);
+    size_t lines_count = 0;
+    int read_count = 0;
+    int old_count = 0;
+    int count = 0;
+    int hits = 0;
+    read_file(&fls, &fls_size, &error, fls_filename);
+    free(error);
+    if (fls == NULL) {
+        return -1;
+    }
+    for (line = fls; *line != '\0'; line++) {
+        lines_count += *line == '\n';
+    }
+    if (line_set_init(&read_files, lines_count + 1) != 0) {
+        free(fls);
+        return -1;
+    }
+    lines_count = 0;
+    for (line = list == NULL ? "" : list; *line != '\0'; line++) {
+        lines_count += *line == '\n';
+    }
+    if (line_set_init(&old_files, lines_count + 1) != 0) {
+        line_set_free(&read_files);
+        free(fls);
+        return -1;
+    }
+    /* no line gets longer, so this suffices */
+    new_list = (char *)malloc(fls_size + list_size + 1);
+    if (new_list == NULL) {
+        line_set_free(&read_files);
+        line_set_free(&old_files);
+        free(fls);
+        return -1;
+    }
+    end = new_list;
+    /* files read by this run */
+    for (line = fls; *line != '\0'; line = line_end + (*line_end == '\n')) {
+        const char *path = line + strlen("INPUT ");
+        line_end = strchr(line, '\n');
+        if (line_end == NULL) {
+            line_end = line + strlen(line);
+        }
+        if (   strncmp(line, "INPUT /", strlen("INPUT /")) != 0
+            || !line_set_add(&read_files, path, line_end - path, 1)) {
+            continue;
+        }
+        read_count++;
+        if (count < PREFETCH_MAX_FILES) {
+            memcpy(end, path, line_end - path);
+            end += line_end - path;
+            *end++ = '\n';
+            count++;
+        }
+    }
+    /* other files of the old list */
+    for (line = list == NULL ? "" : list; *line != '\0'; line = line_end + (*line_end == '\n')) {
+        line_end = strchr(line, '\n');
+        if (line_end == NULL) {
+            line_end = line + strlen(line);
+        }
+        if (line_end == line || !line_set_add(&old_files, line, line_end - line, 1)) {
+            continue;
+        }
+        old_count++;
+        if (!line_set_add(&read_files, line, line_end - line, 0)) {
+            hits++;
+        } else if (count < PREFETCH_MAX_FILES) {
+            memcpy(end, line, line_end - line);
+            end += line_end - line;
+            *end++ = '\n';
+            count++;
+        }
+    }
+    *end = '\0';
+    if (read_count > hits || old_count > PREFETCH_MAX_FILES) {
+        if (replace_file(&error, list_filename, new_list, end - new_list) != 0) {
+            free(error);
+        }
+    }
+    line_set_free(&read_files);
+    line_set_free(&old_files);
+    free(new_list);
+    free(fls);
+    return hits;
+}
+
+/*! File extensions of the auxiliary files kept by the seed store.
+ */
+static const char *const seed_extensions[] = {"aux", "toc", "out"};
+
+/*! Pre-populate a temporary directory with auxiliary files
+ *  from the seed store.
+ *
+ *  Since the seed store is merely an optimization,
+ *  all errors are silently ignored.
+ *
+ *  \return
+ *      1 if an aux file was seeded, 0 otherwise
+ *
+ *  \param aux
+ *      will be set to a newly allocated buffer that contains
+ *      the seeded aux file,
+ *      or \c NULL if there is none
+ *
+ *  \param aux_size
+ *      will be set to the size of \c aux
+ *
+ *  \param seed_prefix
+ *      path prefix of the seed files, without file extension
+ *
+ *  \param dir
+ *      the temporary directory
+ */
+static int load_seed(char **aux, size_t *aux_size, const char *seed_prefix, const char *dir)
+{
+    size_t i;
+    *aux = NULL;
+    *aux_size = 0;
+    for (i = 0; i < sizeof(seed_extensions) / sizeof(seed_extensions[0]); i++) {
+        char *error;
+        char *content;
+        size_t content_size;
+        char *seed_filename = sprintf_alloc("%s.%s", seed_prefix, seed_extensions[i]);
+        char *filename = sprintf_alloc("%s/texput.%s", dir, seed_extensions[i]);
+        if (seed_filename != NULL && filename != NULL) {
+            read_file(&content, &content_size, &error, seed_filename);
+            free(error);
+            if (content != NULL) {
+                if (write_file(&error, filename, content, content_size) != 0) {
+                    free(error);
+                } else if (strcmp(seed_extensions[i], "aux") == 0) {
+                    *aux = content;
+                    *aux_size = content_size;
+                    content = NULL;
+                }
+                free(content);
+            }
+        }
+        free(seed_filename);
+        free(filename);
+    }
+    return *aux != NULL;
+}
+
+/*! Keep the auxiliary files of a temporary directory in the seed store.
+ *
+ *  The seed files are replaced atomically via replace_file(),
+ *  so concurrent conversions never see partially written files.
+ *  Since the seed store is merely an optimization,
+ *  all errors are silently ignored.
+ *
+ *  \param seed_prefix
+ *      path prefix of the seed files, without file extension
+ *
+ *  \param dir
+ *      the temporary directory
+ */
+static void store_seed(const char *seed_prefix, const char *dir)
+{
+    size_t i;
+    for (i = 0; i < sizeof(seed_extensions) / sizeof(seed_extensions[0]); i++) {
+        char *error;
+        char *content;
+        size_t content_size;
+        char *seed_filename = sprintf_alloc("%s.%s", seed_prefix, seed_extensions[i]);
+        char *filename = sprintf_alloc("%s/texput.%s", dir, seed_extensions[i]);
+        if (seed_filename != NULL && filename != NULL) {
+            read_file(&content, &content_size, &error, filename);
+            free(error);
+            if (content != NULL) {
+                if (replace_file(&error, seed_filename, content, content_size) != 0) {
+                    free(error);
+                }
+                free(content);
+            }
+        }
+        free(seed_filename);
+        free(filename);
+    }
+}
+
+/*! An auxiliary file of a temporary directory,
+ *  see read_workspace_files().
+ */
+typedef struct workspace_file
+{
+    /*! file name within the temporary directory */
+    char *name;
+    /*! content of the file */
+    char *content;
+    /*! size of \c content */
+    size_t content_size;
+} workspace_file;
+
+/*! File extensions of the files not returned by read_workspace_files().
+ */
+static const char *const workspace_file_excluded_extensions[] = {".tex", ".log", ".fls", ".pdf", ".dvi", ".xdv"};
+
+/*! Free the result of read_workspace_files().
+ *
+ *  \param files
+ *      the files, or \c NULL
+ *
+ *  \param files_count
+ *      number of elements in \c files
+ */
+static void free_workspace_files(workspace_file *files, int files_count)
+{
+    int i;
+    if (files == NULL) {
+        return;
+    }
+    for (i = 0; i < files_count; i++) {
+        free(files[i].name);
+        free(files[i].content);
+    }
+    free(files);
+}
+
+/*! Read the auxiliary files of a temporary directory,
+ *  such as \c .aux, \c .toc and \c .out files,
+ *  to start other temporary directories with them.
+ *
+ *  Sources, logs and results are left out,
+ *  as well as subdirectories.
+ *
+ *  \return
+ *      the files, to be freed via free_workspace_files(),
+ *      or \c NULL on failure or if there are none
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param files_count
+ *      will be set to the number of files, or -1 on failure
+ *
+ *  \param dirname
+ *      the temporary directory
+ */
+static workspace_file *read_workspace_files(char **error, int *files_count, const char *dirname)
+{
+    workspace_file *files = NULL;
+    int files_capacity = 0;
+    DIR *dir;
+    struct dirent *entry;
+    *error = NULL;
+    *files_count = 0;
+    dir = opendir(dirname);
+    if (dir == NULL) {
+        *error = sprintf_alloc("Unable to read directory entries of \"%s\": %s.",
+                               dirname, strerror(errno));
+        goto error_cleanup;
+    }
+    for (entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        const size_t name_size = strlen(entry->d_name);
+        workspace_file *file;
+        char *filename;
+        size_t i;
+        if (entry->d_type != DT_REG) {
+            continue;
+        }
+        for (i = 0; i < sizeof(workspace_file_excluded_extensions) / sizeof(workspace_file_excluded_extensions[0]); i++) {
+            const size_t extension_size = strlen(workspace_file_excluded_extensions[i]);
+            if (   name_size >= extension_size
+                && strcmp(entry->d_name + name_size - extension_size, workspace_file_excluded_extensions[i]) == 0) {
+                break;
+            }
+        }
+        if (i < sizeof(workspace_file_excluded_extensions) / sizeof(workspace_file_excluded_extensions[0])) {
+            continue;
+        }
+        if (*files_count == files_capacity) {
+            const int capacity = files_capacity == 0 ? 8 : 2 * files_capacity;
+            workspace_file *new_files = (workspace_file *)realloc(files, capacity * sizeof(workspace_file));
+            if (new_files == NULL) {
+                goto error_cleanup;
+            }
+            files = new_files;
+            files_capacity = capacity;
+        }
+        file = &files[*files_count];
+        file->content = NULL;
+        file->name = sprintf_alloc("%s", entry->d_name);
+        if (file->name == NULL) {
+            goto error_cleanup;
+        }
+        (*files_count)++;
+        filename = sprintf_alloc("%s/%s", dirname, entry->d_name);
+        if (filename == NULL) {
+            goto error_cleanup;
+        }
+        read_file(&file->content, &file->content_size, error, filename);
+        free(filename);
+        if (file->content == NULL) {
+            goto error_cleanup;
+        }
+    }
+    closedir(dir);
+    return files;
+error_cleanup:
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    free_workspace_files(files, *files_count);
+    *files_count = -1;
+    return NULL;
+}
+
+/*! Create files in a temporary directory.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param files
+ *      the files, see read_workspace_files()
+ *
+ *  \param files_count
+ *      number of elements in \c files
+ *
+ *  \param dir
+ *      the temporary directory
+ */
+static int write_workspace_files(char **error, const workspace_file *files, int files_count, const char *dir)
+{
+    int i;
+    *error = NULL;
+    for (i = 0; i < files_count; i++) {
+        char *filename = sprintf_alloc("%s/%s", dir, files[i].name);
+        if (filename == NULL) {
+            return -1;
+        }
+        if (write_file(error, filename, files[i].content, files[i].content_size) != 0) {
+            free(filename);
+            return -1;
+        }
+        free(filename);
+    }
+    return 0;
+}
+
+/*! Find the executable of a command in \c PATH, like \c execvp() does.
+ *
+ *  \return
+ *      a newly allocated string containing the path of the executable,
+ *      or \c NULL on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param cmd
+ *      the command,
+ *      which is returned as it is if it contains a \c '/'
+ */
+static char *find_executable(char **error, const char *cmd)
+{
+    const char *path;
+    const char *entry;
+    const char *entry_end;
+    *error = NULL;
+    if (strchr(cmd, '/') != NULL) {
+        return sprintf_alloc("%s", cmd);
+    }
+    pthread_once(&environment_once, environment_init);
+    path = environment_path;
+    for (entry = path; *entry != '\0'; entry = entry_end + (*entry_end == ':')) {
+        char *filename;
+        struct stat st;
+        entry_end = strchr(entry, ':');
+        if (entry_end == NULL) {
+            entry_end = entry + strlen(entry);
+        }
+        if (entry_end == entry) {
+            filename = sprintf_alloc("%s", cmd);
+        } else {
+            filename = sprintf_alloc("%.*s/%s", (int)(entry_end - entry), entry, cmd);
+        }
+        if (filename == NULL) {
+            return NULL;
+        }
+        if (stat(filename, &st) == 0 && S_ISREG(st.st_mode) && access(filename, X_OK) == 0) {
+            return filename;
+        }
+        free(filename);
+    }
+    *error = sprintf_alloc("Unable to find command \"%s\" in PATH.", cmd);
+    return NULL;
+}
+
+/*! Start a command within a directory using \c fork() and \c exec().
+ *
+ *  This is the portable fallback of spawn_command().
+ *  Note that \c fork() has to copy the page tables of the calling process,
+ *  which becomes expensive when the calling process is large.
+ *
+ *  Since the calling process may have multiple threads,
+ *  the child process uses only async-signal-safe functions
+ *  between \c fork() and \c exec().
+ *  In particular, the executable is searched in \c PATH beforehand,
+ *  and no \c stdio functions are used,
+ *  which might flush buffers of the calling process.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param pid
+ *      will be set to the process ID of the child process
+ *
+ *  \param dir
+ *      working directory of the command
+ *
+ *  \param executable
+ *      full path of the command,
+ *      or \c NULL to search \c argv[0] in \c PATH
+ *
+ *  \param stdout_fd
+ *      file descriptor to become the command's stdout,
+ *      or -1 for \c /dev/null
+ *
+ *  \param argv
+ *      command and its arguments, terminated by \c NULL
+ *
+ *  \param envp
+ *      environment of the command, terminated by \c NULL,
+ *      or \c NULL for the environment of the calling process
+ */
+static int spawn_command_fork(char **error, pid_t *pid, const char *dir, const char *executable, int stdout_fd, char *const argv[], char *const envp[])
+{
+    char *found = NULL;
+    *error = NULL;
+    if (executable == NULL) {
+        found = find_executable(error, argv[0]);
+        if (found == NULL) {
+            return -1;
+        }
+        executable = found;
+    }
+    *pid = fork();
+    if (*pid == -1) {
+        *error = sprintf_alloc("Unable to fork child process: %s.",
+                               strerror(errno));
+        free(found);
+        return -1;
+    }
+    /* child process */
+    if (*pid == 0) {
+        int fd;
+        /* run command within the directory */
+        if (chdir(dir) != 0) {
+            _exit(127);
+        }
+        /* prevent access to stdin, stdout and stderr */
+        fd = open("/dev/null", O_RDWR);
+        if (   fd == -1
+            || dup2(fd, 0) == -1
+            || dup2(stdout_fd == -1 ? fd : stdout_fd, 1) == -1
+            || dup2(fd, 2) == -1) {
+            _exit(127);
+        }
+        if (fd > 2) {
+            close(fd);
+        }
+        /* execute command */
+        execve(executable, argv, envp == NULL ? environ : envp);
+        /* exit if execve() failed */
+        _exit(127);
+    }
+    free(found);
+    return 0;
+}
+
+/*! Start a command within a directory using \c posix_spawn().
+ *
+ *  Unlike spawn_command_fork(),
+ *  this doesn't copy the page tables of the calling process,
+ *  so the cost of starting a command doesn't grow
+ *  with the size of the calling process.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      If \c posix_spawn() is not supported on this system,
+ *      \c error will be set to \c NULL.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param pid
+ *      will be set to the process ID of the child process
+ *
+ *  \param dir
+ *      working directory of the command
+ *
+ *  \param executable
+ *      full path of the command,
+ *      or \c NULL to search \c argv[0] in \c PATH
+ *
+ *  \param stdout_fd
+ *      file descriptor to become the command's stdout,
+ *      or -1 for \c /dev/null
+ *
+ *  \param argv
+ *      command and its arguments, terminated by \c NULL
+ *
+ *  \param envp
+ *      environment of the command, terminated by \c NULL,
+ *      or \c NULL for the environment of the calling process
+ */
+static int spawn_command_posix_spawn(char **error, pid_t *pid, const char *dir, const char *executable, int stdout_fd, char *const argv[], char *const envp[])
+{
+#if TEXCALLER_HAVE_POSIX_SPAWN_CHDIR
+    posix_spawn_file_actions_t file_actions;
+    int err;
+    *error = NULL;
+    err = posix_spawn_file_actions_init(&file_actions);
+    if (err != 0) {
+        *error = sprintf_alloc("Unable to prepare spawning of command \"%s\": %s.",
+                               argv[0], strerror(err));
+        return -1;
+    }
+    /* run command within the directory,
+       and prevent access to stdin, stdout and stderr */
+    if (   (err = posix_spawn_file_actions_addchdir_np(&file_actions, dir)) != 0
+        || (err = posix_spawn_file_actions_addopen(&file_actions, 0, "/dev/null", O_RDONLY, 0)) != 0
+        || (err = stdout_fd == -1
+                  ? posix_spawn_file_actions_addopen(&file_actions, 1, "/dev/null", O_WRONLY, 0)
+                  : posix_spawn_file_actions_adddup2(&file_actions, stdout_fd, 1)) != 0
+        || (err = posix_spawn_file_actions_addopen(&file_actions, 2, "/dev/null", O_WRONLY, 0)) != 0) {
+        *error = sprintf_alloc("Unable to prepare spawning of command \"%s\": %s.",
+                               argv[0], strerror(err));
+        posix_spawn_file_actions_destroy(&file_actions);
+        return -1;
+    }
+    /* execute command */
+    if (envp == NULL) {
+        envp = environ;
+    }
+    if (executable != NULL) {
+        err = posix_spawn(pid, executable, &file_actions, NULL, argv, envp);
+    } else {
+        err = posix_spawnp(pid, argv[0], &file_actions, NULL, argv, envp);
+    }
+    posix_spawn_file_actions_destroy(&file_actions);
+    if (err != 0) {
+        *error = sprintf_alloc("Unable to spawn command \"%s\": %s.",
+                               argv[0], strerror(err));
+        return -1;
+    }
+    return 0;
+#else
+    (void)pid;
+    (void)dir;
+    (void)executable;
+    (void)stdout_fd;
+    (void)argv;
+    (void)envp;
+    *error = NULL;
+    return -1;
+#endif
+}
+
+/*! Start a command within a directory.
+ *
+ *  The command's stdin, stdout and stderr are redirected to \c /dev/null,
+ *  unless another stdout is given.
+ *  Its executable is searched in \c PATH unless given.
+ *  This function is thread-safe.
+ *
+ *  The fastest available backend is used,
+ *  that is, \c posix_spawn() where it is able to change
+ *  the working directory of the child process
+ *  (spawn_command_posix_spawn()),
+ *  and \c fork() otherwise (spawn_command_fork()).
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param pid
+ *      will be set to the process ID of the child process
+ *
+ *  \param dir
+ *      working directory of the command
+ *
+ *  \param executable
+ *      full path of the command, as returned by find_executable(),
+ *      or \c NULL to search \c argv[0] in \c PATH
+ *
+ *  \param stdout_fd
+ *      file descriptor to become the command's stdout,
+ *      or -1 for \c /dev/null
+ *
+ *  \param argv
+ *      command and its arguments, terminated by \c NULL
+ *
+ *  \param envp
+ *      environment of the command, terminated by \c NULL,
+ *      or \c NULL for the environment of the calling process
+ */
+static int spawn_command(char **error, pid_t *pid, const char *dir, const char *executable, int stdout_fd, char *const argv[], char *const envp[])
+{
+    if (TEXCALLER_HAVE_POSIX_SPAWN_CHDIR) {
+        if (spawn_command_posix_spawn(error, pid, dir, executable, stdout_fd, argv, envp) == 0) {
+            return 0;
+        }
+        if (*error != NULL) {
+            return -1;
+        }
+    }
+    return spawn_command_fork(error, pid, dir, executable, stdout_fd, argv, envp);
+}
+
+/*! Wait for a command started by spawn_command() to terminate.
+ *
+ *  \return
+ *      0 if the command terminated with exit status 0, -1 otherwise
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param pid
+ *      process ID of the command
+ *
+ *  \param cmd
+ *      name of the command, used for error messages
+ */
+static int wait_command(char **error, pid_t pid, const char *cmd)
+{
+    *error = NULL;
+    for (;;) {
+        int status;
+        pid_t wpid = waitpid(pid, &status, 0);
+        if (wpid == -1 && errno == EINTR) {
+            continue;
+        }
+        if (wpid == -1) {
+            *error = sprintf_alloc("Unable to wait for child process: %s.",
+                                   strerror(errno));
+            return -1;
+        }
+        if (WIFSIGNALED(status)) {
+            *error = sprintf_alloc("Command \"%s\" was terminated by signal %i.",
+                                   cmd, (int)WTERMSIG(status));
+            return -1;
+        }
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            *error = sprintf_alloc("Command \"%s\" terminated with exit status %i.",
+                                   cmd, (int)WEXITSTATUS(status));
+            return -1;
+        }
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            return 0;
+        }
+    }
+}
+
+/*! Generate additional outputs from a result document.
+ *
+ *  The conversion tools for all outputs are run in parallel.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param outputs
+ *      the outputs to generate, whose \c result and \c result_size
+ *      will be set on success
+ *
+ *  \param outputs_count
+ *      number of elements in \c outputs
+ *
+ *  \param dir
+ *      the temporary directory that contains the result document
+ *
+ *  \param result_format
+ *      format of the result document, \c "DVI" or \c "PDF"
+ */
+static int convert_outputs(char **error, texcaller_output *outputs, int outputs_count, const char *dir, const char *result_format)
+{
+    pid_t *pids;
+    int spawned;
+    int i;
+    *error = NULL;
+    pids = (pid_t *)malloc(outputs_count * sizeof(pid_t));
+    if (pids == NULL) {
+        return -1;
+    }
+    /* start all conversion tools */
+    for (spawned = 0; spawned < outputs_count; spawned++) {
+        const texcaller_output *output = &outputs[spawned];
+        const int is_png = strcmp(output->format, "PNG") == 0;
+        char page_arg[32];
+        char resolution_arg[32];
+        char filename[32];
+        char *argv[11];
+        int argc = 0;
+        sprintf(page_arg, "%i", output->page);
+        sprintf(resolution_arg, "%i", output->resolution > 0 ? output->resolution : 150);
+        sprintf(filename, "output-%i.%s", spawned, is_png ? "png" : "svg");
+        if (strcmp(result_format, "PDF") == 0) {
+            argv[argc++] = (char *)"pdftocairo";
+            argv[argc++] = (char *)(is_png ? "-png" : "-svg");
+            argv[argc++] = (char *)"-f";
+            argv[argc++] = page_arg;
+            argv[argc++] = (char *)"-l";
+            argv[argc++] = page_arg;
+            if (is_png) {
+                argv[argc++] = (char *)"-r";
+                argv[argc++] = resolution_arg;
+                argv[argc++] = (char *)"-singlefile";
+                /* pdftocairo adds the .png extension by itself */
+                filename[strlen(filename) - strlen(".png")] = '\0';
+            }
+            argv[argc++] = (char *)"texput.pdf";
+            argv[argc++] = filename;
+        } else if (is_png) {
+            argv[argc++] = (char *)"dvipng";
+            argv[argc++] = (char *)"-q";
+            argv[argc++] = (char *)"-D";
+            argv[argc++] = resolution_arg;
+            argv[argc++] = (char *)"-pp";
+            argv[argc++] = page_arg;
+            argv[argc++] = (char *)"-o";
+            argv[argc++] = filename;
+            argv[argc++] = (char *)"texput.dvi";
+        } else {
+            argv[argc++] = (char *)"dvisvgm";
+            argv[argc++] = (char *)"-p";
+            argv[argc++] = page_arg;
+            argv[argc++] = (char *)"-o";
+            argv[argc++] = filename;
+            argv[argc++] = (char *)"texput.dvi";
+        }
+        argv[argc++] = NULL;
+        if (spawn_command(error, &pids[spawned], dir, NULL, -1, argv, NULL) != 0) {
+            break;
+        }
+    }
+    /* wait for all started conversion tools, even after errors */
+    for (i = 0; i < spawned; i++) {
+        char *wait_error;
+        if (wait_command(&wait_error, pids[i], "output conversion") != 0) {
+            if (*error == NULL) {
+                *error = wait_error;
+            } else {
+                free(wait_error);
+            }
+        }
+    }
+    free(pids);
+    if (spawned < outputs_count || *error != NULL) {
+        return -1;
+    }
+    /* read all outputs */
+    for (i = 0; i < outputs_count; i++) {
+        char *filename = sprintf_alloc("%s/output-%i.%s", dir, i,
+                                       strcmp(outputs[i].format, "PNG") == 0 ? "png" : "svg");
+        if (filename == NULL) {
+            return -1;
+        }
+        read_file(&outputs[i].result, &outputs[i].result_size, error, filename);
+        free(filename);
+        if (outputs[i].result == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*! Number of elements of ::texcaller_source_format. */
+#define SOURCE_FORMATS_COUNT 6
+
+/*! Number of elements of ::texcaller_result_format. */
+#define RESULT_FORMATS_COUNT 2
+
+/*! Names of the source formats, indexed by ::texcaller_source_format. */
+static const char *const source_format_names[SOURCE_FORMATS_COUNT] = {
+    "TeX", "LaTeX", "XeTeX", "XeLaTeX", "LuaTeX", "LuaLaTeX"
+};
+
+/*! Names of the result formats, indexed by ::texcaller_result_format. */
+static const char *const result_format_names[RESULT_FORMATS_COUNT] = {
+    "DVI", "PDF"
+};
+
+/*! TeX interpreters, indexed by ::texcaller_source_format
+ *  and ::texcaller_result_format,
+ *  or \c NULL if the conversion is not supported.
+ */
+static const char *const engine_commands[SOURCE_FORMATS_COUNT][RESULT_FORMATS_COUNT] = {
+    {"tex",   "pdftex"},
+    {"latex", "pdflatex"},
+    {NULL,    "xetex"},
+    {NULL,    "xelatex"},
+    {NULL,    "luatex"},
+    {NULL,    "lualatex"}
+};
+
+/*! Find the index of a format name.
+ *
+ *  \return
+ *      the index of \c name within \c names,
+ *      or -1 if not found
+ *
+ *  \param names
+ *      the format names
+ *
+ *  \param names_count
+ *      number of elements in \c names
+ *
+ *  \param name
+ *      the format name to look up
+ */
+static int find_format(const char *const names[], int names_count, const char *name)
+{
+    int i;
+    for (i = 0; i < names_count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*! \name Compression
+ *
+ *  Compressed sources and results,
+ *  see texcaller_job::source_codec and texcaller_job::result_codec.
+ *
+ *  The compression tools work on files within the temporary directory,
+ *  so the uncompressed source is written straight into \c texput.tex
+ *  and the uncompressed result is read straight from \c texput.pdf,
+ *  without either of them being held in memory.
+ *
+ *  @{
+ */
+
+/*! Number of elements of ::texcaller_codec. */
+#define CODECS_COUNT 3
+
+/*! Names of the codecs, indexed by ::texcaller_codec. */
+static const char *const codec_names[CODECS_COUNT] = {
+    "identity", "gzip", "zstd"
+};
+
+/*! Compression tools, indexed by ::texcaller_codec,
+ *  or \c NULL if no compression is needed.
+ *  All of them decompress via \c -d
+ *  and write to stdout via \c -c.
+ */
+static const char *const codec_commands[CODECS_COUNT] = {
+    NULL, "gzip", "zstd"
+};
+
+/*! File name extensions of the codecs, indexed by ::texcaller_codec. */
+static const char *const codec_extensions[CODECS_COUNT] = {
+    "", ".gz", ".zst"
+};
+
+/*! Compress or decompress a file via an external tool.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param dir
+ *      working directory of the tool
+ *
+ *  \param codec
+ *      the codec, which must not be \c TEXCALLER_IDENTITY
+ *
+ *  \param decompress
+ *      whether to decompress rather than compress
+ *
+ *  \param input_filename
+ *      the file to read
+ *
+ *  \param output_filename
+ *      the file to create
+ */
+static int run_codec(char **error, const char *dir, int codec, int decompress, const char *input_filename, const char *output_filename)
+{
+    char *argv[6];
+    pid_t pid;
+    int argc = 0;
+    int fd;
+    argv[argc++] = (char *)codec_commands[codec];
+    if (decompress) {
+        argv[argc++] = (char *)"-d";
+    }
+    argv[argc++] = (char *)"-c";
+    argv[argc++] = (char *)"-q";
+    argv[argc++] = (char *)input_filename;
+    argv[argc++] = NULL;
+    fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        *error = sprintf_alloc("Unable to open file \"%s\" for writing: %s.",
+                               output_filename, strerror(errno));
+        return -1;
+    }
+    if (spawn_command(error, &pid, dir, NULL, fd, argv, NULL) != 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return wait_command(error, pid, argv[0]);
+}
+
+/*! @} */
+
+/*! \name Metrics
+ *
+ *  Process-wide counters of all conversions,
+ *  see texcaller_metrics_snapshot().
+ *
+ *  Recording must not slow down concurrent conversions,
+ *  so the counters are split into shards.
+ *  Each thread updates the shard chosen by a hash of its thread ID
+ *  via atomic additions,
+ *  which don't contend unless two threads share a shard,
+ *  and a snapshot sums up all shards.
+ *  The counters are <tt>unsigned long</tt>,
+ *  and times are counted in microseconds.
+ *
+ *  @{
+ */
+
+/*! Number of shards of the metrics. */
+#define METRICS_SHARDS 16
+
+/*! Number of buckets of the runs histogram, the last one being unbounded. */
+#define METRICS_RUNS_BUCKETS 7
+
+/*! Number of buckets of the latency histogram, the last one being unbounded. */
+#define METRICS_LATENCY_BUCKETS 12
+
+/*! Upper bounds of the latency buckets in seconds. */
+static const double metrics_latency_bounds[METRICS_LATENCY_BUCKETS - 1] = {
+    0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60, 300
+};
+
+/*! Outcome of a conversion. */
+enum metrics_outcome
+{
+    METRICS_SUCCEEDED,
+    METRICS_FAILED,
+    METRICS_CANCELLED,
+    METRICS_OUTCOMES_COUNT
+};
+
+/*! Names of the outcomes, indexed by ::metrics_outcome. */
+static const char *const metrics_outcome_names[METRICS_OUTCOMES_COUNT] = {
+    "succeeded", "failed", "cancelled"
+};
+
+/*! A shard of the metrics.
+ */
+typedef struct metrics_shard
+{
+    /*! conversions by source format, result format and outcome */
+    unsigned long conversions[SOURCE_FORMATS_COUNT][RESULT_FORMATS_COUNT][METRICS_OUTCOMES_COUNT];
+    /*! successful conversions by number of TeX runs */
+    unsigned long runs[METRICS_RUNS_BUCKETS];
+    /*! TeX runs of all successful conversions */
+    unsigned long runs_sum;
+    /*! conversions by latency */
+    unsigned long latency[METRICS_LATENCY_BUCKETS];
+    /*! latency of all conversions in microseconds */
+    unsigned long latency_sum;
+    /*! time all conversions waited for the scheduler in microseconds */
+    unsigned long queue_sum;
+    /*! size of all sources */
+    unsigned long source_bytes;
+    /*! size of all results */
+    unsigned long result_bytes;
+    /*! temporary directories that couldn't be removed */
+    unsigned long cleanup_failures;
+    /*! failed attempts to convert on a remote worker */
+    unsigned long remote_failures;
+    /*! previews that have been stopped early */
+    unsigned long truncated_previews;
+    /*! keeps the shards on separate cache lines */
+    char padding[64];
+} metrics_shard;
+
+/*! The shards of the metrics. */
+static metrics_shard metrics_shards[METRICS_SHARDS];
+
+/*! Description of a metric, for texcaller_metrics_prometheus().
+ */
+typedef struct metrics_family
+{
+    /*! name of the metric */
+    const char *name;
+    /*! Prometheus metric type */
+    const char *type;
+    /*! description of the metric */
+    const char *help;
+} metrics_family;
+
+/*! All metrics, in the order of texcaller_metrics_snapshot(). */
+static const metrics_family metrics_families[] = {
+    {"texcaller_conversions_total", "counter", "Conversions by source format, result format and outcome."},
+    {"texcaller_runs", "histogram", "TeX runs per successful conversion."},
+    {"texcaller_conversion_seconds", "histogram", "Latency of conversions, including the queue."},
+    {"texcaller_queue_seconds_total", "counter", "Time conversions waited for the scheduler."},
+    {"texcaller_source_bytes_total", "counter", "Size of all sources."},
+    {"texcaller_result_bytes_total", "counter", "Size of all results."},
+    {"texcaller_cleanup_failures_total", "counter", "Temporary directories that couldn't be removed."},
+    {"texcaller_remote_failures_total", "counter", "Failed attempts to convert on a remote worker."},
+    {"texcaller_truncated_previews_total", "counter", "Previews that have been stopped early."}
+};
+
+/*! Number of elements in \c metrics_families. */
+#define METRICS_FAMILIES_COUNT ((int)(sizeof(metrics_families) / sizeof(metrics_families[0])))
+
+/*! Get the shard of the calling thread.
+ *
+ *  \return
+ *      the shard
+ */
+static metrics_shard *metrics_shard_of_thread(void)
+{
+    const pthread_t self = pthread_self();
+    return &metrics_shards[hash_bytes(HASH_BYTES_INIT, (const char *)&self, sizeof(self)) % METRICS_SHARDS];
+}
+
+/*! Add to a counter of a shard.
+ *
+ *  \param counter
+ *      the counter
+ *
+ *  \param value
+ *      the value to add
+ */
+static void metrics_add(unsigned long *counter, unsigned long value)
+{
+    __sync_fetch_and_add(counter, value);
+}
+
+/*! Record a finished conversion.
+ *
+ *  \param job
+ *      the conversion
+ *
+ *  \param outcome
+ *      see ::metrics_outcome
+ *
+ *  \param runs
+ *      number of TeX runs
+ *
+ *  \param latency
+ *      seconds since the conversion started, including the queue
+ *
+ *  \param queue_time
+ *      seconds the conversion waited for the scheduler
+ *
+ *  \param result_size
+ *      size of the result
+ *
+ *  \param cleanup_failed
+ *      whether the temporary directory couldn't be removed
+ */
+static void metrics_record(const texcaller_job *job, int outcome, int runs, double latency, double queue_time, size_t result_size, int cleanup_failed)
+{
+    metrics_shard *shard = metrics_shard_of_thread();
+    const int source_format = (int)job->source_format;
+    const int result_format = (int)job->result_format;
+    int bucket;
+    if (   source_format >= 0 && source_format < SOURCE_FORMATS_COUNT
+        && result_format >= 0 && result_format < RESULT_FORMATS_COUNT) {
+        metrics_add(&shard->conversions[source_format][result_format][outcome], 1);
+    }
+    /* remote conversions don't report their runs */
+    if (outcome == METRICS_SUCCEEDED && runs > 0) {
+        bucket = runs < 1 ? 0 : runs > METRICS_RUNS_BUCKETS ? METRICS_RUNS_BUCKETS - 1 : runs - 1;
+        metrics_add(&shard->runs[bucket], 1);
+        metrics_add(&shard->runs_sum, (unsigned long)runs);
+    }
+    for (bucket = 0; bucket < METRICS_LATENCY_BUCKETS - 1 && latency > metrics_latency_bounds[bucket]; bucket++) {
+    }
+    metrics_add(&shard->latency[bucket], 1);
+    metrics_add(&shard->latency_sum, (unsigned long)(latency * 1e6));
+    metrics_add(&shard->queue_sum, (unsigned long)(queue_time * 1e6));
+    metrics_add(&shard->source_bytes, (unsigned long)job->source_size);
+    metrics_add(&shard->result_bytes, (unsigned long)result_size);
+    if (cleanup_failed) {
+        metrics_add(&shard->cleanup_failures, 1);
+    }
+}
+
+/*! @} */
+
+/*! \name Remote workers
+ *
+ *  Conversions may be delegated to worker processes on other machines
+ *  (see texcaller_options::workers and texcaller_worker_serve()).
+ *  Each worker address is resolved only once per process,
+ *  and registered along with the worker's state,
+ *  which is shared by all conversions within the process.
+ *
+ *  @{
+ */
+
+/*! Magic bytes starting each request and response,
+ *  including the protocol version.
+ */
+#define REMOTE_MAGIC "TXC2"
+
+/*! Size of the fixed part of a request. */
+#define REMOTE_REQUEST_HEADER_SIZE 36
+
+/*! Size of the fixed part of a response. */
+#define REMOTE_RESPONSE_HEADER_SIZE 20
+
+/*! Seconds during which a failed worker is avoided. */
+#define REMOTE_RETRY_DELAY 5.0
+
+/*! Seconds to wait for a connection to a worker. */
+#define REMOTE_CONNECT_TIMEOUT 5
+
+/*! Maximum size of the secret and the tenant name of a request. */
+#define REMOTE_MAX_NAME_SIZE 4096
+
+/*! Maximum size of the result of a response. */
+#define REMOTE_MAX_RESULT_SIZE (256 * 1024 * 1024UL)
+
+/*! Maximum size of the info of a response. */
+#define REMOTE_MAX_INFO_SIZE (16 * 1024 * 1024UL)
+
+/*! A remote worker. */
+typedef struct remote_worker
+{
+    /*! Address as given in texcaller_options::workers. */
+    char *address;
+
+    /*! Resolved socket address. */
+    struct sockaddr_storage addr;
+
+    /*! Size of \c addr. */
+    socklen_t addr_size;
+
+    /*! Number of conversions of this process currently sent to the worker. */
+    int pending;
+
+    /*! Queue depth reported by the worker in its last response. */
+    unsigned long load;
+
+    /*! Time of the last failure, according to monotonic_time(),
+     *  or 0 if the last request succeeded.
+     */
+    double failure_time;
+} remote_worker;
+
+/*! Protects all \c remote_* variables and all remote workers. */
+static pthread_mutex_t remote_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*! All remote workers known to this process, never freed. */
+static remote_worker **remote_workers = NULL;
+
+/*! Number of elements in \c remote_workers. */
+static size_t remote_workers_count = 0;
+
+/*! Resolve a worker address.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param addr
+ *      will be set to the resolved socket address
+ *
+ *  \param addr_size
+ *      will be set to the size of \c addr
+ *
+ *  \param address
+ *      the address, either <tt>unix:PATH</tt> or <tt>HOST:PORT</tt>
+ *
+ *  \param passive
+ *      whether the address is meant for listening,
+ *      in which case an empty \c HOST is rejected,
+ *      so that all interfaces are only used when asked for explicitly
+ */
+static int resolve_address(char **error, struct sockaddr_storage *addr, socklen_t *addr_size, const char *address, int passive)
+{
+    const char *colon;
+    char *host;
+    struct addrinfo hints;
+    struct addrinfo *info;
+    int err;
+    *error = NULL;
+    memset(addr, 0, sizeof(*addr));
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un *addr_un = (struct sockaddr_un *)addr;
+        if (strlen(address + 5) >= sizeof(addr_un->sun_path)) {
+            *error = sprintf_alloc("Socket path of address \"%s\" is too long.",
+                                   address);
+            return -1;
+        }
+        addr_un->sun_family = AF_UNIX;
+        strcpy(addr_un->sun_path, address + 5);
+        *addr_size = sizeof(struct sockaddr_un);
+        return 0;
+    }
+    colon = strrchr(address, ':');
+    if (colon == NULL) {
+        *error = sprintf_alloc("Address \"%s\" is neither \"unix:PATH\" nor \"HOST:PORT\".",
+                               address);
+        return -1;
+    }
+    /* strip brackets around IPv6 addresses */
+    if (address[0] == '[' && colon - address >= 2 && colon[-1] == ']') {
+        host = sprintf_alloc("%.*s", (int)(colon - address - 2), address + 1);
+    } else {
+        host = sprintf_alloc("%.*s", (int)(colon - address), address);
+    }
+    if (host == NULL) {
+        return -1;
+    }
+    if (passive && strcmp(host, "") == 0) {
+        *error = sprintf_alloc("Address \"%s\" has no host, use \"0.0.0.0%s\" or \"[::]%s\" to listen on all interfaces.",
+                               address, colon, colon);
+        free(host);
+        return -1;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    err = getaddrinfo(strcmp(host, "") == 0 ? NULL : host, colon + 1, &hints, &info);
+    free(host);
+    if (err != 0) {
+        *error = sprintf_alloc("Unable to resolve address \"%s\": %s.",
+                               address, gai_strerror(err));
+        return -1;
+    }
+    memcpy(addr, info->ai_addr, info->ai_addrlen);
+    *addr_size = info->ai_addrlen;
+    freeaddrinfo(info);
+    return 0;
+}
+
+/*! Find or register a remote worker.
+ *
+ *  Must be called with \c remote_mutex locked,
+ *  which is released while resolving the address of a new worker,
+ *  so a slow name lookup doesn't block the other threads.
+ *
+ *  \return
+ *      the remote worker, or \c NULL on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param address
+ *      the worker's address, not necessarily null-terminated
+ *
+ *  \param address_size
+ *      size of \c address
+ */
+static remote_worker *remote_worker_register(char **error, const char *address, size_t address_size)
+{
+    remote_worker *worker;
+    remote_worker **new_workers;
+    size_t i;
+    int status;
+    *error = NULL;
+    for (i = 0; i < remote_workers_count; i++) {
+        if (   strlen(remote_workers[i]->address) == address_size
+            && strncmp(remote_workers[i]->address, address, address_size) == 0) {
+            return remote_workers[i];
+        }
+    }
+    worker = (remote_worker *)malloc(sizeof(remote_worker));
+    if (worker == NULL) {
+        return NULL;
+    }
+    worker->address = sprintf_alloc("%.*s", (int)address_size, address);
+    if (worker->address == NULL) {
+        free(worker);
+        return NULL;
+    }
+    pthread_mutex_unlock(&remote_mutex);
+    status = resolve_address(error, &worker->addr, &worker->addr_size, worker->address, 0);
+    pthread_mutex_lock(&remote_mutex);
+    if (status != 0) {
+        goto failure;
+    }
+    /* another thread may have registered the worker meanwhile */
+    for (i = 0; i < remote_workers_count; i++) {
+        if (strcmp(remote_workers[i]->address, worker->address) == 0) {
+            free(worker->address);
+            free(worker);
+            return remote_workers[i];
+        }
+    }
+    new_workers = (remote_worker **)realloc(remote_workers, (remote_workers_count + 1) * sizeof(remote_worker *));
+    if (new_workers == NULL) {
+        goto failure;
+    }
+    remote_workers = new_workers;
+    worker->pending = 0;
+    worker->load = 0;
+    worker->failure_time = 0;
+    remote_workers[remote_workers_count++] = worker;
+    return worker;
+failure:
+    free(worker->address);
+    free(worker);
+    return NULL;
+}
+
+/*! Find or register all remote workers of a list.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param workers
+ *      will be set to a newly allocated array of the remote workers
+ *
+ *  \param workers_count
+ *      will be set to the number of elements in \c workers
+ *
+ *  \param list
+ *      comma-separated list of worker addresses
+ */
+static int remote_workers_find(char **error, remote_worker ***workers, int *workers_count, const char *list)
+{
+    const char *entry;
+    const char *entry_end;
+    *error = NULL;
+    *workers = NULL;
+    *workers_count = 0;
+    pthread_mutex_lock(&remote_mutex);
+    for (entry = list; *entry != '\0'; entry = entry_end + (*entry_end == ',')) {
+        remote_worker *worker;
+        remote_worker **new_workers;
+        entry_end = strchr(entry, ',');
+        if (entry_end == NULL) {
+            entry_end = entry + strlen(entry);
+        }
+        if (entry_end == entry) {
+            continue;
+        }
+        worker = remote_worker_register(error, entry, entry_end - entry);
+        if (worker == NULL) {
+            goto failure;
+        }
+        new_workers = (remote_worker **)realloc(*workers, (*workers_count + 1) * sizeof(remote_worker *));
+        if (new_workers == NULL) {
+            goto failure;
+        }
+        *workers = new_workers;
+        (*workers)[(*workers_count)++] = worker;
+    }
+    pthread_mutex_unlock(&remote_mutex);
+    if (*workers_count == 0) {
+        *error = sprintf_alloc("No remote worker given in \"%s\".", list);
+        return -1;
+    }
+    return 0;
+failure:
+    pthread_mutex_unlock(&remote_mutex);
+    free(*workers);
+    *workers = NULL;
+    *workers_count = 0;
+    return -1;
+}
+
+/*! Choose the remote worker for the next attempt of a conversion.
+ *
+ *  Workers that failed recently are avoided.
+ *  Among the others, the worker with the fewest pending conversions
+ *  of this process is chosen,
+ *  and if that's a tie, the worker that reported the shortest queue.
+ *  The \c pending counter of the chosen worker is incremented.
+ *
+ *  \return
+ *      index of the chosen worker
+ *
+ *  \param workers
+ *      the remote workers
+ *
+ *  \param workers_count
+ *      number of elements in \c workers
+ *
+ *  \param tried
+ *      for each worker, whether it has already been tried,
+ *      in which case it won't be chosen again.
+ *      At least one worker must not have been tried yet.
+ */
+static int remote_worker_choose(remote_worker *const workers[], int workers_count, const char *tried)
+{
+    const double now = monotonic_time();
+    int best = -1;
+    int best_available = 0;
+    int i;
+    pthread_mutex_lock(&remote_mutex);
+    for (i = 0; i < workers_count; i++) {
+        const remote_worker *worker = workers[i];
+        const int available = worker->failure_time == 0 || now - worker->failure_time >= REMOTE_RETRY_DELAY;
+        if (tried[i]) {
+            continue;
+        }
+        if (   best == -1
+            || available > best_available
+            || (   available == best_available
+                && (   worker->pending < workers[best]->pending
+                    || (   worker->pending == workers[best]->pending
+                        && worker->load < workers[best]->load)))) {
+            best = i;
+            best_available = available;
+        }
+    }
+    workers[best]->pending++;
+    pthread_mutex_unlock(&remote_mutex);
+    return best;
+}
+
+/*! Encode an unsigned 32 bit integer in network byte order.
+ *
+ *  \param p
+ *      buffer of 4 bytes
+ *
+ *  \param value
+ *      the integer
+ */
+static void put_uint32(unsigned char *p, unsigned long value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+/*! Decode an unsigned 32 bit integer in network byte order.
+ *
+ *  \return
+ *      the integer
+ *
+ *  \param p
+ *      buffer of 4 bytes
+ */
+static unsigned long get_uint32(const unsigned char *p)
+{
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | ((unsigned long)p[2] << 8) | p[3];
+}
+
+/*! Write a buffer completely to a socket.
+ *
+ *  \return
+ *      0 on success, -1 on failure, with \c errno set.
+ *      If the send timeout of the socket expired,
+ *      \c errno is set to \c ETIMEDOUT.
+ *
+ *  \param fd
+ *      the socket
+ *
+ *  \param data
+ *      the buffer
+ *
+ *  \param size
+ *      size of \c data
+ */
+static int send_all(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            errno = ETIMEDOUT;
+        }
+        if (sent == -1) {
+            return -1;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return 0;
+}
+
+/*! Read a buffer completely from a socket.
+ *
+ *  \return
+ *      0 on success, -1 on failure, with \c errno set.
+ *      If the connection was closed before,
+ *      \c errno is set to \c ECONNRESET,
+ *      and if the receive timeout of the socket expired,
+ *      to \c ETIMEDOUT.
+ *
+ *  \param fd
+ *      the socket
+ *
+ *  \param data
+ *      the buffer
+ *
+ *  \param size
+ *      size of \c data
+ */
+static int recv_all(int fd, char *data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t received = recv(fd, data, size, 0);
+        if (received == -1 && errno == EINTR) {
+            continue;
+        }
+        if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            errno = ETIMEDOUT;
+        }
+        if (received == -1) {
+            return -1;
+        }
+        if (received == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        data += received;
+        size -= received;
+    }
+    return 0;
+}
+
+/*! Set the send and receive timeouts of a socket.
+ *
+ *  \param fd
+ *      the socket
+ *
+ *  \param seconds
+ *      the timeout, see texcaller_options::worker_timeout
+ */
+static void set_socket_timeout(int fd, int seconds)
+{
+    struct timeval timeout;
+    if (seconds <= 0) {
+        return;
+    }
+    timeout.tv_sec = seconds;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/*! Connect a socket, giving up after \c REMOTE_CONNECT_TIMEOUT.
+ *
+ *  \return
+ *      0 on success, -1 on failure, with \c errno set
+ *
+ *  \param fd
+ *      the socket, in blocking mode
+ *
+ *  \param addr
+ *      the address to connect to
+ *
+ *  \param addr_size
+ *      size of \c addr
+ */
+static int connect_with_timeout(int fd, const struct sockaddr *addr, socklen_t addr_size)
+{
+    const int flags = fcntl(fd, F_GETFL);
+    struct pollfd poll_fd;
+    int err = 0;
+    socklen_t err_size = sizeof(err);
+    int status;
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        return -1;
+    }
+    if (connect(fd, addr, addr_size) != 0) {
+        if (errno != EINPROGRESS) {
+            return -1;
+        }
+        poll_fd.fd = fd;
+        poll_fd.events = POLLOUT;
+        do {
+            status = poll(&poll_fd, 1, REMOTE_CONNECT_TIMEOUT * 1000);
+        } while (status == -1 && errno == EINTR);
+        if (status == 0) {
+            errno = ETIMEDOUT;
+        }
+        if (status <= 0) {
+            return -1;
+        }
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_size) != 0) {
+            return -1;
+        }
+        if (err != 0) {
+            errno = err;
+            return -1;
+        }
+    }
+    return fcntl(fd, F_SETFL, flags);
+}
+
+/*! Check whether the peer of a socket is on the same host.
+ *
+ *  \return
+ *      1 for Unix domain sockets and loopback addresses, 0 otherwise
+ *
+ *  \param fd
+ *      the connected socket
+ */
+static int socket_peer_is_local(int fd)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_size = sizeof(addr);
+    if (getpeername(fd, (struct sockaddr *)&addr, &addr_size) != 0) {
+        return 0;
+    }
+    if (addr.ss_family == AF_UNIX) {
+        return 1;
+    }
+    if (addr.ss_family == AF_INET) {
+        return (ntohl(((struct sockaddr_in *)&addr)->sin_addr.s_addr) >> 24) == 127;
+    }
+    if (addr.ss_family == AF_INET6) {
+        const struct in6_addr *addr6 = &((struct sockaddr_in6 *)&addr)->sin6_addr;
+        return IN6_IS_ADDR_LOOPBACK(addr6) || (IN6_IS_ADDR_V4MAPPED(addr6) && addr6->s6_addr[12] == 127);
+    }
+    return 0;
+}
+
+/*! Compare a received secret with the expected one,
+ *  in a time that doesn't depend on where they differ.
+ *
+ *  \return
+ *      1 if they are equal, 0 otherwise
+ *
+ *  \param secret
+ *      the received secret, not null-terminated
+ *
+ *  \param secret_size
+ *      size of \c secret
+ *
+ *  \param expected
+ *      the expected secret, see texcaller_options::worker_secret
+ */
+static int secret_matches(const char *secret, size_t secret_size, const char *expected)
+{
+    const size_t expected_size = strlen(expected);
+    unsigned char difference = secret_size == expected_size ? 0 : 1;
+    size_t i;
+    for (i = 0; i < secret_size; i++) {
+        difference |= (unsigned char)(secret[i] ^ expected[i < expected_size ? i : 0]);
+    }
+    return difference == 0;
+}
+
+/*! Send the response to a request of a remote client.
+ *
+ *  \return
+ *      0 on success, -1 on failure, with \c errno set
+ *
+ *  \param fd
+ *      the connected socket
+ *
+ *  \param result
+ *      the result, or \c NULL if the conversion failed
+ *
+ *  \param result_size
+ *      size of \c result
+ *
+ *  \param info
+ *      the info string, or \c NULL when out of memory
+ */
+static int remote_respond(int fd, const char *result, size_t result_size, const char *info)
+{
+    unsigned char header[REMOTE_RESPONSE_HEADER_SIZE];
+    const size_t info_size = info == NULL ? 0 : strlen(info);
+    unsigned long load;
+    pthread_mutex_lock(&scheduler_mutex);
+    load = scheduler_running + scheduler_queued;
+    pthread_mutex_unlock(&scheduler_mutex);
+    memcpy(header, REMOTE_MAGIC, 4);
+    put_uint32(header + 4, result == NULL ? 1 : 0);
+    put_uint32(header + 8, load);
+    put_uint32(header + 12, result_size);
+    put_uint32(header + 16, info_size);
+    if (   send_all(fd, (const char *)header, REMOTE_RESPONSE_HEADER_SIZE) != 0
+        || send_all(fd, result, result_size) != 0
+        || send_all(fd, info, info_size) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*! Send a conversion to a remote worker and receive its result.
+ *
+ *  \return
+ *      0 if the worker responded, even if the conversion failed,
+ *      -1 if the worker could not be reached
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param load
+ *      will be set to the queue depth reported by the worker
+ *
+ *  \param result
+ *      see texcaller_convert()
+ *
+ *  \param result_size
+ *      see texcaller_convert()
+ *
+ *  \param info
+ *      see texcaller_convert()
+ *
+ *  \param worker
+ *      the remote worker
+ *
+ *  \param job
+ *      the conversion
+ *
+ *  \param options
+ *      options of the conversion
+ */
+static int remote_convert(char **error, unsigned long *load, char **result, size_t *result_size, char **info, const remote_worker *worker, const texcaller_job *job, const texcaller_options *options)
+{
+    unsigned char header[REMOTE_REQUEST_HEADER_SIZE];
+    const size_t secret_size = options->worker_secret == NULL ? 0 : strlen(options->worker_secret);
+    const size_t tenant_size = options->tenant == NULL ? 0 : strlen(options->tenant);
+    size_t info_size;
+    int status = -1;
+    int fd;
+    *error = NULL;
+    fd = socket(worker->addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        *error = sprintf_alloc("Unable to create socket for remote worker \"%s\": %s.",
+                               worker->address, strerror(errno));
+        return -1;
+    }
+    if (connect_with_timeout(fd, (const struct sockaddr *)&worker->addr, worker->addr_size) != 0) {
+        *error = sprintf_alloc("Unable to connect to remote worker \"%s\": %s.",
+                               worker->address, strerror(errno));
+        goto cleanup;
+    }
+    if (worker->addr.ss_family != AF_UNIX) {
+        const int enabled = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enabled, sizeof(enabled));
+    }
+    set_socket_timeout(fd, options->worker_timeout);
+    /* send request */
+    memcpy(header, REMOTE_MAGIC, 4);
+    put_uint32(header + 4, job->source_format);
+    put_uint32(header + 8, job->result_format);
+    put_uint32(header + 12, job->max_runs);
+    put_uint32(header + 16, options->priority);
+    put_uint32(header + 20, options->tenant_weight);
+    put_uint32(header + 24, secret_size);
+    put_uint32(header + 28, tenant_size);
+    put_uint32(header + 32, job->source_size);
+    if (   send_all(fd, (const char *)header, REMOTE_REQUEST_HEADER_SIZE) != 0
+        || send_all(fd, options->worker_secret, secret_size) != 0
+        || send_all(fd, options->tenant, tenant_size) != 0
+        || send_all(fd, job->source, job->source_size) != 0) {
+        *error = sprintf_alloc("Unable to send request to remote worker \"%s\": %s.",
+                               worker->address, strerror(errno));
+        goto cleanup;
+    }
+    /* receive response */
+    if (recv_all(fd, (char *)header, REMOTE_RESPONSE_HEADER_SIZE) != 0) {
+        *error = sprintf_alloc("Unable to receive response from remote worker \"%s\": %s.",
+                               worker->address, strerror(errno));
+        goto cleanup;
+    }
+    if (memcmp(header, REMOTE_MAGIC, 4) != 0) {
+        *error = sprintf_alloc("Invalid response from remote worker \"%s\".",
+                               worker->address);
+        goto cleanup;
+    }
+    *load = get_uint32(header + 8);
+    *result_size = get_uint32(header + 12);
+    info_size = get_uint32(header + 16);
+    if (*result_size > REMOTE_MAX_RESULT_SIZE || info_size > REMOTE_MAX_INFO_SIZE) {
+        *result_size = 0;
+        *error = sprintf_alloc("Invalid response from remote worker \"%s\": result or info too large.",
+                               worker->address);
+        goto cleanup;
+    }
+    if (get_uint32(header + 4) == 0) {
+        *result = (char *)malloc(*result_size + 1);
+        if (*result == NULL) {
+            *result_size = 0;
+            status = 0;
+            goto cleanup;
+        }
+        if (recv_all(fd, *result, *result_size) != 0) {
+            *error = sprintf_alloc("Unable to receive result from remote worker \"%s\": %s.",
+                                   worker->address, strerror(errno));
+            goto cleanup;
+        }
+    } else {
+        *result_size = 0;
+    }
+    /* an empty info string means the worker was out of memory */
+    if (info_size > 0) {
+        *info = (char *)malloc(info_size + 1);
+        if (*info == NULL) {
+            free(*result);
+            *result = NULL;
+            *result_size = 0;
+            status = 0;
+            goto cleanup;
+        }
+        if (recv_all(fd, *info, info_size) != 0) {
+            *error = sprintf_alloc("Unable to receive info from remote worker \"%s\": %s.",
+                                   worker->address, strerror(errno));
+            goto cleanup;
+        }
+        (*info)[info_size] = '\0';
+    } else {
+        free(*result);
+        *result = NULL;
+        *result_size = 0;
+    }
+    status = 0;
+    goto cleanup;
+cleanup:
+    if (status != 0) {
+        free(*result);
+        *result = NULL;
+        *result_size = 0;
+        free(*info);
+        *info = NULL;
+    }
+    close(fd);
+    return status;
+}
+
+/*! Convert a TeX or LaTeX source on one of the remote workers.
+ *
+ *  If a worker can't be reached,
+ *  the conversion is retried on the next one,
+ *  until all workers have been tried.
+ *  Failed conversions are not retried,
+ *  because they would fail on any worker.
+ *
+ *  \param result
+ *      see texcaller_convert()
+ *
+ *  \param result_size
+ *      see texcaller_convert()
+ *
+ *  \param info
+ *      see texcaller_convert()
+ *
+ *  \param options
+ *      options of the conversion, with texcaller_options::workers set
+ *
+ *  \param workers
+ *      the remote workers of texcaller_options::workers,
+ *      or \c NULL to find them now
+ *
+ *  \param workers_count
+ *      number of elements in \c workers
+ *
+ *  \param job
+ *      the conversion
+ */
+static void convert_remotely(char **result, size_t *result_size, char **info, const texcaller_options *options, remote_worker **workers, int workers_count, const texcaller_job *job)
+{
+    remote_worker **found_workers = NULL;
+    char *tried = NULL;
+    char *error;
+    char *last_error = NULL;
+    int attempt;
+    if (job->source_size > 0xffffffffUL) {
+        *info = sprintf_alloc("Source of %lu bytes is too large for remote workers.",
+                              (unsigned long)job->source_size);
+        return;
+    }
+    if (   (options->tenant != NULL && strlen(options->tenant) > REMOTE_MAX_NAME_SIZE)
+        || (options->worker_secret != NULL && strlen(options->worker_secret) > REMOTE_MAX_NAME_SIZE)) {
+        *info = sprintf_alloc("Tenant and worker secret must not exceed %i bytes for remote workers.",
+                              REMOTE_MAX_NAME_SIZE);
+        return;
+    }
+    /* resolve the workers, unless the context did that in advance */
+    if (workers == NULL) {
+        if (remote_workers_find(&error, &found_workers, &workers_count, options->workers) != 0) {
+            *info = error;
+            return;
+        }
+        workers = found_workers;
+    }
+    tried = (char *)calloc(workers_count, 1);
+    if (tried == NULL) {
+        goto cleanup;
+    }
+    for (attempt = 0; attempt < workers_count; attempt++) {
+        const int i = remote_worker_choose(workers, workers_count, tried);
+        unsigned long load = 0;
+        const int status = remote_convert(&error, &load, result, result_size, info,
+                                          workers[i], job, options);
+        tried[i] = 1;
+        pthread_mutex_lock(&remote_mutex);
+        workers[i]->pending--;
+        if (status == 0) {
+            workers[i]->load = load;
+            workers[i]->failure_time = 0;
+        } else {
+            workers[i]->failure_time = monotonic_time();
+        }
+        pthread_mutex_unlock(&remote_mutex);
+        if (status != 0 && error != NULL) {
+            metrics_add(&metrics_shard_of_thread()->remote_failures, 1);
+        }
+        if (status == 0 || error == NULL) {
+            goto cleanup;
+        }
+        free(last_error);
+        last_error = error;
+    }
+    *info = sprintf_alloc("Unable to convert on any of %i remote workers. %s",
+                          workers_count, last_error);
+    goto cleanup;
+cleanup:
+    free(found_workers);
+    free(tried);
+    free(last_error);
+}
+
+/*! @} */
+
+/*! \name Font caches
+ *
+ *  LuaTeX builds the font name database of luaotfload,
+ *  and XeTeX the cache of fontconfig,
+ *  whenever they find them missing,
+ *  which may take minutes.
+ *  If texcaller_options::cache_dir is set,
+ *  these caches are kept in that directory
+ *  by setting \c TEXMFVAR, \c TEXMFCACHE and \c XDG_CACHE_HOME
+ *  for the TeX interpreter.
+ *
+ *  Conversions must not use a cache while it is being built.
+ *  Therefore, the cache directory contains a stamp file per command,
+ *  which is created after its first successful conversion.
+ *  Until then, conversions of that command lock the cache directory
+ *  exclusively, so only one of them builds the caches,
+ *  and the others wait for it.
+ *  Once the stamp file exists, conversions don't lock anything.
+ *
+ *  @{
+ */
+
+/*! Number of environment variables pointing into the cache directory. */
+#define CACHE_ENVIRONMENT_COUNT 3
+
+/*! Environment variables pointing into the cache directory,
+ *  including the \c = sign.
+ */
+static const char *const cache_environment_names[CACHE_ENVIRONMENT_COUNT] = {
+    "TEXMFVAR=",
+    "TEXMFCACHE=",
+    "XDG_CACHE_HOME="
+};
+
+/*! Subdirectories of the cache directory,
+ *  corresponding to \c cache_environment_names.
+ */
+static const char *const cache_environment_subdirs[CACHE_ENVIRONMENT_COUNT] = {
+    "/texmf-var",
+    "/texmf-var",
+    ""
+};
+
+/*! Environment variable that prevents the TeX interpreter
+ *  from wrapping lines of its terminal output,
+ *  so the profiler sees complete file names.
+ */
+#define PROFILE_ENVIRONMENT "max_print_line=1000000"
+
+/*! Create the environment of TeX interpreters.
+ *
+ *  \return
+ *      the environment of the calling process,
+ *      with all \c cache_environment_names pointing into \c cache_dir
+ *      and \c PROFILE_ENVIRONMENT if requested,
+ *      as a single newly allocated block,
+ *      or \c NULL when out of memory
+ *
+ *  \param cache_dir
+ *      the cache directory, or \c NULL
+ *
+ *  \param profile
+ *      whether to add \c PROFILE_ENVIRONMENT
+ */
+static char **child_environment(const char *cache_dir, int profile)
+{
+    const size_t variable_size = (cache_dir == NULL ? 0 : strlen(cache_dir)) + sizeof("XDG_CACHE_HOME=/texmf-var");
+    const int cache_count = cache_dir == NULL ? 0 : CACHE_ENVIRONMENT_COUNT;
+    size_t environ_count;
+    size_t count;
+    size_t i;
+    int j;
+    char **envp;
+    char *p;
+    for (environ_count = 0; environ[environ_count] != NULL; environ_count++) {
+    }
+    envp = (char **)malloc((environ_count + CACHE_ENVIRONMENT_COUNT + 2) * sizeof(char *)
+                           + CACHE_ENVIRONMENT_COUNT * variable_size);
+    if (envp == NULL) {
+        return NULL;
+    }
+    count = 0;
+    for (i = 0; i < environ_count; i++) {
+        for (j = 0; j < cache_count; j++) {
+            const char *name = cache_environment_names[j];
+            if (strncmp(environ[i], name, strlen(name)) == 0) {
+                break;
+            }
+        }
+        if (j == cache_count && !(profile && strncmp(environ[i], "max_print_line=", 15) == 0)) {
+            envp[count++] = environ[i];
+        }
+    }
+    p = (char *)(envp + environ_count + CACHE_ENVIRONMENT_COUNT + 2);
+    for (j = 0; j < cache_count; j++) {
+        envp[count++] = p;
+        p += sprintf(p, "%s%s%s", cache_environment_names[j], cache_dir, cache_environment_subdirs[j]) + 1;
+    }
+    if (profile) {
+        envp[count++] = (char *)PROFILE_ENVIRONMENT;
+    }
+    envp[count] = NULL;
+    return envp;
+}
+
+/*! Lock the cache directory if the caches of a TeX interpreter are cold.
+ *
+ *  The caches are cold if no conversion of \c cmd succeeded yet.
+ *  In that case, the cache directory is locked exclusively,
+ *  and the caller has to create the stamp file
+ *  after a successful conversion, before releasing the lock.
+ *  Otherwise, nothing is locked.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param lock_fd
+ *      will be set to the file descriptor holding the lock,
+ *      to be closed by the caller,
+ *      or -1 if the caches are warm
+ *
+ *  \param stamp_filename
+ *      will be set to the newly allocated file name of the stamp file
+ *      if the caches are cold, and to \c NULL otherwise
+ *
+ *  \param cache_dir
+ *      the cache directory
+ *
+ *  \param cmd
+ *      the TeX interpreter
+ */
+static int cache_lock(char **error, int *lock_fd, char **stamp_filename, const char *cache_dir, const char *cmd)
+{
+    char *lock_filename = NULL;
+    char *texmf_var = NULL;
+    int fd = -1;
+    *error = NULL;
+    *lock_fd = -1;
+    *stamp_filename = sprintf_alloc("%s/%s.warm", cache_dir, cmd);
+    if (*stamp_filename == NULL) {
+        goto error;
+    }
+    if (access(*stamp_filename, F_OK) == 0) {
+        goto warm;
+    }
+    lock_filename = sprintf_alloc("%s/texcaller.lock", cache_dir);
+    if (lock_filename == NULL) {
+        goto error;
+    }
+    fd = open(lock_filename, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        *error = sprintf_alloc("Unable to open lock file \"%s\": %s.",
+                               lock_filename, strerror(errno));
+        goto error;
+    }
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            *error = sprintf_alloc("Unable to lock file \"%s\": %s.",
+                                   lock_filename, strerror(errno));
+            goto error;
+        }
+    }
+    /* another conversion may have built the caches while waiting */
+    if (access(*stamp_filename, F_OK) == 0) {
+        close(fd);
+        goto warm;
+    }
+    texmf_var = sprintf_alloc("%s/texmf-var", cache_dir);
+    if (texmf_var == NULL) {
+        goto error;
+    }
+    mkdir(texmf_var, 0777);
+    free(texmf_var);
+    free(lock_filename);
+    *lock_fd = fd;
+    return 0;
+warm:
+    free(lock_filename);
+    free(*stamp_filename);
+    *stamp_filename = NULL;
+    return 0;
+error:
+    if (fd != -1) {
+        close(fd);
+    }
+    free(lock_filename);
+    free(*stamp_filename);
+    *stamp_filename = NULL;
+    return -1;
+}
+
+/*! Documents converted by texcaller_warm_up(),
+ *  indexed by \c texcaller_source_format.
+ *  Loading \c fontspec makes XeTeX and LuaTeX look up fonts by name,
+ *  which builds the font caches.
+ */
+static const char *const warm_up_sources[SOURCE_FORMATS_COUNT] = {
+    "x\\bye",
+    "\\documentclass{article}\\begin{document}x\\end{document}",
+    "x\\bye",
+    "\\documentclass{article}\\usepackage{fontspec}\\begin{document}x\\end{document}",
+    "x\\bye",
+    "\\documentclass{article}\\usepackage{fontspec}\\begin{document}x\\end{document}"
+};
+
+/*! @} */
+
+/*! \name Profiler
+ *
+ *  If texcaller_options::profile is set,
+ *  the TeX interpreter runs in \c nonstopmode,
+ *  so it reports on stdout each file it reads,
+ *  such as <tt>(/path/to/article.cls</tt> ... <tt>)</tt>
+ *  for classes, packages and other TeX files,
+ *  <tt>{/path/to/pdftex.map}</tt> for font maps and encodings,
+ *  and <tt>\</path/to/cmr10.pfb\></tt> for embedded fonts.
+ *  The profiler reads this output while the TeX interpreter runs,
+ *  and attributes the time between opening and closing a file
+ *  to that file, excluding the files it opened in turn.
+ *  The document body starts when the \c .aux file is read
+ *  by <tt>\\begin{document}</tt>.
+ *
+ *  Timestamps are taken when the output is read,
+ *  so they are only as precise as the TeX interpreter
+ *  flushes its terminal output,
+ *  which it does after each file name.
+ *  Parentheses within other messages are tracked as well,
+ *  to keep the nesting of files intact.
+ *
+ *  @{
+ */
+
+/*! Maximum nesting depth of tracked files and parentheses. */
+#define PROFILE_STACK_SIZE 256
+
+/*! Maximum length of a tracked file name. */
+#define PROFILE_NAME_SIZE 1024
+
+/*! Number of files in the report. */
+#define PROFILE_REPORT_SIZE 20
+
+/*! Time spent on a file, summed over all TeX runs.
+ */
+typedef struct profile_file
+{
+    /*! the file name as reported by the TeX interpreter */
+    char *name;
+    /*! seconds spent on the file, excluding the files it opened */
+    double time;
+    /*! number of times the file was read */
+    int loads;
+} profile_file;
+
+/*! An open file or parenthesis.
+ */
+typedef struct profile_frame
+{
+    /*! the character that closes this frame */
+    char closer;
+    /*! index of the file within \c profile::files, or -1 for a parenthesis */
+    int file;
+    /*! time the file was opened */
+    double start_time;
+    /*! seconds spent on files opened by this file */
+    double children_time;
+} profile_frame;
+
+/*! State of the profiler of a conversion.
+ */
+typedef struct profile
+{
+    /*! all files read so far */
+    profile_file *files;
+    /*! number of elements in \c files */
+    int files_count;
+    /*! allocated number of elements in \c files */
+    int files_capacity;
+    /*! open files and parentheses */
+    profile_frame stack[PROFILE_STACK_SIZE];
+    /*! number of elements in \c stack */
+    int depth;
+    /*! file name being read, or the empty string */
+    char name[PROFILE_NAME_SIZE];
+    /*! length of \c name */
+    size_t name_size;
+    /*! the character before \c name, or \c '\\0' if no name is being read */
+    char opener;
+    /*! time the current TeX run started */
+    double run_start_time;
+    /*! time the document body of the current TeX run started, or -1 */
+    double body_start_time;
+    /*! duration of each TeX run */
+    double *run_times;
+    /*! duration of the document body of each TeX run, or -1 if unknown */
+    double *body_times;
+    /*! number of finished TeX runs */
+    int runs;
+    /*! number of elements in \c run_times and \c body_times */
+    int max_runs;
+} profile;
+
+/*! Create a profiler.
+ *
+ *  \return
+ *      the new profiler, to be freed via profile_destroy(),
+ *      or \c NULL when out of memory
+ *
+ *  \param max_runs
+ *      maximum number of TeX runs to profile
+ */
+static profile *profile_create(int max_runs)
+{
+    profile *p = (profile *)malloc(sizeof(profile));
+    if (p == NULL) {
+        return NULL;
+    }
+    memset(p, 0, sizeof(profile));
+    p->max_runs = max_runs;
+    p->run_times = (double *)malloc(max_runs * sizeof(double));
+    p->body_times = (double *)malloc(max_runs * sizeof(double));
+    if (p->run_times == NULL || p->body_times == NULL) {
+        free(p->run_times);
+        free(p->body_times);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+/*! Destroy a profiler created by profile_create().
+ *
+ *  \param p
+ *      the profiler, or \c NULL
+ */
+static void profile_destroy(profile *p)
+{
+    int i;
+    if (p == NULL) {
+        return;
+    }
+    for (i = 0; i < p->files_count; i++) {
+        free(p->files[i].name);
+    }
+    free(p->files);
+    free(p->run_times);
+    free(p->body_times);
+    free(p);
+}
+
+/*! Notify the profiler that a TeX run has started.
+ *
+ *  \param p
+ *      the profiler
+ *
+ *  \param now
+ *      the current time, according to monotonic_time()
+ */
+static void profile_begin_run(profile *p, double now)
+{
+    p->depth = 0;
+    p->opener = '\0';
+    p->name_size = 0;
+    p->run_start_time = now;
+    p->body_start_time = -1;
+}
+
+/*! Find or add a file.
+ *
+ *  \return
+ *      index of the file within \c p->files,
+ *      or -1 when out of memory
+ *
+ *  \param p
+ *      the profiler
+ *
+ *  \param name
+ *      the file name
+ */
+static int profile_find_file(profile *p, const char *name)
+{
+    int i;
+    for (i = 0; i < p->files_count; i++) {
+        if (strcmp(p->files[i].name, name) == 0) {
+            return i;
+        }
+    }
+    if (p->files_count == p->files_capacity) {
+        const int capacity = p->files_capacity == 0 ? 64 : 2 * p->files_capacity;
+        profile_file *files = (profile_file *)realloc(p->files, capacity * sizeof(profile_file));
+        if (files == NULL) {
+            return -1;
+        }
+        p->files = files;
+        p->files_capacity = capacity;
+    }
+    p->files[i].name = sprintf_alloc("%s", name);
+    if (p->files[i].name == NULL) {
+        return -1;
+    }
+    p->files[i].time = 0;
+    p->files[i].loads = 0;
+    p->files_count++;
+    return i;
+}
+
+/*! Close the innermost file or parenthesis.
+ *
+ *  \param p
+ *      the profiler
+ *
+ *  \param now
+ *      the current time, according to monotonic_time()
+ */
+static void profile_pop(profile *p, double now)
+{
+    const profile_frame *frame = &p->stack[--p->depth];
+    if (frame->file != -1) {
+        const double time = now - frame->start_time;
+        int i;
+        p->files[frame->file].time += time - frame->children_time;
+        /* attribute the time to the enclosing file */
+        for (i = p->depth - 1; i >= 0; i--) {
+            if (p->stack[i].file != -1) {
+                p->stack[i].children_time += time;
+                break;
+            }
+        }
+    }
+}
+
+/*! Finish the file name being read, if any.
+ *
+ *  \param p
+ *      the profiler
+ *
+ *  \param now
+ *      the current time, according to monotonic_time()
+ */
+static void profile_end_name(profile *p, double now)
+{
+    static const char aux_suffix[] = "texput.aux";
+    const char opener = p->opener;
+    int file = -1;
+    if (opener == '\0') {
+        return;
+    }
+    p->opener = '\0';
+    p->name[p->name_size] = '\0';
+    /* file names are reported as paths */
+    if (p->name_size > 1 && (p->name[0] == '/' || p->name[0] == '.')) {
+        file = profile_find_file(p, p->name);
+        if (   p->body_start_time < 0
+            && p->name_size >= sizeof(aux_suffix) - 1
+            && strcmp(p->name + p->name_size - (sizeof(aux_suffix) - 1), aux_suffix) == 0) {
+            p->body_start_time = now;
+        }
+    }
+    p->name_size = 0;
+    /* other brackets and braces are too common to be tracked */
+    if ((file == -1 && opener != '(') || p->depth == PROFILE_STACK_SIZE) {
+        return;
+    }
+    if (file != -1) {
+        p->files[file].loads++;
+    }
+    p->stack[p->depth].closer = opener == '(' ? ')' : opener == '<' ? '>' : '}';
+    p->stack[p->depth].file = file;
+    p->stack[p->depth].start_time = now;
+    p->stack[p->depth].children_time = 0;
+    p->depth++;
+}
+
+/*! Feed output of the TeX interpreter into the profiler.
+ *
+ *  \param p
+ *      the profiler
+ *
+ *  \param data
+ *      the output
+ *
+ *  \param size
+ *      size of \c data
+ *
+ *  \param now
+ *      the current time, according to monotonic_time()
+ */
+static void profile_feed(profile *p, const char *data, size_t size, double now)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        const char c = data[i];
+        if (p->opener != '\0') {
+            if (!(c == ' ' || c == '\n' || c == '\r' || c == '\t' || strchr("()<>{}", c) != NULL)) {
+                if (p->name_size < PROFILE_NAME_SIZE - 1) {
+                    p->name[p->name_size++] = c;
+                }
+                continue;
+            }
+            profile_end_name(p, now);
+        }
+        if (c == '(' || c == '<' || c == '{') {
+            p->opener = c;
+        } else if (p->depth > 0 && c == p->stack[p->depth - 1].closer) {
+            profile_pop(p, now);
+        }
+    }
+}
+
+/*! Notify the profiler that a TeX run has finished.
+ *
+ *  \param p
+ *      the profiler
+ *
+ *  \param now
+ *      the current time, according to monotonic_time()
+ */
+static void profile_end_run(profile *p, double now)
+{
+    profile_end_name(p, now);
+    while (p->depth > 0) {
+        profile_pop(p, now);
+    }
+    if (p->runs < p->max_runs) {
+        p->run_times[p->runs] = now - p->run_start_time;
+        p->body_times[p->runs] = p->body_start_time < 0 ? -1 : now - p->body_start_time;
+        p->runs++;
+    }
+}
+
+/*! Compare files by descending time, for \c qsort().
+ */
+static int profile_compare_files(const void *a, const void *b)
+{
+    const double time_a = ((const profile_file *)a)->time;
+    const double time_b = ((const profile_file *)b)->time;
+    return time_a < time_b ? 1 : time_a > time_b ? -1 : 0;
+}
+
+/*! Append the report of the profiler to a string.
+ *
+ *  The files are sorted by their time,
+ *  which changes the order of \c p->files.
+ *
+ *  \return
+ *      see append_alloc()
+ *
+ *  \param s
+ *      see append_alloc()
+ *
+ *  \param p
+ *      the profiler
+ */
+static char *profile_report(char *s, profile *p)
+{
+    int i;
+    qsort(p->files, p->files_count, sizeof(profile_file), profile_compare_files);
+    s = append_alloc(s, "\n\nProfile of %i runs, by time spent per file,"
+                        " excluding the files it read:\n", p->runs);
+    for (i = 0; i < p->files_count && i < PROFILE_REPORT_SIZE; i++) {
+        const char *name = strrchr(p->files[i].name, '/');
+        s = append_alloc(s, "%8.3f s  %s (read %i times)\n",
+                         p->files[i].time, name == NULL ? p->files[i].name : name + 1, p->files[i].loads);
+    }
+    if (p->files_count > PROFILE_REPORT_SIZE) {
+        s = append_alloc(s, "          and %i more files\n", p->files_count - PROFILE_REPORT_SIZE);
+    }
+    for (i = 0; i < p->runs; i++) {
+        s = append_alloc(s, "Run %i took %.3f s", i + 1, p->run_times[i]);
+        if (p->body_times[i] >= 0) {
+            s = append_alloc(s, ", of which %.3f s in the preamble and %.3f s in the document body",
+                             p->run_times[i] - p->body_times[i], p->body_times[i]);
+        }
+        s = append_alloc(s, ".\n");
+    }
+    return s;
+}
+
+/*! @} */
+
+/*! Settings shared by multiple conversions,
+ *  see texcaller_context_create().
+ */
+struct texcaller_context
+{
+    /*! Options of all conversions, without additional outputs. */
+    texcaller_options options;
+
+    /*! Directory containing the temporary directories. */
+    const char *tmpdir;
+
+    /*! Whether \c executables have been resolved in advance. */
+    int resolved;
+
+    /*! Full paths of the TeX interpreters,
+     *  indexed like \c engine_commands,
+     *  or \c NULL if not installed.
+     */
+    char *executables[SOURCE_FORMATS_COUNT][RESULT_FORMATS_COUNT];
+
+    /*! Remote workers of texcaller_options::workers,
+     *  or \c NULL if not resolved in advance.
+     */
+    remote_worker **workers;
+
+    /*! Number of elements in \c workers. */
+    int workers_count;
+};
+
+/*! Log line of a preview that was stopped early,
+ *  see texcaller_options::preview_pages.
+ */
+#define PREVIEW_TRUNCATED "texcaller: truncated preview"
+
+/*! First line of the TeX interpreter in preview mode,
+ *  with the number of pages as \c %i.
+ *
+ *  It appends a check to the output routine,
+ *  which counts the pages that have actually been shipped out,
+ *  as a shipout resets \c \\deadcycles.
+ *  After the last page,
+ *  the check replaces the output routine by one that discards all pages,
+ *  and ends the job via the primitive \c \\end
+ *  (\c \\\@\@end in LaTeX) right after the output routine,
+ *  which is the earliest point where \c \\end is allowed.
+ *  This works the same for all formats,
+ *  without relying on shipout hooks of LaTeX.
+ *  The job name is still \c texput,
+ *  as it is taken from the first input file.
+ */
+#define PREVIEW_COMMAND \
+    "\\newcount\\texcallerpreviewpages" \
+    "\\expandafter\\ifx\\csname @@end\\endcsname\\relax\\let\\texcallerpreviewend\\end" \
+    "\\else\\expandafter\\let\\expandafter\\texcallerpreviewend\\csname @@end\\endcsname\\fi" \
+    "\\def\\texcallerpreviewcheck{\\ifnum\\deadcycles=0 \\global\\advance\\texcallerpreviewpages 1 " \
+    "\\ifnum\\texcallerpreviewpages<%i \\else\\immediate\\write-1{" PREVIEW_TRUNCATED "}" \
+    "\\global\\output{\\setbox0\\box255 \\deadcycles0 }\\aftergroup\\texcallerpreviewend\\fi\\fi}" \
+    "\\output\\expandafter{\\the\\output\\texcallerpreviewcheck}" \
+    "\\input texput.tex"
+
+/*! A conversion in progress,
+ *  see texcaller_context_convert() and texcaller_conversion_start().
+ */
+struct texcaller_conversion
+{
+    /*! The conversion. */
+    texcaller_job job;
+
+    /*! Whether the TeX interpreter is watched via \c fd
+     *  instead of waiting for it.
+     */
+    int async;
+
+    /*! The TeX interpreter. */
+    const char *cmd;
+
+    /*! Full path of \c cmd, or \c NULL to search it in \c PATH. */
+    const char *executable;
+
+    /*! Command line of the TeX interpreter. */
+    char *argv[9];
+
+    /*! Index of the draft mode flag within \c argv,
+     *  or -1 if draft mode is disabled.
+     */
+    int draft_arg;
+
+    /*! Whether the current TeX run is in draft mode. */
+    int draft;
+
+    /*! Number of TeX runs in draft mode so far. */
+    int draft_runs;
+
+    /*! See texcaller_options::preview_pages. */
+    int preview_pages;
+
+    /*! First line of the TeX interpreter in preview mode,
+     *  see \c PREVIEW_COMMAND, or \c NULL.
+     */
+    char *preview_command;
+
+    /*! Whether to stop after the first TeX run in preview mode. */
+    int preview_single_run;
+
+    /*! Whether the preview has been stopped early. */
+    int truncated;
+
+    /*! Environment of the TeX interpreter,
+     *  see child_environment(),
+     *  or \c NULL for the environment of the calling process.
+     */
+    char **envp;
+
+    /*! Whether texcaller_options::cache_dir is used. */
+    int caches;
+
+    /*! Lock of texcaller_options::cache_dir, see cache_lock(), or -1. */
+    int cache_lock_fd;
+
+    /*! Stamp file to create after success if the caches are cold, or \c NULL. */
+    char *cache_stamp_filename;
+
+    /*! The profiler, or \c NULL if texcaller_options::profile is disabled. */
+    profile *profile;
+
+    /*! The temporary directory, or \c NULL if not created yet. */
+    char *dir;
+
+    /*! Buffer of \c dir. */
+    char *dir_template;
+
+    /*! Lock of \c dir, see lock_workspace(), or -1. */
+    int dir_lock_fd;
+
+    /*! Size of the source before decoding texcaller_job::source_codec,
+     *  whereas \c job holds the decoded size.
+     */
+    size_t encoded_source_size;
+
+    /*! Buffer of all file names within \c dir. */
+    char *filenames;
+
+    /*! The \c .aux file within \c dir. */
+    const char *aux_filename;
+
+    /*! The result file within \c dir. */
+    const char *result_filename;
+
+    /*! The \c .fls file within \c dir. */
+    const char *fls_filename;
+
+    /*! The \c .log file within \c dir, or \c NULL if \c dir wasn't created. */
+    const char *log_filename;
+
+    /*! See texcaller_options::prefetch_dir. */
+    char *prefetch_list_filename;
+
+    /*! Content of \c prefetch_list_filename, or \c NULL. */
+    char *prefetch_list;
+
+    /*! Number of prefetched files, or -1 if prefetching is disabled. */
+    int prefetched;
+
+    /*! Bytes of the prefetched files that were not in the page cache yet. */
+    unsigned long prefetched_uncached;
+
+    /*! Number of prefetched files read by the TeX interpreter,
+     *  or -1 if unknown.
+     */
+    int prefetch_hits;
+
+    /*! See texcaller_options::seed_dir. */
+    char *seed_prefix;
+
+    /*! Whether the auxiliary files have been seeded. */
+    int seeded;
+
+    /*! Content of the \c .aux file after the last run. */
+    char *aux;
+
+    /*! Size of \c aux. */
+    size_t aux_size;
+
+    /*! Whether \c dir is cleaned up by the workspace manager. */
+    int deferred_cleanup;
+
+    /*! Whether scheduler_release() has to be called. */
+    int scheduled;
+
+    /*! The asynchronous conversion waiting for the scheduler,
+     *  see scheduler_acquire_async(), or \c NULL.
+     */
+    scheduler_job *scheduler_job;
+
+    /*! Seconds spent waiting for the scheduler. */
+    double queue_time;
+
+    /*! Time the conversion started, according to monotonic_time(). */
+    double start_time;
+
+    /*! Number of TeX runs started so far. */
+    int runs;
+
+    /*! Jobserver token held by the current TeX run. */
+    jobserver_token jobserver_token;
+
+    /*! Whether the asynchronous conversion waits for the scheduler
+     *  or a jobserver token, in which case \c fd signals when to try again.
+     */
+    int awaiting_token;
+
+    /*! Time the conversion started waiting for the scheduler
+     *  or a jobserver token, according to monotonic_time().
+     */
+    double token_wait_start_time;
+
+    /*! Process ID of the running TeX interpreter, or -1. */
+    pid_t pid;
+
+    /*! Read end of the TeX interpreter's stdout, or -1. */
+    int fd;
+
+    /*! Whether the conversion has finished. */
+    int finished;
+
+    /*! See texcaller_convert(). */
+    char *result;
+
+    /*! See texcaller_convert(). */
+    size_t result_size;
+
+    /*! See texcaller_convert(). */
+    char *info;
+};
+
+/*! Initialize a context for a single conversion.
+ *
+ *  Unlike texcaller_context_create(),
+ *  this doesn't allocate anything,
+ *  so the interpreter and the remote workers
+ *  are searched during the conversion.
+ *
+ *  \param context
+ *      the context to initialize
+ *
+ *  \param options
+ *      options of the conversion, or \c NULL for the default values.
+ *      The strings are not copied.
+ */
+static void context_init_temporary(texcaller_context *context, const texcaller_options *options)
+{
+    if (options == NULL) {
+        texcaller_options_init(&context->options);
+    } else {
+        context->options = *options;
+    }
+    context->options.outputs = NULL;
+    context->options.outputs_count = 0;
+    context->options.parts = NULL;
+    context->options.parts_count = 0;
+    pthread_once(&environment_once, environment_init);
+    context->tmpdir = environment_tmpdir;
+    context->resolved = 0;
+    context->workers = NULL;
+    context->workers_count = 0;
+}
+
+/*! Finish a conversion with an error.
+ *
+ *  \param conversion
+ *      the conversion
+ *
+ *  \param error
+ *      the error message, to be freed by the conversion,
+ *      or \c NULL when out of memory
+ */
+static void conversion_fail(texcaller_conversion *conversion, char *error)
+{
+    conversion->info = error;
+    conversion->finished = 1;
+}
+
+/*! Start the next TeX run of a conversion.
+ *
+ *  If the conversion is asynchronous or profiled,
+ *  the TeX interpreter's stdout is connected to a pipe,
+ *  which reaches end of file when the TeX interpreter exits.
+ *
+ *  \param conversion
+ *      the conversion
+ */
+static void conversion_spawn(texcaller_conversion *conversion)
+{
+    char *error;
+    int fds[2] = {-1, -1};
+    int wait_fd = -1;
+    double wait_time;
+    if (!conversion->awaiting_token) {
+        conversion->token_wait_start_time = monotonic_time();
+    }
+    /* asynchronous conversions must not block,
+       and wait for the scheduler before their first run */
+    if (conversion->scheduler_job != NULL) {
+        if (scheduler_try_start(&error, &wait_fd, conversion->scheduler_job) != 0) {
+            conversion->awaiting_token = 0;
+            conversion_fail(conversion, error);
+            return;
+        }
+        conversion->awaiting_token = wait_fd != -1;
+        if (conversion->awaiting_token) {
+            conversion->fd = wait_fd;
+            return;
+        }
+        conversion->scheduler_job = NULL;
+        conversion->scheduled = 1;
+    }
+    if (jobserver_acquire(&error, &conversion->jobserver_token, conversion->async ? &wait_fd : NULL) != 0) {
+        conversion->awaiting_token = 0;
+        conversion_fail(conversion, error);
+        return;
+    }
+    conversion->awaiting_token = wait_fd != -1;
+    if (conversion->awaiting_token) {
+        conversion->fd = wait_fd;
+        return;
+    }
+    wait_time = monotonic_time() - conversion->token_wait_start_time;
+    conversion->queue_time += wait_time;
+    conversion->start_time += wait_time;
+    if (conversion->async || conversion->profile != NULL) {
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            conversion_fail(conversion, sprintf_alloc("Unable to create pipe: %s.",
+                                                      strerror(errno)));
+            return;
+        }
+        if (conversion->async) {
+            fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        }
+    }
+    if (spawn_command(&error, &conversion->pid, conversion->dir, conversion->executable,
+                      fds[1], conversion->argv, conversion->envp) != 0) {
+        conversion->pid = -1;
+        jobserver_release(&conversion->jobserver_token);
+        if (fds[0] != -1) {
+            close(fds[0]);
+            close(fds[1]);
+        }
+        conversion_fail(conversion, error);
+        return;
+    }
+    if (fds[1] != -1) {
+        close(fds[1]);
+    }
+    conversion->fd = fds[0];
+    conversion->runs++;
+    if (conversion->draft) {
+        conversion->draft_runs++;
+    }
+    if (conversion->profile != NULL) {
+        profile_begin_run(conversion->profile, monotonic_time());
+    }
+}
+
+/*! Read the TeX interpreter's stdout until end of file.
+ *
+ *  The output is fed into the profiler, if any,
+ *  and discarded otherwise.
+ *
+ *  \return
+ *      1 if end of file was reached, so \c conversion->fd is closed,
+ *      or 0 if the nonblocking \c conversion->fd has no more data yet
+ *
+ *  \param conversion
+ *      the conversion, whose \c fd isn't -1
+ */
+static int conversion_read(texcaller_conversion *conversion)
+{
+    char buffer[4096];
+    ssize_t size;
+    for (;;) {
+        size = read(conversion->fd, buffer, sizeof(buffer));
+        if (size > 0) {
+            if (conversion->profile != NULL) {
+                profile_feed(conversion->profile, buffer, (size_t)size, monotonic_time());
+            }
+        } else if (!(size == -1 && errno == EINTR)) {
+            break;
+        }
+    }
+    if (size == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    close(conversion->fd);
+    conversion->fd = -1;
+    if (conversion->profile != NULL) {
+        profile_end_run(conversion->profile, monotonic_time());
+    }
+    return 1;
+}
+
+/*! Read the \c .aux files of the main document and of all parts.
+ *
+ *  Missing files are tolerated.
+ *
+ *  \param aux
+ *      will be set to a newly allocated buffer
+ *      that contains all \c .aux files,
+ *      or \c NULL if there are none
+ *
+ *  \param aux_size
+ *      will be set to the size of \c aux
+ *
+ *  \param conversion
+ *      the conversion
+ */
+static void read_aux_files(char **aux, size_t *aux_size, const texcaller_conversion *conversion)
+{
+    const texcaller_job *job = &conversion->job;
+    char *error;
+    int i;
+    read_file(aux, aux_size, &error, conversion->aux_filename);
+    free(error);
+    for (i = 0; i < job->parts_count; i++) {
+        char *filename = sprintf_alloc("%s/%s.aux", conversion->dir, job->parts[i].name);
+        char *part_aux = NULL;
+        size_t part_aux_size = 0;
+        char *new_aux;
+        if (filename != NULL) {
+            read_file(&part_aux, &part_aux_size, &error, filename);
+            free(error);
+            free(filename);
+        }
+        if (part_aux == NULL) {
+            continue;
+        }
+        new_aux = (char *)realloc(*aux, *aux_size + part_aux_size);
+        if (new_aux != NULL) {
+            memcpy(new_aux + *aux_size, part_aux, part_aux_size);
+            *aux = new_aux;
+            *aux_size += part_aux_size;
+        }
+        free(part_aux);
+    }
+}
+
+/*! Wait for the TeX interpreter of a conversion to exit.
+ *
+ *  \return
+ *      0 on success,
+ *      or -1 if the TeX interpreter failed,
+ *      in which case the conversion has failed
+ *
+ *  \param conversion
+ *      the conversion, whose stdout has been read until end of file
+ */
+static int conversion_wait(texcaller_conversion *conversion)
+{
+    char *error;
+    const int status = wait_command(&error, conversion->pid, conversion->cmd);
+    conversion->pid = -1;
+    jobserver_release(&conversion->jobserver_token);
+    if (status != 0) {
+        conversion_fail(conversion, error);
+        return -1;
+    }
+    return 0;
+}
+
+/*! Continue a conversion after the TeX interpreter exited.
+ *
+ *  That is, either finish the conversion
+ *  or start the next TeX run.
+ *
+ *  \param conversion
+ *      the conversion, whose TeX interpreter exited
+ */
+static void conversion_continue(texcaller_conversion *conversion)
+{
+    const texcaller_job *job = &conversion->job;
+    char *error;
+    char *aux_old;
+    size_t aux_old_size;
+    int stable;
+    if (conversion_wait(conversion) != 0) {
+        return;
+    }
+    /* read new aux files, saving old ones */
+    aux_old      = conversion->aux;
+    aux_old_size = conversion->aux_size;
+    read_aux_files(&conversion->aux, &conversion->aux_size, conversion);
+    /* check whether aux files stabilized,
+       which is also true if there aren't and weren't any aux files */
+    stable = conversion->aux_size == aux_old_size && memcmp(conversion->aux, aux_old, aux_old_size) == 0;
+    free(aux_old);
+    if (conversion->preview_single_run) {
+        stable = 1;
+    }
+    if (stable && conversion->draft) {
+        /* drop the draft mode flag for a final run
+           that generates the result from the stabilized aux file */
+        conversion->argv[conversion->draft_arg] = (char *)"texput.tex";
+        conversion->argv[conversion->draft_arg + 1] = NULL;
+        conversion->draft = 0;
+        conversion_spawn(conversion);
+        return;
+    }
+    if (!stable) {
+        if (conversion->runs < job->max_runs) {
+            conversion_spawn(conversion);
+        } else {
+            conversion_fail(conversion, sprintf_alloc("Output didn't stabilize after %i runs.",
+                                                      job->max_runs));
+        }
+        return;
+    }
+    conversion->finished = 1;
+    if (conversion->preview_command != NULL) {
+        char *log;
+        size_t log_size;
+        read_file(&log, &log_size, &error, conversion->log_filename);
+        free(error);
+        if (log != NULL) {
+            conversion->truncated = find_string(log, log_size, PREVIEW_TRUNCATED) != NULL;
+            free(log);
+        }
+        if (conversion->truncated) {
+            metrics_add(&metrics_shard_of_thread()->truncated_previews, 1);
+        }
+    }
+    if (job->result_codec != TEXCALLER_IDENTITY) {
+        char *filename = sprintf_alloc("%s%s", conversion->result_filename, codec_extensions[job->result_codec]);
+        if (filename == NULL) {
+            return;
+        }
+        if (run_codec(&error, conversion->dir, (int)job->result_codec, 0,
+                      conversion->result_filename, filename) == 0) {
+            read_file(&conversion->result, &conversion->result_size, &error, filename);
+        }
+        free(filename);
+    } else {
+        read_file(&conversion->result, &conversion->result_size, &error, conversion->result_filename);
+    }
+    if (conversion->result == NULL) {
+        conversion->info = error;
+        return;
+    }
+    if (job->outputs_count > 0
+        && convert_outputs(&error, job->outputs, job->outputs_count,
+                           conversion->dir, result_format_names[job->result_format]) != 0) {
+        free(conversion->result);
+        conversion->result = NULL;
+        conversion->result_size = 0;
+        conversion->info = error;
+        return;
+    }
+    if (conversion->cache_stamp_filename != NULL) {
+        /* tolerate failure, which just keeps the caches cold */
+        if (write_file(&error, conversion->cache_stamp_filename, "", 0) != 0) {
+            free(error);
+        }
+    }
+    /* a truncated preview hasn't read and referenced everything */
+    if (conversion->prefetch_list_filename != NULL && !conversion->truncated) {
+        conversion->prefetch_hits = update_prefetch_list(conversion->prefetch_list_filename,
+                                                         conversion->prefetch_list,
+                                                         conversion->fls_filename);
+    }
+    /* the seed is unchanged if it stabilized right away,
+       not counting the final run after draft mode */
+    if (conversion->seed_prefix != NULL && !conversion->truncated
+        && !(conversion->seeded && conversion->runs - (conversion->draft_runs > 0) == 1)) {
+        store_seed(conversion->seed_prefix, conversion->dir);
+    }
+    conversion->info = sprintf_alloc("Generated %s (%lu bytes)"
+                                     " from %s (%lu bytes) after %i runs.",
+                                     result_format_names[job->result_format],
+                                     (unsigned long)conversion->result_size,
+                                     source_format_names[job->source_format],
+                                     (unsigned long)job->source_size, conversion->runs);
+    if (conversion->draft_runs > 0) {
+        conversion->info = append_alloc(conversion->info, " Ran %i of them in draft mode.",
+                                        conversion->draft_runs);
+    }
+    if (conversion->truncated) {
+        conversion->info = append_alloc(conversion->info, " Truncated preview after %i pages.",
+                                        conversion->preview_pages);
+    }
+    if (job->source_codec != TEXCALLER_IDENTITY) {
+        conversion->info = append_alloc(conversion->info, " Decompressed the source from %lu bytes via %s.",
+                                        (unsigned long)conversion->encoded_source_size,
+                                        codec_names[job->source_codec]);
+    }
+    if (job->result_codec != TEXCALLER_IDENTITY) {
+        conversion->info = append_alloc(conversion->info, " Compressed the result via %s.",
+                                        codec_names[job->result_codec]);
+    }
+    if (job->outputs_count > 0) {
+        conversion->info = append_alloc(conversion->info, " Generated additional outputs.");
+    }
+    if (conversion->prefetched != -1) {
+        conversion->info = append_alloc(conversion->info, " Prefetched %i input files (%lu KiB not yet cached)",
+                                        conversion->prefetched, (conversion->prefetched_uncached + 1023) / 1024);
+        if (conversion->prefetch_hits != -1) {
+            conversion->info = append_alloc(conversion->info, ", %i of which were read", conversion->prefetch_hits);
+        }
+        conversion->info = append_alloc(conversion->info, ".");
+    }
+    if (conversion->seeded) {
+        conversion->info = append_alloc(conversion->info,
+                                        " Seeded auxiliary files from a previous compilation.");
+    }
+    if (conversion->caches) {
+        conversion->info = append_alloc(conversion->info,
+                                        conversion->cache_stamp_filename != NULL
+                                        ? " Built the font caches." : " Used warm font caches.");
+    }
+    conversion->info = append_alloc(conversion->info, " Waited %.3f s in queue, ran %.3f s.",
+                                    conversion->queue_time, monotonic_time() - conversion->start_time);
+    if (conversion->profile != NULL) {
+        conversion->info = profile_report(conversion->info, conversion->profile);
+    }
+}
+
+/*! Begin a conversion.
+ *
+ *  That is, check the arguments,
+ *  prepare the temporary directory
+ *  and start the first TeX run.
+ *
+ *  \param conversion
+ *      will be initialized
+ *
+ *  \param context
+ *      the context of the conversion
+ *
+ *  \param job
+ *      the conversion
+ *
+ *  \param async
+ *      whether the TeX interpreter will be watched via \c conversion->fd
+ *      instead of waiting for it.
+ *      In that case, the conversion is only queued in the scheduler
+ *      via scheduler_acquire_async(), and conversion_spawn() watches
+ *      the scheduler's wakeup descriptor via \c conversion->fd
+ *      until it may start the first run.
+ *
+ *  \param files
+ *      auxiliary files to create in the temporary directory
+ *      before the first run, see read_workspace_files(),
+ *      or \c NULL
+ *
+ *  \param files_count
+ *      number of elements in \c files
+ */
+static void conversion_begin(texcaller_conversion *conversion, const texcaller_context *context, const texcaller_job *job, int async, const workspace_file *files, int files_count)
+{
+    const texcaller_options *options = &context->options;
+    const char *source = job->source;
+    const size_t source_size = job->source_size;
+    const int source_format = (int)job->source_format;
+    const int result_format = (int)job->result_format;
+    /* whether the uncompressed source is available in memory */
+    const int source_in_memory =    job->source_codec == TEXCALLER_IDENTITY
+                                 && job->source_fd == -1 && job->source_path == NULL;
+    char *error;
+    const char *tmpdir;
+    struct stat st;
+    size_t filename_size;
+    int argc;
+    int i;
+    memset(conversion, 0, sizeof(*conversion));
+    conversion->start_time = monotonic_time();
+    conversion->job = *job;
+    conversion->async = async;
+    conversion->prefetched = -1;
+    conversion->prefetch_hits = -1;
+    conversion->draft_arg = -1;
+    conversion->cache_lock_fd = -1;
+    conversion->dir_lock_fd = -1;
+    conversion->pid = -1;
+    conversion->fd = -1;
+    for (i = 0; i < job->outputs_count; i++) {
+        job->outputs[i].result = NULL;
+        job->outputs[i].result_size = 0;
+    }
+    /* check arguments */
+    if (source_format < 0 || source_format >= SOURCE_FORMATS_COUNT) {
+        conversion_fail(conversion, sprintf_alloc("Unknown source format %i.", source_format));
+        return;
+    }
+    if (result_format < 0 || result_format >= RESULT_FORMATS_COUNT) {
+        conversion_fail(conversion, sprintf_alloc("Unknown result format %i.", result_format));
+        return;
+    }
+    conversion->cmd = engine_commands[source_format][result_format];
+    if (conversion->cmd == NULL) {
+        conversion_fail(conversion, sprintf_alloc("Unable to convert from \"%s\" to \"%s\".",
+                                                  source_format_names[source_format],
+                                                  result_format_names[result_format]));
+        return;
+    }
+    if (job->max_runs < 2) {
+        conversion_fail(conversion, sprintf_alloc("Argument max_runs is %i, but must be >= 2.",
+                                                  job->max_runs));
+        return;
+    }
+    for (i = 0; i < job->outputs_count; i++) {
+        if (   strcmp(job->outputs[i].format, "PNG") != 0
+            && strcmp(job->outputs[i].format, "SVG") != 0) {
+            conversion_fail(conversion, sprintf_alloc("Unable to generate additional output of format \"%s\".",
+                                                      job->outputs[i].format));
+            return;
+        }
+        if (job->outputs[i].page < 1) {
+            conversion_fail(conversion, sprintf_alloc("Page of additional output is %i, but must be >= 1.",
+                                                      job->outputs[i].page));
+            return;
+        }
+    }
+    for (i = 0; i < job->parts_count; i++) {
+        const char *name = job->parts[i].name;
+        if (name[0] == '\0' || name[0] == '.' || strchr(name, '/') != NULL || strcmp(name, "texput") == 0) {
+            conversion_fail(conversion, sprintf_alloc("Part name \"%s\" is invalid.", name));
+            return;
+        }
+    }
+    if ((int)job->source_codec < 0 || (int)job->source_codec >= CODECS_COUNT) {
+        conversion_fail(conversion, sprintf_alloc("Unknown source codec %i.", (int)job->source_codec));
+        return;
+    }
+    if ((int)job->result_codec < 0 || (int)job->result_codec >= CODECS_COUNT) {
+        conversion_fail(conversion, sprintf_alloc("Unknown result codec %i.", (int)job->result_codec));
+        return;
+    }
+    if (async && (   job->outputs_count > 0 || options->workers != NULL
+                  || job->source_codec != TEXCALLER_IDENTITY || job->result_codec != TEXCALLER_IDENTITY)) {
+        conversion_fail(conversion, sprintf_alloc("Additional outputs, codecs and remote workers"
+                                                  " are not supported by asynchronous conversions."));
+        return;
+    }
+    /* delegate to a remote worker */
+    if (options->workers != NULL) {
+        if (job->outputs_count > 0) {
+            conversion_fail(conversion, sprintf_alloc("Additional outputs are not supported by remote workers."));
+            return;
+        }
+        if (job->parts_count > 0) {
+            conversion_fail(conversion, sprintf_alloc("Parts are not supported by remote workers."));
+            return;
+        }
+        if (job->source_codec != TEXCALLER_IDENTITY || job->result_codec != TEXCALLER_IDENTITY) {
+            conversion_fail(conversion, sprintf_alloc("Codecs are not supported by remote workers."));
+            return;
+        }
+        if (job->source_fd != -1 || job->source_path != NULL) {
+            /* the source is sent over the network anyway */
+            texcaller_job remote_job = *job;
+            char *remote_source;
+            char *error;
+            if (read_source(&error, &remote_source, &remote_job.source_size, job) != 0) {
+                conversion_fail(conversion, error);
+                return;
+            }
+            remote_job.source = remote_source;
+            remote_job.source_fd = -1;
+            remote_job.source_path = NULL;
+            convert_remotely(&conversion->result, &conversion->result_size, &conversion->info, options,
+                             context->workers, context->workers_count, &remote_job);
+            free(remote_source);
+            conversion->finished = 1;
+            return;
+        }
+        convert_remotely(&conversion->result, &conversion->result_size, &conversion->info, options,
+                         context->workers, context->workers_count, job);
+        conversion->finished = 1;
+        return;
+    }
+    if (context->resolved) {
+        conversion->executable = context->executables[source_format][result_format];
+        if (conversion->executable == NULL) {
+            conversion_fail(conversion, sprintf_alloc("Unable to find command \"%s\" in PATH.",
+                                                      conversion->cmd));
+            return;
+        }
+    }
+    /* wait for the scheduler,
+       or just queue an asynchronous conversion, see conversion_spawn() */
+    conversion->start_time = monotonic_time();
+    if (!async) {
+        if (scheduler_acquire(&error, options) != 0) {
+            conversion_fail(conversion, error);
+            return;
+        }
+        conversion->scheduled = 1;
+        conversion->queue_time = monotonic_time() - conversion->start_time;
+        conversion->start_time += conversion->queue_time;
+    } else {
+        if (scheduler_acquire_async(&error, &conversion->scheduler_job, options) != 0) {
+            conversion_fail(conversion, error);
+            return;
+        }
+        conversion->scheduled = conversion->scheduler_job == NULL;
+    }
+    /* use the font caches, and prepare the profiler */
+    if (options->cache_dir != NULL || options->profile) {
+        conversion->envp = child_environment(options->cache_dir, options->profile);
+        if (conversion->envp == NULL) {
+            conversion_fail(conversion, NULL);
+            return;
+        }
+    }
+    if (options->profile) {
+        conversion->profile = profile_create(job->max_runs + 1);
+        if (conversion->profile == NULL) {
+            conversion_fail(conversion, NULL);
+            return;
+        }
+    }
+    if (options->cache_dir != NULL) {
+        conversion->caches = 1;
+        if (cache_lock(&error, &conversion->cache_lock_fd, &conversion->cache_stamp_filename,
+                       options->cache_dir, conversion->cmd) != 0) {
+            conversion_fail(conversion, error);
+            return;
+        }
+    }
+    /* create temporary directory */
+    tmpdir = context->tmpdir;
+    if (options->deferred_cleanup || options->recycle_workspaces) {
+        conversion->deferred_cleanup = start_workspace_manager(tmpdir, options->recycle_workspaces) == 0;
+    }
+    if (conversion->deferred_cleanup && options->recycle_workspaces) {
+        conversion->dir_template = acquire_workspace(&conversion->dir_lock_fd);
+        conversion->dir = conversion->dir_template;
+    }
+    if (conversion->dir == NULL) {
+        conversion->dir_template = sprintf_alloc("%s/texcaller-temp-%lu-XXXXXX", tmpdir, (unsigned long)getpid());
+        if (conversion->dir_template == NULL) {
+            conversion_fail(conversion, NULL);
+            return;
+        }
+        conversion->dir = mkdtemp(conversion->dir_template);
+    }
+    if (conversion->dir == NULL) {
+        conversion_fail(conversion, sprintf_alloc("Unable to create temporary directory from template \"%s\": %s.",
+                                                  conversion->dir_template, strerror(errno)));
+        return;
+    }
+    if (conversion->dir_lock_fd == -1) {
+        conversion->dir_lock_fd = lock_workspace(conversion->dir);
+        if (conversion->dir_lock_fd == -1) {
+            conversion_fail(conversion, sprintf_alloc("Unable to lock temporary directory \"%s\": %s.",
+                                                      conversion->dir, strerror(errno)));
+            return;
+        }
+    }
+    /* the file names differ only in their extension,
+       so allocate them all at once */
+    filename_size = strlen(conversion->dir) + sizeof("/texput.tex");
+    conversion->filenames = (char *)malloc(5 * filename_size);
+    if (conversion->filenames == NULL) {
+        conversion_fail(conversion, NULL);
+        return;
+    }
+    sprintf(conversion->filenames, "%s/texput.tex", conversion->dir);
+    sprintf(conversion->filenames + filename_size, "%s/texput.aux", conversion->dir);
+    sprintf(conversion->filenames + 2 * filename_size, "%s/texput.%s",
+            conversion->dir, result_format == TEXCALLER_DVI ? "dvi" : "pdf");
+    sprintf(conversion->filenames + 3 * filename_size, "%s/texput.fls", conversion->dir);
+    sprintf(conversion->filenames + 4 * filename_size, "%s/texput.log", conversion->dir);
+    conversion->aux_filename = conversion->filenames + filename_size;
+    conversion->result_filename = conversion->filenames + 2 * filename_size;
+    conversion->fls_filename = conversion->filenames + 3 * filename_size;
+    conversion->log_filename = conversion->filenames + 4 * filename_size;
+    /* prepare command line */
+    argc = 0;
+    conversion->argv[argc++] = (char *)conversion->cmd;
+    /* the profiler reads the file names from stdout */
+    conversion->argv[argc++] = (char *)(options->profile ? "-interaction=nonstopmode" : "-interaction=batchmode");
+    conversion->argv[argc++] = (char *)"-halt-on-error";
+    conversion->argv[argc++] = (char *)"-file-line-error";
+    conversion->argv[argc++] = (char *)"-no-shell-escape";
+    /* prefetch input files recorded by previous conversions,
+       which are looked up by the uncompressed preamble */
+    if (options->prefetch_dir != NULL && source_in_memory) {
+        size_t prefetch_list_size;
+        const char *preamble_end = find_string(source, source_size, "\\begin{document}");
+        const size_t preamble_size = preamble_end == NULL ? 0 : (size_t)(preamble_end - source);
+        conversion->prefetch_list_filename = sprintf_alloc("%s/%s-%08lx.lst",
+                                                           options->prefetch_dir, conversion->cmd,
+                                                           hash_bytes(HASH_BYTES_INIT, source, preamble_size));
+        if (conversion->prefetch_list_filename == NULL) {
+            conversion_fail(conversion, NULL);
+            return;
+        }
+        read_file(&conversion->prefetch_list, &prefetch_list_size, &error, conversion->prefetch_list_filename);
+        /* tolerate missing prefetch list */
+        free(error);
+        if (conversion->prefetch_list != NULL) {
+            conversion->prefetched = prefetch_files(&conversion->prefetched_uncached, conversion->prefetch_list);
+        }
+        conversion->argv[argc++] = (char *)"-recorder";
+    }
+    /* skip PDF generation until the last run,
+       which is pointless for a single preview run */
+    if (options->draft_mode && result_format == TEXCALLER_PDF && options->preview_pages < 1) {
+        conversion->draft_arg = argc;
+        conversion->draft = 1;
+        conversion->argv[argc++] = (char *)(   source_format == TEXCALLER_XETEX
+                                            || source_format == TEXCALLER_XELATEX
+                                            ? "-no-pdf" : "-draftmode");
+    }
+    /* stop after the first pages in preview mode */
+    if (options->preview_pages > 0) {
+        conversion->preview_command = sprintf_alloc(PREVIEW_COMMAND, options->preview_pages);
+        if (conversion->preview_command == NULL) {
+            conversion_fail(conversion, NULL);
+            return;
+        }
+        conversion->preview_pages = options->preview_pages;
+        conversion->preview_single_run = !options->preview_reruns;
+        conversion->argv[argc++] = conversion->preview_command;
+    } else {
+        conversion->argv[argc++] = (char *)"texput.tex";
+    }
+    conversion->argv[argc++] = NULL;
+    /* seed auxiliary files from previous compilations,
+       which are looked up by the uncompressed structure */
+    if (options->seed_dir != NULL && source_in_memory) {
+        conversion->seed_prefix = sprintf_alloc("%s/%s-%08lx",
+                                                options->seed_dir, conversion->cmd,
+                                                hash_structure(source, source_size));
+        if (conversion->seed_prefix == NULL) {
+            conversion_fail(conversion, NULL);
+            return;
+        }
+        conversion->seeded = load_seed(&conversion->aux, &conversion->aux_size,
+                                       conversion->seed_prefix, conversion->dir);
+    }
+    /* create source files */
+    if (job->source_codec != TEXCALLER_IDENTITY) {
+        char *filename = sprintf_alloc("%s%s", conversion->filenames, codec_extensions[job->source_codec]);
+        if (filename == NULL) {
+            conversion_fail(conversion, NULL);
+            return;
+        }
+        if (   write_source(&error, &conversion->encoded_source_size, filename, job) != 0
+            || run_codec(&error, conversion->dir, (int)job->source_codec, 1,
+                         filename, conversion->filenames) != 0) {
+            free(filename);
+            conversion_fail(conversion, error);
+            return;
+        }
+        unlink(filename);
+        free(filename);
+        /* report and count the decoded size, like for plain sources */
+        if (stat(conversion->filenames, &st) != 0) {
+            conversion_fail(conversion, sprintf_alloc("Unable to stat file \"%s\": %s.",
+                                                      conversion->filenames, strerror(errno)));
+            return;
+        }
+        conversion->job.source_size = (size_t)st.st_size;
+    } else if (write_source(&error, &conversion->job.source_size, conversion->filenames, job) != 0) {
+        conversion_fail(conversion, error);
+        return;
+    }
+    for (i = 0; i < job->parts_count; i++) {
+        char *filename = sprintf_alloc("%s/%s.tex", conversion->dir, job->parts[i].name);
+        if (filename == NULL) {
+            conversion_fail(conversion, NULL);
+            return;
+        }
+        if (write_file(&error, filename, job->parts[i].source, job->parts[i].source_size) != 0) {
+            free(filename);
+            conversion_fail(conversion, error);
+            return;
+        }
+        free(filename);
+    }
+    /* start with the given auxiliary files */
+    if (files_count > 0) {
+        if (write_workspace_files(&error, files, files_count, conversion->dir) != 0) {
+            conversion_fail(conversion, error);
+            return;
+        }
+        free(conversion->aux);
+        read_aux_files(&conversion->aux, &conversion->aux_size, conversion);
+    }
+    /* the source isn't needed anymore */
+    conversion->job.source = NULL;
+    conversion_spawn(conversion);
+}
+
+/*! End a conversion and cleanup all used resources.
+ *
+ *  If the TeX interpreter is still running, it is killed.
+ *
+ *  \param conversion
+ *      the conversion
+ *
+ *  \param result
+ *      see texcaller_convert()
+ *
+ *  \param result_size
+ *      see texcaller_convert()
+ *
+ *  \param info
+ *      see texcaller_convert()
+ */
+static void conversion_end(texcaller_conversion *conversion, char **result, size_t *result_size, char **info)
+{
+    const texcaller_job *job = &conversion->job;
+    const int cancelled = !conversion->finished;
+    int cleanup_failed = 0;
+    char *error;
+    int i;
+    if (conversion->pid != -1) {
+        kill(conversion->pid, SIGKILL);
+        while (waitpid(conversion->pid, NULL, 0) == -1 && errno == EINTR) {
+        }
+        jobserver_release(&conversion->jobserver_token);
+    }
+    if (conversion->fd != -1) {
+        close(conversion->fd);
+    }
+    if (!conversion->finished) {
+        conversion->info = sprintf_alloc("Conversion was cancelled after %i runs.",
+                                         conversion->runs);
+    }
+    if (conversion->scheduler_job != NULL) {
+        scheduler_cancel(conversion->scheduler_job);
+    }
+    if (conversion->scheduled) {
+        scheduler_release();
+    }
+    if (conversion->cache_lock_fd != -1) {
+        close(conversion->cache_lock_fd);
+    }
+    if (conversion->log_filename != NULL) {
+        char *log;
+        size_t log_size;
+        read_file(&log, &log_size, &error, conversion->log_filename);
+        free(error);
+        if (log != NULL) {
+            if (conversion->info == NULL) {
+                conversion->info = log;
+            } else {
+                char *info_old = conversion->info;
+                conversion->info = sprintf_alloc("%s\n\n%s", info_old, log);
+                free(info_old);
+                free(log);
+            }
+        }
+    }
+    if (   conversion->dir != NULL && conversion->deferred_cleanup && conversion->dir_lock_fd != -1
+        && trash_workspace(conversion->dir, conversion->dir_lock_fd) == 0) {
+        conversion->dir = NULL;
+        conversion->dir_lock_fd = -1;
+    }
+    if (   conversion->dir != NULL
+        && remove_directory_recursively(&error, conversion->dir) != 0) {
+        cleanup_failed = 1;
+        free(conversion->result);
+        conversion->result = NULL;
+        conversion->result_size = 0;
+        free(conversion->info);
+        conversion->info = error;
+    }
+    /* a directory that couldn't be removed is left to recover_workspaces() */
+    if (conversion->dir_lock_fd != -1) {
+        close(conversion->dir_lock_fd);
+    }
+    if (conversion->result == NULL) {
+        conversion->result_size = 0;
+        for (i = 0; i < job->outputs_count; i++) {
+            free(job->outputs[i].result);
+            job->outputs[i].result = NULL;
+            job->outputs[i].result_size = 0;
+        }
+    }
+    free(conversion->dir_template);
+    free(conversion->filenames);
+    free(conversion->prefetch_list_filename);
+    free(conversion->prefetch_list);
+    free(conversion->seed_prefix);
+    free(conversion->preview_command);
+    free(conversion->aux);
+    free(conversion->envp);
+    free(conversion->cache_stamp_filename);
+    profile_destroy(conversion->profile);
+    metrics_record(job,
+                   cancelled ? METRICS_CANCELLED : conversion->result != NULL ? METRICS_SUCCEEDED : METRICS_FAILED,
+                   conversion->runs, conversion->queue_time + monotonic_time() - conversion->start_time,
+                   conversion->queue_time, conversion->result_size, cleanup_failed);
+    *result = conversion->result;
+    *result_size = conversion->result_size;
+    *info = conversion->info;
+}
+
+/*!  @} */
+
+/*! \name Parallel parts
+ *
+ *  If texcaller_options::parallel_parts is set,
+ *  a document with parts is compiled as follows:
+ *
+ *  -# The whole document is run in draft mode
+ *     until its \c .aux files are stable,
+ *     which then contain the final cross-references and page numbers
+ *     of all parts.
+ *  -# For each part, a conversion with <tt>\\includeonly</tt>
+ *     set to that part starts from these \c .aux files,
+ *     so the other parts are skipped
+ *     while their references and page numbers are still known.
+ *     Along with these, two single runs are made:
+ *     one with <tt>\\includeonly{}</tt>, which yields
+ *     the front and back matter,
+ *     and one truncated before the first part,
+ *     which yields the front matter.
+ *     All of them run in a pool of threads,
+ *     one per processor at most,
+ *     so the scheduler and the jobserver limit their concurrency further.
+ *  -# The pages of each part are cut out of its PDF
+ *     and concatenated via \c qpdf.
+ *
+ *  The page counts are taken from the logs of the TeX interpreter.
+ *
+ *  @{
+ */
+
+/*! A conversion of a single part, or of the front or back matter.
+ */
+typedef struct part_conversion
+{
+    /*! name of the part, or \c NULL for the front or back matter */
+    const char *name;
+    /*! context of the conversion */
+    const texcaller_context *context;
+    /*! the job, whose \c source is \c source */
+    texcaller_job job;
+    /*! the modified source of the document */
+    char *source;
+    /*! auxiliary files of the first pass */
+    const workspace_file *files;
+    /*! number of elements in \c files */
+    int files_count;
+    /*! whether to run the TeX interpreter only once */
+    int once;
+    /*! whether the conversion succeeded */
+    int succeeded;
+    /*! number of TeX runs */
+    int runs;
+    /*! number of pages of \c result, or -1 if unknown */
+    int pages;
+    /*! see texcaller_convert() */
+    char *result;
+    /*! see texcaller_convert() */
+    size_t result_size;
+    /*! see texcaller_convert() */
+    char *info;
+} part_conversion;
+
+/*! Part conversions shared by a pool of threads.
+ */
+typedef struct part_queue
+{
+    /*! the part conversions */
+    part_conversion *parts;
+    /*! number of elements in \c parts */
+    int count;
+    /*! index of the next part conversion to run */
+    int next;
+    /*! protects \c next */
+    pthread_mutex_t mutex;
+} part_queue;
+
+/*! Find the number of pages in the log of the TeX interpreter.
+ *
+ *  \return
+ *      the number of pages, or -1 if not found
+ *
+ *  \param log
+ *      the log, or \c NULL
+ */
+static int count_pages(const char *log)
+{
+    const char *output;
+    if (log == NULL) {
+        return -1;
+    }
+    if (strstr(log, "No pages of output.") != NULL) {
+        return 0;
+    }
+    output = strstr(log, "Output written on ");
+    if (output == NULL) {
+        return -1;
+    }
+    output = strstr(output, " (");
+    if (output == NULL) {
+        return -1;
+    }
+    return atoi(output + 2);
+}
+
+/*! Run a part conversion.
+ *
+ *  \return
+ *      \c NULL
+ *
+ *  \param arg
+ *      the ::part_conversion
+ */
+static void *part_conversion_run(void *arg)
+{
+    part_conversion *part = (part_conversion *)arg;
+    texcaller_conversion conversion;
+    conversion_begin(&conversion, part->context, &part->job, 0, part->files, part->files_count);
+    while (!conversion.finished) {
+        if (conversion.fd != -1) {
+            conversion_read(&conversion);
+        }
+        if (!part->once) {
+            conversion_continue(&conversion);
+        } else if (conversion_wait(&conversion) == 0) {
+            /* keep only the log, from which the pages are counted */
+            conversion.finished = 1;
+            part->succeeded = 1;
+        }
+    }
+    part->runs = conversion.runs;
+    conversion_end(&conversion, &part->result, &part->result_size, &part->info);
+    if (!part->once) {
+        part->succeeded = part->result != NULL;
+    }
+    part->pages = count_pages(part->info);
+    return NULL;
+}
+
+/*! Run part conversions until none are left.
+ *
+ *  \return
+ *      \c NULL
+ *
+ *  \param arg
+ *      the ::part_queue
+ */
+static void *part_queue_run(void *arg)
+{
+    part_queue *queue = (part_queue *)arg;
+    int i;
+    for (;;) {
+        pthread_mutex_lock(&queue->mutex);
+        i = queue->next < queue->count ? queue->next++ : -1;
+        pthread_mutex_unlock(&queue->mutex);
+        if (i == -1) {
+            return NULL;
+        }
+        part_conversion_run(&queue->parts[i]);
+    }
+}
+
+/*! Assemble the pages of all parts via \c qpdf.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param result
+ *      will be set to a newly allocated buffer that contains the PDF
+ *
+ *  \param result_size
+ *      will be set to the size of \c result
+ *
+ *  \param parts
+ *      the converted parts, in the order of the document
+ *
+ *  \param parts_count
+ *      number of elements in \c parts
+ *
+ *  \param front_pages
+ *      number of pages before the first part
+ *
+ *  \param frame_pages
+ *      number of pages before the first and after the last part
+ *
+ *  \param tmpdir
+ *      directory for the temporary files
+ */
+static int assemble_parts(char **error, char **result, size_t *result_size, const part_conversion *parts, int parts_count, int front_pages, int frame_pages, const char *tmpdir)
+{
+    char *dir_template = NULL;
+    char *dir = NULL;
+    int dir_lock_fd = -1;
+    char **argv = NULL;
+    char *args = NULL;
+    char *filename = NULL;
+    pid_t pid;
+    int argc = 0;
+    int i;
+    *error = NULL;
+    *result = NULL;
+    *result_size = 0;
+    argv = (char **)malloc((2 * parts_count + 6) * sizeof(char *));
+    args = (char *)malloc(parts_count * 2 * 32);
+    dir_template = sprintf_alloc("%s/texcaller-temp-%lu-XXXXXX", tmpdir, (unsigned long)getpid());
+    if (argv == NULL || args == NULL || dir_template == NULL) {
+        goto error_cleanup;
+    }
+    dir = mkdtemp(dir_template);
+    if (dir == NULL) {
+        *error = sprintf_alloc("Unable to create temporary directory from template \"%s\": %s.",
+                               dir_template, strerror(errno));
+        goto error_cleanup;
+    }
+    dir_lock_fd = lock_workspace(dir);
+    if (dir_lock_fd == -1) {
+        *error = sprintf_alloc("Unable to lock temporary directory \"%s\": %s.",
+                               dir, strerror(errno));
+        goto error_cleanup;
+    }
+    argv[argc++] = (char *)"qpdf";
+    argv[argc++] = (char *)"--empty";
+    argv[argc++] = (char *)"--pages";
+    for (i = 0; i < parts_count; i++) {
+        /* the first part keeps the front matter, the last part the back matter */
+        char *part_filename = args + 64 * i;
+        char *range = part_filename + 32;
+        const int part_pages = parts[i].pages - frame_pages;
+        const int first = i == 0 ? 1 : front_pages + 1;
+        const int last = i == parts_count - 1 ? parts[i].pages : front_pages + part_pages;
+        if (part_pages < 0) {
+            *error = sprintf_alloc("Unable to assemble the parts: Part \"%s\" has %i pages,"
+                                   " but the document without parts has %i pages.",
+                                   parts[i].name, parts[i].pages, frame_pages);
+            goto error_cleanup;
+        }
+        if (last < first) {
+            continue;
+        }
+        sprintf(part_filename, "part-%i.pdf", i);
+        sprintf(range, "%i-%i", first, last);
+        free(filename);
+        filename = sprintf_alloc("%s/%s", dir, part_filename);
+        if (filename == NULL) {
+            goto error_cleanup;
+        }
+        if (write_file(error, filename, parts[i].result, parts[i].result_size) != 0) {
+            goto error_cleanup;
+        }
+        argv[argc++] = part_filename;
+        argv[argc++] = range;
+    }
+    argv[argc++] = (char *)"--";
+    argv[argc++] = (char *)"texput.pdf";
+    argv[argc++] = NULL;
+    if (   spawn_command(error, &pid, dir, NULL, -1, argv, NULL) != 0
+        || wait_command(error, pid, "qpdf") != 0) {
+        goto error_cleanup;
+    }
+    free(filename);
+    filename = sprintf_alloc("%s/texput.pdf", dir);
+    if (filename == NULL) {
         goto error_cleanup;
     }
-    return;
-error_cleanup:
-    free(*result);
-    *result = NULL;
-    *result_size = 0;
-    if (file != NULL) {
-        fclose(file);
+    read_file(result, result_size, error, filename);
+    if (*result == NULL) {
+        goto error_cleanup;
+    }
+    free(filename);
+    free(args);
+    free(argv);
+    if (remove_directory_recursively(error, dir) != 0) {
+        free(*result);
+        *result = NULL;
+        *result_size = 0;
+        close(dir_lock_fd);
+        free(dir_template);
+        return -1;
+    }
+    close(dir_lock_fd);
+    free(dir_template);
+    return 0;
+error_cleanup:
+    if (dir != NULL) {
+        char *remove_error;
+        remove_directory_recursively(&remove_error, dir);
+        free(remove_error);
+    }
+    if (dir_lock_fd != -1) {
+        close(dir_lock_fd);
+    }
+    free(filename);
+    free(args);
+    free(argv);
+    free(dir_template);
+    return -1;
+}
+
+/*! Convert a document with parts in parallel.
+ *
+ *  \return
+ *      0 if done, or -1 if the document has to be converted serially
+ *      because it has fewer than two parts
+ *
+ *  \param result
+ *      see texcaller_convert()
+ *
+ *  \param result_size
+ *      see texcaller_convert()
+ *
+ *  \param info
+ *      see texcaller_convert()
+ *
+ *  \param context
+ *      the context of the conversion
+ *
+ *  \param job
+ *      the conversion, a PDF without additional outputs
+ */
+static int convert_parts(char **result, size_t *result_size, char **info, const texcaller_context *context, const texcaller_job *job)
+{
+    const char *source = job->source;
+    const size_t source_size = job->source_size;
+    const char *begin_document = find_string(source, source_size, "\\begin{document}");
+    const double start_time = monotonic_time();
+    const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    texcaller_context first_context;
+    texcaller_context parts_context;
+    texcaller_context once_context;
+    texcaller_conversion conversion;
+    part_conversion *parts = NULL;
+    part_queue queue;
+    pthread_t *threads = NULL;
+    int threads_count = 0;
+    workspace_file *files = NULL;
+    int files_count = 0;
+    const char **positions = NULL;
+    const char *first_position = NULL;
+    part_conversion *front;
+    part_conversion *frame;
+    char *error;
+    char *aux_old;
+    size_t aux_old_size;
+    int count = 0;
+    int first_succeeded = 0;
+    int first_runs = 0;
+    int runs;
+    int i;
+    int j;
+    *result = NULL;
+    *result_size = 0;
+    *info = NULL;
+    if (begin_document == NULL) {
+        return -1;
+    }
+    /* find the parts in the order of the document */
+    positions = (const char **)malloc(job->parts_count * sizeof(const char *));
+    parts = (part_conversion *)malloc((job->parts_count + 2) * sizeof(part_conversion));
+    if (positions == NULL || parts == NULL) {
+        goto cleanup;
+    }
+    for (i = 0; i < job->parts_count + 2; i++) {
+        parts[i].source = NULL;
+        parts[i].result = NULL;
+        parts[i].info = NULL;
+    }
+    for (i = 0; i < job->parts_count; i++) {
+        char *include = sprintf_alloc("\\include{%s}", job->parts[i].name);
+        const char *position;
+        if (include == NULL) {
+            goto cleanup;
+        }
+        position = find_string(begin_document, source_size - (begin_document - source), include);
+        free(include);
+        if (position == NULL) {
+            continue;
+        }
+        /* insertion sort by position */
+        for (j = count; j > 0 && positions[j - 1] > position; j--) {
+            positions[j] = positions[j - 1];
+            parts[j].name = parts[j - 1].name;
+        }
+        positions[j] = position;
+        parts[j].name = job->parts[i].name;
+        count++;
+    }
+    if (count < 2) {
+        free(positions);
+        free(parts);
+        return -1;
+    }
+    first_position = positions[0];
+    /* run the whole document in draft mode until the aux files are stable,
+       as the front matter may grow and shift the pages of all parts */
+    first_context = *context;
+    first_context.options.draft_mode = 1;
+    first_context.options.profile = 0;
+    conversion_begin(&conversion, &first_context, job, 0, NULL, 0);
+    while (!conversion.finished) {
+        if (conversion.fd != -1) {
+            conversion_read(&conversion);
+        }
+        if (conversion_wait(&conversion) != 0) {
+            break;
+        }
+        aux_old      = conversion.aux;
+        aux_old_size = conversion.aux_size;
+        read_aux_files(&conversion.aux, &conversion.aux_size, &conversion);
+        if (conversion.aux_size != aux_old_size || memcmp(conversion.aux, aux_old, aux_old_size) != 0) {
+            free(aux_old);
+            if (conversion.runs < job->max_runs) {
+                conversion_spawn(&conversion);
+            } else {
+                conversion_fail(&conversion, sprintf_alloc("Output didn't stabilize after %i runs.",
+                                                           job->max_runs));
+            }
+            continue;
+        }
+        free(aux_old);
+        files = read_workspace_files(&error, &files_count, conversion.dir);
+        conversion.finished = 1;
+        if (files_count == -1) {
+            conversion.info = error;
+        } else {
+            first_succeeded = 1;
+        }
+    }
+    /* the draft runs have built the caches, which are then warm for
+       the parts, instead of each part waiting for the cache lock */
+    if (first_succeeded && conversion.cache_stamp_filename != NULL) {
+        /* tolerate failure, which just keeps the caches cold */
+        if (write_file(&error, conversion.cache_stamp_filename, "", 0) != 0) {
+            free(error);
+        }
+    }
+    first_runs = conversion.runs;
+    conversion_end(&conversion, result, result_size, info);
+    free(*result);
+    *result = NULL;
+    *result_size = 0;
+    if (!first_succeeded) {
+        goto cleanup;
+    }
+    free(*info);
+    *info = NULL;
+    if (files_count == 0) {
+        /* without auxiliary files, the parts can't be separated */
+        free(positions);
+        free(parts);
+        return -1;
+    }
+    /* prepare the conversions of the parts, and of the front and back matter */
+    parts_context = *context;
+    parts_context.options.prefetch_dir = NULL;
+    parts_context.options.seed_dir = NULL;
+    parts_context.options.profile = 0;
+    once_context = parts_context;
+    once_context.options.draft_mode = 0;
+    front = &parts[count];
+    frame = &parts[count + 1];
+    front->name = NULL;
+    frame->name = NULL;
+    for (i = 0; i < count + 2; i++) {
+        part_conversion *part = &parts[i];
+        part->once = part == front || part == frame;
+        part->context = part->once ? &once_context : &parts_context;
+        part->job = *job;
+        part->files = files;
+        part->files_count = files_count;
+        part->succeeded = 0;
+        part->runs = 0;
+        part->pages = -1;
+        part->result_size = 0;
+        if (part == front) {
+            part->source = sprintf_alloc("%.*s\n\\end{document}\n",
+                                         (int)(first_position - source), source);
+        } else {
+            part->source = sprintf_alloc("%.*s\\includeonly{%s}\n%.*s",
+                                         (int)(begin_document - source), source,
+                                         part->name == NULL ? "" : part->name,
+                                         (int)(source_size - (begin_document - source)), begin_document);
+        }
+    }
+    for (i = 0; i < count + 2; i++) {
+        if (parts[i].source == NULL) {
+            goto cleanup;
+        }
+        parts[i].job.source = parts[i].source;
+        parts[i].job.source_size = strlen(parts[i].source);
+    }
+    /* convert everything in a pool of threads, one per processor,
+       which includes this thread and shrinks if out of threads */
+    queue.parts = parts;
+    queue.count = count + 2;
+    queue.next = 0;
+    pthread_mutex_init(&queue.mutex, NULL);
+    i = processors > 1 ? (int)processors - 1 : 0;
+    if (i > count + 1) {
+        i = count + 1;
+    }
+    threads = (pthread_t *)malloc((i + 1) * sizeof(pthread_t));
+    for (; threads != NULL && threads_count < i; threads_count++) {
+        if (pthread_create(&threads[threads_count], NULL, part_queue_run, &queue) != 0) {
+            break;
+        }
+    }
+    part_queue_run(&queue);
+    for (i = 0; i < threads_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&queue.mutex);
+    /* report the first failure, along with its log */
+    runs = 0;
+    for (i = 0; i < count + 2; i++) {
+        if (!parts[i].succeeded || parts[i].pages == -1) {
+            *info = sprintf_alloc("Unable to convert %s%s%s: %s",
+                                  parts[i].name == NULL ? "" : "part \"",
+                                  parts[i].name == NULL
+                                  ? &parts[i] == front ? "the front matter" : "the document without parts"
+                                  : parts[i].name,
+                                  parts[i].name == NULL ? "" : "\"",
+                                  parts[i].info == NULL ? "Out of memory." : parts[i].info);
+            goto cleanup;
+        }
+        if (!parts[i].once && parts[i].runs > runs) {
+            runs = parts[i].runs;
+        }
+    }
+    if (assemble_parts(&error, result, result_size, parts, count,
+                       front->pages, frame->pages, context->tmpdir) != 0) {
+        *info = error;
+        goto cleanup;
+    }
+    *info = sprintf_alloc("Generated %s (%lu bytes) from %s (%lu bytes)"
+                          " after %i draft runs of the whole document"
+                          " and up to %i runs of %i parts in parallel."
+                          " Ran %.3f s.",
+                          result_format_names[job->result_format], (unsigned long)*result_size,
+                          source_format_names[job->source_format], (unsigned long)source_size,
+                          first_runs, runs, count, monotonic_time() - start_time);
+cleanup:
+    for (i = 0; parts != NULL && i < job->parts_count + 2; i++) {
+        free(parts[i].source);
+        free(parts[i].result);
+        free(parts[i].info);
+    }
+    free_workspace_files(files, files_count);
+    free(threads);
+    free(positions);
+    free(parts);
+    return 0;
+}
+
+/*!  @} */
+/*! \name Batches
+ *
+ *  A batch of documents with the same preamble
+ *  is converted as a single document,
+ *  see texcaller_context_convert_batch().
+ *  Each document starts with the values of all LaTeX counters
+ *  and the page numbering from the beginning of the batch,
+ *  so it is numbered as if it had been converted alone.
+ *  The number of pages shipped out so far
+ *  is recorded in the \c .aux file after each document as
+ *  <tt>\\texcallerpages{position}{pages}</tt>,
+ *  from which the page ranges of the documents follow,
+ *  regardless of how the documents number their pages.
+ *
+ *  Documents whose results would still differ
+ *  are not batched:
+ *  bodies with <tt>\\label</tt>, whose labels would collide,
+ *  and batches with \c hyperref, whose link targets would collide.
+ *  The latter is also recorded in the \c .aux file as
+ *  <tt>\\texcallerunbatchable</tt>,
+ *  in case \c hyperref is loaded by another package.
+ *
+ *  @{
+ */
+
+/*! Preamble addition that ignores the markers in the \c .aux file
+ *  and counts the pages shipped out,
+ *  via the LaTeX kernel's counter if available.
+ */
+#define BATCH_PREAMBLE "\n\\providecommand\\texcallerpages[2]{}\\providecommand\\texcallerunbatchable{}%\n" \
+                       "\\ifdefined\\ReadonlyShipoutCounter\\let\\texcallershipouts\\ReadonlyShipoutCounter\\else\n" \
+                       "\\newcount\\texcallershipouts\\let\\texcallershipout\\shipout\n" \
+                       "\\def\\shipout{\\global\\advance\\texcallershipouts 1 \\texcallershipout}\\fi\n" \
+                       "\\begin{document}\n"
+
+/*! Start of the batch, which saves all counters and the page numbering,
+ *  and records whether \c hyperref is loaded.
+ */
+#define BATCH_SETUP "\\def\\texcallersave#1{\\expandafter\\xdef\\csname texcallersaved#1\\endcsname" \
+                    "{\\the\\csname c@#1\\endcsname}}%\n" \
+                    "\\def\\texcallerrestore#1{\\ifcsname texcallersaved#1\\endcsname" \
+                    "\\global\\csname c@#1\\endcsname\\csname texcallersaved#1\\endcsname\\relax\\fi}%\n" \
+                    "{\\expandafter\\let\\csname @elt\\endcsname\\texcallersave\\csname cl@@ckpt\\endcsname}" \
+                    "\\global\\let\\texcallerthepage\\thepage\n" \
+                    "\\ifcsname hyper@anchor\\endcsname" \
+                    "\\immediate\\write\\csname @auxout\\endcsname{\\string\\texcallerunbatchable}\\fi\n"
+
+/*! Start of each document within the batch, which restores all counters and the page numbering. */
+#define BATCH_DOCUMENT_BEGIN "\\clearpage\\begingroup" \
+                             "{\\expandafter\\let\\csname @elt\\endcsname\\texcallerrestore\\csname cl@@ckpt\\endcsname}" \
+                             "\\global\\let\\thepage\\texcallerthepage%\n"
+
+/*! End of each document within the batch, taking its position. */
+#define BATCH_DOCUMENT_END "\n\\clearpage\\immediate\\write\\csname @auxout\\endcsname" \
+                           "{\\string\\texcallerpages{%i}{\\the\\texcallershipouts}}\\endgroup\n"
+
+/*! End of the batch. */
+#define BATCH_END "\\end{document}\n"
+
+/*! Count the lines breaks of a buffer.
+ *
+ *  \return
+ *      the number of \c '\\n' characters
+ *
+ *  \param s
+ *      the buffer
+ *
+ *  \param size
+ *      size of \c s
+ */
+static int count_lines(const char *s, size_t size)
+{
+    int lines = 0;
+    const char *end = s + size;
+    for (s = (const char *)memchr(s, '\n', size); s != NULL; s = (const char *)memchr(s + 1, '\n', end - s - 1)) {
+        lines++;
+    }
+    return lines;
+}
+
+/*! Build the source of a batch.
+ *
+ *  \return
+ *      the newly allocated source,
+ *      or \c NULL when out of memory
+ *
+ *  \param source_size
+ *      will be set to the size of the source
+ *
+ *  \param first_lines
+ *      will be set to the line number of the first line of each body,
+ *      must have \c pending_count elements
+ *
+ *  \param job
+ *      the batch, whose \c source is the preamble
+ *
+ *  \param documents
+ *      all documents
+ *
+ *  \param pending
+ *      indices of the documents within \c documents to put into the batch
+ *
+ *  \param pending_count
+ *      number of elements in \c pending
+ */
+static char *batch_source(size_t *source_size, int *first_lines, const texcaller_job *job, const texcaller_batch_document *documents, const int *pending, int pending_count)
+{
+    size_t size = job->source_size + sizeof(BATCH_PREAMBLE) + sizeof(BATCH_SETUP) + sizeof(BATCH_END);
+    char *source;
+    char *s;
+    int line;
+    int i;
+    for (i = 0; i < pending_count; i++) {
+        size += sizeof(BATCH_DOCUMENT_BEGIN) + documents[pending[i]].body_size + sizeof(BATCH_DOCUMENT_END) + 16;
+    }
+    source = (char *)malloc(size);
+    if (source == NULL) {
+        return NULL;
+    }
+    memcpy(source, job->source, job->source_size);
+    s = source + job->source_size;
+    s += sprintf(s, "%s%s", BATCH_PREAMBLE, BATCH_SETUP);
+    line = 1 + count_lines(source, s - source);
+    for (i = 0; i < pending_count; i++) {
+        const texcaller_batch_document *document = &documents[pending[i]];
+        s += sprintf(s, "%s", BATCH_DOCUMENT_BEGIN);
+        line++;
+        first_lines[i] = line;
+        memcpy(s, document->body, document->body_size);
+        s += document->body_size;
+        line += count_lines(document->body, document->body_size);
+        s += sprintf(s, BATCH_DOCUMENT_END, i);
+        line += 2;
+    }
+    s += sprintf(s, "%s", BATCH_END);
+    *source_size = s - source;
+    return source;
+}
+
+/*! Find the document that caused an error of a batch.
+ *
+ *  The error is located via the line number
+ *  that the TeX interpreter reports due to \c -file-line-error.
+ *
+ *  \return
+ *      the position of the document within the batch,
+ *      -2 if the error is in the preamble,
+ *      or -1 if the error can't be located
+ *
+ *  \param info
+ *      the info message of the batch, including the log
+ *
+ *  \param first_lines
+ *      see batch_source()
+ *
+ *  \param pending_count
+ *      number of documents in the batch
+ */
+static int batch_error_position(const char *info, const int *first_lines, int pending_count)
+{
+    const char *location;
+    int line = 0;
+    int i;
+    if (info == NULL) {
+        return -1;
+    }
+    for (location = strstr(info, "texput.tex:"); location != NULL; location = strstr(location + 1, "texput.tex:")) {
+        if (sscanf(location, "texput.tex:%i:", &line) == 1) {
+            break;
+        }
+    }
+    if (location == NULL) {
+        return -1;
+    }
+    if (line < first_lines[0] - 1) {
+        return -2;
+    }
+    for (i = pending_count - 1; i >= 0; i--) {
+        if (line >= first_lines[i] - 1) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*! Split the PDF of a batch into the PDFs of its documents via \c qpdf.
+ *
+ *  Up to one \c qpdf per processor runs at the same time.
+ *  Documents without pages fail.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param documents
+ *      all documents, whose \c result, \c result_size and \c info
+ *      will be set on success
+ *
+ *  \param pending
+ *      indices of the documents within \c documents in the batch
+ *
+ *  \param pages
+ *      number of pages of each document in the batch
+ *
+ *  \param pending_count
+ *      number of elements in \c pending and \c pages
+ *
+ *  \param dir
+ *      the temporary directory that contains the PDF of the batch
+ *
+ *  \param runs
+ *      number of TeX runs of the batch
+ */
+static int split_batch(char **error, texcaller_batch_document *documents, const int *pending, const int *pages, int pending_count, const char *dir, int runs)
+{
+    const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    const int max_spawned = processors > 0 ? (int)processors : 1;
+    pid_t *pids;
+    int first = 1;
+    int started;
+    int finished;
+    int i;
+    *error = NULL;
+    pids = (pid_t *)malloc(pending_count * sizeof(pid_t));
+    if (pids == NULL) {
+        return -1;
+    }
+    /* run qpdf for all documents with pages,
+       waiting for the oldest one when enough are running */
+    for (started = 0, finished = 0; finished < pending_count; ) {
+        if (started < pending_count && *error == NULL && started - finished < max_spawned) {
+            char range[32];
+            char filename[32];
+            char *argv[8];
+            pids[started] = -1;
+            if (pages[started] > 0) {
+                sprintf(range, "%i-%i", first, first + pages[started] - 1);
+                sprintf(filename, "document-%i.pdf", started);
+                argv[0] = (char *)"qpdf";
+                argv[1] = (char *)"--empty";
+                argv[2] = (char *)"--pages";
+                argv[3] = (char *)"texput.pdf";
+                argv[4] = range;
+                argv[5] = (char *)"--";
+                argv[6] = filename;
+                argv[7] = NULL;
+                if (spawn_command(error, &pids[started], dir, NULL, -1, argv, NULL) != 0) {
+                    pids[started] = -1;
+                }
+            }
+            first += pages[started];
+            started++;
+        } else if (finished < started) {
+            char *wait_error;
+            if (pids[finished] != -1 && wait_command(&wait_error, pids[finished], "qpdf") != 0) {
+                if (*error == NULL) {
+                    *error = wait_error;
+                } else {
+                    free(wait_error);
+                }
+            }
+            finished++;
+        } else {
+            break;
+        }
+    }
+    free(pids);
+    if (finished < pending_count || *error != NULL) {
+        return -1;
+    }
+    /* read all documents */
+    first = 1;
+    for (i = 0; i < pending_count; i++) {
+        texcaller_batch_document *document = &documents[pending[i]];
+        char *filename;
+        if (pages[i] == 0) {
+            document->info = sprintf_alloc("Document has no pages in a batch of %i documents.", pending_count);
+            continue;
+        }
+        filename = sprintf_alloc("%s/document-%i.pdf", dir, i);
+        if (filename == NULL) {
+            return -1;
+        }
+        read_file(&document->result, &document->result_size, error, filename);
+        free(filename);
+        if (document->result == NULL) {
+            return -1;
+        }
+        document->info = sprintf_alloc("Generated PDF (%lu bytes) from pages %i-%i"
+                                       " of a batch of %i documents after %i runs.",
+                                       (unsigned long)document->result_size,
+                                       first, first + pages[i] - 1, pending_count, runs);
+        first += pages[i];
+    }
+    return 0;
+}
+
+/*! Convert a batch of documents once.
+ *
+ *  \return
+ *      0 on success, in which case the documents have been converted,
+ *      or -1 on failure
+ *
+ *  \param info
+ *      On failure, \c info will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c info will be set to \c NULL.
+ *
+ *  \param position
+ *      On failure, will be set to the result of batch_error_position().
+ *
+ *  \param context
+ *      the context of the conversion
+ *
+ *  \param job
+ *      the batch, whose \c source is the preamble
+ *
+ *  \param documents
+ *      all documents
+ *
+ *  \param pending
+ *      indices of the documents within \c documents to put into the batch
+ *
+ *  \param pending_count
+ *      number of elements in \c pending
+ */
+static int convert_batch_once(char **info, int *position, const texcaller_context *context, const texcaller_job *job, texcaller_batch_document *documents, const int *pending, int pending_count)
+{
+    texcaller_job batch_job = *job;
+    texcaller_conversion conversion;
+    int *first_lines;
+    int *pages;
+    char *source;
+    char *result;
+    size_t result_size;
+    char *error = NULL;
+    int status = -1;
+    int i;
+    *info = NULL;
+    *position = -1;
+    first_lines = (int *)malloc(pending_count * sizeof(int));
+    pages = (int *)malloc(pending_count * sizeof(int));
+    source = first_lines == NULL || pages == NULL
+             ? NULL : batch_source(&batch_job.source_size, first_lines, job, documents, pending, pending_count);
+    if (source == NULL) {
+        free(first_lines);
+        free(pages);
+        return -1;
+    }
+    batch_job.source = source;
+    batch_job.outputs = NULL;
+    batch_job.outputs_count = 0;
+    conversion_begin(&conversion, context, &batch_job, 0, NULL, 0);
+    while (!conversion.finished) {
+        if (conversion.fd != -1) {
+            conversion_read(&conversion);
+        }
+        conversion_continue(&conversion);
+    }
+    if (conversion.result != NULL) {
+        /* read the numbers of pages shipped out after each document
+           from the final aux file, which is terminated by read_file() */
+        const char *marker = conversion.aux == NULL ? NULL : strstr(conversion.aux, "\\texcallerpages{");
+        int shipped = 0;
+        for (i = 0; i < pending_count; i++) {
+            pages[i] = -1;
+        }
+        for (; marker != NULL; marker = strstr(marker + 1, "\\texcallerpages{")) {
+            int marker_position;
+            int marker_pages;
+            if (   sscanf(marker, "\\texcallerpages{%i}{%i}", &marker_position, &marker_pages) == 2
+                && marker_position >= 0 && marker_position < pending_count && marker_pages >= 0) {
+                pages[marker_position] = marker_pages;
+            }
+        }
+        for (i = 0; i < pending_count && pages[i] >= shipped; i++) {
+            const int total = pages[i];
+            pages[i] -= shipped;
+            shipped = total;
+        }
+        if (conversion.aux != NULL && strstr(conversion.aux, "\\texcallerunbatchable") != NULL) {
+            error = sprintf_alloc("Unable to batch the documents: Their hyperlink targets would collide.");
+        } else if (i < pending_count) {
+            error = sprintf_alloc("Unable to split the batch: Missing the page count of document %i.", pending[i]);
+        } else if (split_batch(&error, documents, pending, pages, pending_count, conversion.dir, conversion.runs) == 0) {
+            status = 0;
+        }
+    }
+    conversion_end(&conversion, &result, &result_size, info);
+    free(result);
+    if (status == 0) {
+        free(*info);
+        *info = NULL;
+    } else {
+        *position = batch_error_position(*info, first_lines, pending_count);
+        if (error != NULL) {
+            /* the batch was converted, but couldn't be split */
+            free(*info);
+            *info = error;
+            *position = -1;
+        }
+        for (i = 0; i < pending_count; i++) {
+            free(documents[pending[i]].result);
+            documents[pending[i]].result = NULL;
+            documents[pending[i]].result_size = 0;
+            free(documents[pending[i]].info);
+            documents[pending[i]].info = NULL;
+        }
+    }
+    free(source);
+    free(first_lines);
+    free(pages);
+    return status;
+}
+
+/*! Convert a document of a batch alone.
+ *
+ *  \param context
+ *      the context of the conversion
+ *
+ *  \param job
+ *      the batch, whose \c source is the preamble
+ *
+ *  \param document
+ *      the document, whose \c result, \c result_size and \c info will be set
+ */
+static void convert_batch_document(const texcaller_context *context, const texcaller_job *job, texcaller_batch_document *document)
+{
+    texcaller_job document_job = *job;
+    char *source = (char *)malloc(job->source_size + document->body_size + sizeof(BATCH_PREAMBLE) + sizeof(BATCH_END));
+    char *s;
+    document->result = NULL;
+    document->result_size = 0;
+    document->info = NULL;
+    if (source == NULL) {
+        return;
+    }
+    memcpy(source, job->source, job->source_size);
+    s = source + job->source_size;
+    s += sprintf(s, "%s", BATCH_PREAMBLE);
+    memcpy(s, document->body, document->body_size);
+    s += document->body_size;
+    s += sprintf(s, "\n%s", BATCH_END);
+    document_job.source = source;
+    document_job.source_size = s - source;
+    document_job.outputs = NULL;
+    document_job.outputs_count = 0;
+    texcaller_context_convert(&document->result, &document->result_size, &document->info, context, &document_job);
+    free(source);
+}
+
+/*! @} */
+
+/*! Configure the scheduler for concurrent conversions.
+ */
+void texcaller_scheduler_configure(int max_running, int max_queued)
+{
+    pthread_mutex_lock(&scheduler_mutex);
+    scheduler_max_running = max_running > 0 ? max_running : 0;
+    scheduler_max_queued = max_queued > 0 ? max_queued : 0;
+    scheduler_wake();
+    pthread_mutex_unlock(&scheduler_mutex);
+}
+
+/*! Configure the jobserver for concurrent TeX runs of all processes.
+ */
+int texcaller_jobserver_configure(char **error, const char *jobserver)
+{
+    jobserver_state state;
+    /* don't let TEXCALLER_JOBSERVER override this later */
+    pthread_once(&jobserver_once, jobserver_init);
+    if (jobserver_open(error, &state, jobserver) != 0) {
+        return -1;
+    }
+    /* the previous jobserver is kept open,
+       as running conversions may still hold its tokens */
+    pthread_mutex_lock(&jobserver_mutex);
+    jobserver_configured = 1;
+    jobserver_current = state;
+    free(jobserver_error);
+    jobserver_error = NULL;
+    jobserver_implicit = 1;
+    pthread_cond_broadcast(&jobserver_cond);
+    pthread_mutex_unlock(&jobserver_mutex);
+    return 0;
+}
+
+/*! Take a snapshot of the process-wide metrics.
+ */
+texcaller_metric *texcaller_metrics_snapshot(int *count)
+{
+    metrics_shard total;
+    texcaller_metric *metrics;
+    unsigned long cumulative;
+    int n = 0;
+    int i;
+    int j;
+    int k;
+    int shard;
+    *count = 0;
+    /* sum up all shards */
+    memset(&total, 0, sizeof(total));
+    for (shard = 0; shard < METRICS_SHARDS; shard++) {
+        const metrics_shard *s = &metrics_shards[shard];
+        for (i = 0; i < SOURCE_FORMATS_COUNT; i++) {
+            for (j = 0; j < RESULT_FORMATS_COUNT; j++) {
+                for (k = 0; k < METRICS_OUTCOMES_COUNT; k++) {
+                    total.conversions[i][j][k] += s->conversions[i][j][k];
+                }
+            }
+        }
+        for (i = 0; i < METRICS_RUNS_BUCKETS; i++) {
+            total.runs[i] += s->runs[i];
+        }
+        for (i = 0; i < METRICS_LATENCY_BUCKETS; i++) {
+            total.latency[i] += s->latency[i];
+        }
+        total.runs_sum += s->runs_sum;
+        total.latency_sum += s->latency_sum;
+        total.queue_sum += s->queue_sum;
+        total.source_bytes += s->source_bytes;
+        total.result_bytes += s->result_bytes;
+        total.cleanup_failures += s->cleanup_failures;
+        total.remote_failures += s->remote_failures;
+        total.truncated_previews += s->truncated_previews;
+    }
+    metrics = (texcaller_metric *)malloc((SOURCE_FORMATS_COUNT * RESULT_FORMATS_COUNT * METRICS_OUTCOMES_COUNT
+                                          + METRICS_RUNS_BUCKETS + METRICS_LATENCY_BUCKETS + 4 + 6)
+                                         * sizeof(texcaller_metric));
+    if (metrics == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < SOURCE_FORMATS_COUNT; i++) {
+        for (j = 0; j < RESULT_FORMATS_COUNT; j++) {
+            if (engine_commands[i][j] == NULL) {
+                continue;
+            }
+            for (k = 0; k < METRICS_OUTCOMES_COUNT; k++) {
+                metrics[n].name = "texcaller_conversions_total";
+                sprintf(metrics[n].labels, "source_format=\"%s\",result_format=\"%s\",outcome=\"%s\"",
+                        source_format_names[i], result_format_names[j], metrics_outcome_names[k]);
+                metrics[n++].value = (double)total.conversions[i][j][k];
+            }
+        }
+    }
+    cumulative = 0;
+    for (i = 0; i < METRICS_RUNS_BUCKETS; i++) {
+        cumulative += total.runs[i];
+        metrics[n].name = "texcaller_runs_bucket";
+        if (i < METRICS_RUNS_BUCKETS - 1) {
+            sprintf(metrics[n].labels, "le=\"%i\"", i + 1);
+        } else {
+            sprintf(metrics[n].labels, "le=\"+Inf\"");
+        }
+        metrics[n++].value = (double)cumulative;
+    }
+    metrics[n].name = "texcaller_runs_sum";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = (double)total.runs_sum;
+    metrics[n].name = "texcaller_runs_count";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = (double)cumulative;
+    cumulative = 0;
+    for (i = 0; i < METRICS_LATENCY_BUCKETS; i++) {
+        cumulative += total.latency[i];
+        metrics[n].name = "texcaller_conversion_seconds_bucket";
+        if (i < METRICS_LATENCY_BUCKETS - 1) {
+            sprintf(metrics[n].labels, "le=\"%g\"", metrics_latency_bounds[i]);
+        } else {
+            sprintf(metrics[n].labels, "le=\"+Inf\"");
+        }
+        metrics[n++].value = (double)cumulative;
+    }
+    metrics[n].name = "texcaller_conversion_seconds_sum";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = total.latency_sum / 1e6;
+    metrics[n].name = "texcaller_conversion_seconds_count";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = (double)cumulative;
+    metrics[n].name = "texcaller_queue_seconds_total";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = total.queue_sum / 1e6;
+    metrics[n].name = "texcaller_source_bytes_total";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = (double)total.source_bytes;
+    metrics[n].name = "texcaller_result_bytes_total";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = (double)total.result_bytes;
+    metrics[n].name = "texcaller_cleanup_failures_total";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = (double)total.cleanup_failures;
+    metrics[n].name = "texcaller_remote_failures_total";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = (double)total.remote_failures;
+    metrics[n].name = "texcaller_truncated_previews_total";
+    metrics[n].labels[0] = '\0';
+    metrics[n++].value = (double)total.truncated_previews;
+    *count = n;
+    return metrics;
+}
+
+/*! Format the process-wide metrics for Prometheus.
+ */
+char *texcaller_metrics_prometheus(void)
+{
+    texcaller_metric *metrics;
+    char *result;
+    int count;
+    int family = -1;
+    int i;
+    metrics = texcaller_metrics_snapshot(&count);
+    if (metrics == NULL) {
+        return NULL;
+    }
+    result = sprintf_alloc("%s", "");
+    for (i = 0; i < count; i++) {
+        /* the metrics are ordered by family */
+        if (   family + 1 < METRICS_FAMILIES_COUNT
+            && strncmp(metrics[i].name, metrics_families[family + 1].name,
+                       strlen(metrics_families[family + 1].name)) == 0) {
+            family++;
+            result = append_alloc(result, "# HELP %s %s\n# TYPE %s %s\n",
+                                  metrics_families[family].name, metrics_families[family].help,
+                                  metrics_families[family].name, metrics_families[family].type);
+        }
+        result = append_alloc(result, metrics[i].labels[0] == '\0' ? "%s%s %.15g\n" : "%s{%s} %.15g\n",
+                              metrics[i].name, metrics[i].labels, metrics[i].value);
+    }
+    free(metrics);
+    return result;
+}
+
+/*! Initialize \c options with the default values.
+ */
+void texcaller_options_init(texcaller_options *options)
+{
+    options->prefetch_dir = NULL;
+    options->seed_dir = NULL;
+    options->outputs = NULL;
+    options->outputs_count = 0;
+    options->deferred_cleanup = 0;
+    options->recycle_workspaces = 0;
+    options->priority = TEXCALLER_PRIORITY_NORMAL;
+    options->tenant = NULL;
+    options->tenant_weight = 1;
+    options->workers = NULL;
+    options->worker_timeout = 300;
+    options->worker_secret = NULL;
+    options->worker_max_source_size = 64 * 1024 * 1024;
+    options->draft_mode = 0;
+    options->cache_dir = NULL;
+    options->profile = 0;
+    options->parts = NULL;
+    options->parts_count = 0;
+    options->parallel_parts = 0;
+    options->preview_pages = 0;
+    options->preview_reruns = 0;
+    options->source_codec = NULL;
+    options->result_codec = NULL;
+}
+
+/*! Convert a TeX or LaTeX source to DVI or PDF.
+ */
+void texcaller_convert(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs)
+{
+    texcaller_convert_with_options(result, result_size, info,
+                                   source, source_size, source_format, result_format, max_runs,
+                                   NULL);
+}
+
+/*! Common implementation of texcaller_convert_with_options(),
+ *  texcaller_convert_fd() and texcaller_convert_path().
+ *
+ *  \param job
+ *      the job, initialized via texcaller_job_init(),
+ *      with its source already set.
+ *      All other fields are set from the remaining parameters.
+ *
+ *  All other parameters are the same as for texcaller_convert_with_options().
+ */
+static void convert_job_with_options(char **result, size_t *result_size, char **info, texcaller_job *job, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options)
+{
+    const int source_index = find_format(source_format_names, SOURCE_FORMATS_COUNT, source_format);
+    const int result_index = find_format(result_format_names, RESULT_FORMATS_COUNT, result_format);
+    const char *source_codec = options == NULL || options->source_codec == NULL ? "identity" : options->source_codec;
+    const char *result_codec = options == NULL || options->result_codec == NULL ? "identity" : options->result_codec;
+    const int source_codec_index = find_format(codec_names, CODECS_COUNT, source_codec);
+    const int result_codec_index = find_format(codec_names, CODECS_COUNT, result_codec);
+    texcaller_context context;
+    int i;
+    if (source_index == -1 || result_index == -1 || source_codec_index == -1 || result_codec_index == -1) {
+        *result = NULL;
+        *result_size = 0;
+        for (i = 0; options != NULL && i < options->outputs_count; i++) {
+            options->outputs[i].result = NULL;
+            options->outputs[i].result_size = 0;
+        }
+        if (source_codec_index == -1 || result_codec_index == -1) {
+            *info = sprintf_alloc("Unknown codec \"%s\".",
+                                  source_codec_index == -1 ? source_codec : result_codec);
+        } else {
+            *info = sprintf_alloc("Unable to convert from \"%s\" to \"%s\".",
+                                  source_format, result_format);
+        }
+        return;
+    }
+    context_init_temporary(&context, options);
+    job->max_runs = max_runs;
+    job->outputs = options == NULL ? NULL : options->outputs;
+    job->outputs_count = options == NULL ? 0 : options->outputs_count;
+    job->parts = options == NULL ? NULL : options->parts;
+    job->parts_count = options == NULL ? 0 : options->parts_count;
+    job->source_format = (texcaller_source_format)source_index;
+    job->result_format = (texcaller_result_format)result_index;
+    job->source_codec = (texcaller_codec)source_codec_index;
+    job->result_codec = (texcaller_codec)result_codec_index;
+    texcaller_context_convert(result, result_size, info, &context, job);
+}
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, using additional options.
+ */
+void texcaller_convert_with_options(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options)
+{
+    texcaller_job job;
+    texcaller_job_init(&job);
+    job.source = source;
+    job.source_size = source_size;
+    convert_job_with_options(result, result_size, info, &job, source_format, result_format, max_runs, options);
+}
+
+/*! Convert a TeX or LaTeX source read from a file descriptor.
+ */
+void texcaller_convert_fd(char **result, size_t *result_size, char **info, int source_fd, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options)
+{
+    texcaller_job job;
+    texcaller_job_init(&job);
+    job.source_fd = source_fd;
+    convert_job_with_options(result, result_size, info, &job, source_format, result_format, max_runs, options);
+}
+
+/*! Convert a TeX or LaTeX source file.
+ */
+void texcaller_convert_path(char **result, size_t *result_size, char **info, const char *source_path, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options)
+{
+    texcaller_job job;
+    texcaller_job_init(&job);
+    job.source_path = source_path;
+    convert_job_with_options(result, result_size, info, &job, source_format, result_format, max_runs, options);
+}
+
+/*! Build the font caches before the first conversion.
+ */
+int texcaller_warm_up(char **info, const char *source_format, const texcaller_options *options)
+{
+    const int source_index = find_format(source_format_names, SOURCE_FORMATS_COUNT, source_format);
+    texcaller_context context;
+    texcaller_job job;
+    char *result;
+    size_t result_size;
+    if (source_index == -1) {
+        *info = sprintf_alloc("Unknown source format \"%s\".", source_format);
+        return -1;
+    }
+    context_init_temporary(&context, options);
+    /* the caches of remote workers are their own business */
+    context.options.workers = NULL;
+    texcaller_job_init(&job);
+    job.source = warm_up_sources[source_index];
+    job.source_size = strlen(job.source);
+    job.source_format = (texcaller_source_format)source_index;
+    texcaller_context_convert(&result, &result_size, info, &context, &job);
+    if (result == NULL) {
+        return -1;
     }
+    free(result);
+    return 0;
 }
 
-/*! Write a buffer completely into a file.
- *
- *  If the file already exists, it will be overwritten.
- *
- *  \return
- *      0 on success, -1 on failure
- *
- *  \param error
- *      On failure, \c error will be set to a newly allocated string
- *      that contains the error message.
- *      On success, or when out of memory,
- *      \c error will be set to \c NULL.
- *
- *  \param path
- *      path of the file to write to
- *
- *  \param source
- *      buffer to write
- *
- *  \param source_size
- *      size of \c source
+/*! Initialize \c job with the default values.
  */
-static int write_file(char **error, const char *path, const char *source, size_t source_size)
+void texcaller_job_init(texcaller_job *job)
 {
-    FILE *file;
-    size_t written_size;
+    job->source = NULL;
+    job->source_size = 0;
+    job->source_format = TEXCALLER_LATEX;
+    job->result_format = TEXCALLER_PDF;
+    job->max_runs = 5;
+    job->outputs = NULL;
+    job->outputs_count = 0;
+    job->parts = NULL;
+    job->parts_count = 0;
+    job->source_codec = TEXCALLER_IDENTITY;
+    job->result_codec = TEXCALLER_IDENTITY;
+    job->source_fd = -1;
+    job->source_path = NULL;
+}
+
+/*! Create a context for multiple conversions.
+ */
+texcaller_context *texcaller_context_create(char **error, const texcaller_options *options)
+{
+    texcaller_context *context;
+    int i;
+    int j;
     *error = NULL;
-    file = fopen(path, "wb");
-    if (file == NULL) {
-        *error = sprintf_alloc("Unable to open file \"%s\" for writing: %s.",
-                               path, strerror(errno));
-        goto error_cleanup;
+    if (options != NULL && options->outputs_count != 0) {
+        *error = sprintf_alloc("Additional outputs have to be passed per job, not per context.");
+        return NULL;
     }
-    written_size = fwrite(source, 1, source_size, file);
-    if (ferror(file)) {
-        *error = sprintf_alloc("Unable to write %lu bytes to file \"%s\": %s.",
-                               (unsigned long)source_size, path, strerror(errno));
-        goto error_cleanup;
+    if (options != NULL && options->parts_count != 0) {
+        *error = sprintf_alloc("Parts have to be passed per job, not per context.");
+        return NULL;
     }
-    if (written_size != source_size) {
-        *error = sprintf_alloc("Unable to write %lu bytes to file \"%s\": Only %lu bytes were written.",
-                               (unsigned long)source_size, path, (unsigned long)written_size);
-        goto error_cleanup;
+    if (options != NULL && (options->source_codec != NULL || options->result_codec != NULL)) {
+        *error = sprintf_alloc("Codecs have to be passed per job, not per context.");
+        return NULL;
     }
-    if (fclose(file) != 0) {
-        *error = sprintf_alloc("Unable to close file \"%s\" after writing: %s.",
-                               path, strerror(errno));
-        file = NULL;
-        goto error_cleanup;
+    context = (texcaller_context *)malloc(sizeof(texcaller_context));
+    if (context == NULL) {
+        return NULL;
     }
-    return 0;
-error_cleanup:
-    if (file != NULL) {
-        fclose(file);
+    if (options == NULL) {
+        texcaller_options_init(&context->options);
+    } else {
+        context->options = *options;
     }
-    return -1;
+    context->options.prefetch_dir = NULL;
+    context->options.seed_dir = NULL;
+    context->options.tenant = NULL;
+    context->options.workers = NULL;
+    context->options.worker_secret = NULL;
+    context->options.cache_dir = NULL;
+    context->workers = NULL;
+    context->workers_count = 0;
+    for (i = 0; i < SOURCE_FORMATS_COUNT; i++) {
+        for (j = 0; j < RESULT_FORMATS_COUNT; j++) {
+            context->executables[i][j] = NULL;
+        }
+    }
+    pthread_once(&environment_once, environment_init);
+    context->tmpdir = environment_tmpdir;
+    context->resolved = 1;
+    /* keep own copies of the strings */
+    if (options != NULL) {
+        if (   (options->prefetch_dir != NULL
+                && (context->options.prefetch_dir = sprintf_alloc("%s", options->prefetch_dir)) == NULL)
+            || (options->seed_dir != NULL
+                && (context->options.seed_dir = sprintf_alloc("%s", options->seed_dir)) == NULL)
+            || (options->tenant != NULL
+                && (context->options.tenant = sprintf_alloc("%s", options->tenant)) == NULL)
+            || (options->workers != NULL
+                && (context->options.workers = sprintf_alloc("%s", options->workers)) == NULL)
+            || (options->worker_secret != NULL
+                && (context->options.worker_secret = sprintf_alloc("%s", options->worker_secret)) == NULL)
+            || (options->cache_dir != NULL
+                && (context->options.cache_dir = sprintf_alloc("%s", options->cache_dir)) == NULL)) {
+            texcaller_context_destroy(context);
+            return NULL;
+        }
+    }
+    if (   context->options.workers != NULL
+        && remote_workers_find(error, &context->workers, &context->workers_count,
+                               context->options.workers) != 0) {
+        texcaller_context_destroy(context);
+        return NULL;
+    }
+    /* resolve all interpreters,
+       tolerating missing ones until they are actually used */
+    for (i = 0; i < SOURCE_FORMATS_COUNT; i++) {
+        for (j = 0; j < RESULT_FORMATS_COUNT; j++) {
+            if (engine_commands[i][j] != NULL) {
+                context->executables[i][j] = find_executable(error, engine_commands[i][j]);
+                if (context->executables[i][j] == NULL) {
+                    if (*error == NULL) {
+                        texcaller_context_destroy(context);
+                        return NULL;
+                    }
+                    free(*error);
+                    *error = NULL;
+                }
+            }
+        }
+    }
+    /* start the background thread right away */
+    if (context->options.deferred_cleanup || context->options.recycle_workspaces) {
+        start_workspace_manager(context->tmpdir, context->options.recycle_workspaces);
+    }
+    return context;
 }
 
-/*!  @} */
+/*! Destroy a context created by texcaller_context_create().
+ */
+void texcaller_context_destroy(texcaller_context *context)
+{
+    int i;
+    int j;
+    if (context == NULL) {
+        return;
+    }
+    for (i = 0; i < SOURCE_FORMATS_COUNT; i++) {
+        for (j = 0; j < RESULT_FORMATS_COUNT; j++) {
+            free(context->executables[i][j]);
+        }
+    }
+    free((char *)context->options.prefetch_dir);
+    free((char *)context->options.seed_dir);
+    free((char *)context->options.tenant);
+    free((char *)context->options.workers);
+    free((char *)context->options.worker_secret);
+    free((char *)context->options.cache_dir);
+    free(context->workers);
+    free(context);
+}
 
-/*! Convert a TeX or LaTeX source to DVI or PDF.
+/*! Convert a TeX or LaTeX source to DVI or PDF within a context.
  */
-void texcaller_convert(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs)
+void texcaller_context_convert(char **result, size_t *result_size, char **info, const texcaller_context *context, const texcaller_job *job)
 {
+    texcaller_context temporary_context;
+    texcaller_conversion conversion;
+    texcaller_job memory_job;
+    char *memory_source = NULL;
     char *error;
-    const char *cmd;
-    const char *tmpdir;
-    char *dir = NULL;
-    char *dir_template = NULL;
-    char *source_filename = NULL;
-    char *aux_filename = NULL;
-    char *log_filename = NULL;
-    char *result_filename = NULL;
-    char *aux = NULL;
-    size_t aux_size = 0;
-    char *aux_old = NULL;
-    size_t aux_old_size = 0;
-    int runs;
-    *result = NULL;
-    *result_size = 0;
+    if (context == NULL) {
+        context_init_temporary(&temporary_context, NULL);
+        context = &temporary_context;
+    }
+    if (   context->options.parallel_parts && !context->options.profile && context->options.preview_pages < 1
+        && job->parts_count >= 2 && job->result_format == TEXCALLER_PDF && job->outputs_count == 0
+        && job->source_codec == TEXCALLER_IDENTITY && job->result_codec == TEXCALLER_IDENTITY
+        && context->options.workers == NULL) {
+        if (job->source_fd != -1 || job->source_path != NULL) {
+            /* the parts are found and spliced within the source in memory */
+            memory_job = *job;
+            if (read_source(&error, &memory_source, &memory_job.source_size, job) != 0) {
+                *result = NULL;
+                *result_size = 0;
+                *info = error;
+                return;
+            }
+            memory_job.source = memory_source;
+            memory_job.source_fd = -1;
+            memory_job.source_path = NULL;
+            job = &memory_job;
+        }
+        if (convert_parts(result, result_size, info, context, job) == 0) {
+            free(memory_source);
+            return;
+        }
+    }
+    conversion_begin(&conversion, context, job, 0, NULL, 0);
+    /* run command as often as necessary */
+    while (!conversion.finished) {
+        if (conversion.fd != -1) {
+            conversion_read(&conversion);
+        }
+        conversion_continue(&conversion);
+    }
+    conversion_end(&conversion, result, result_size, info);
+    free(memory_source);
+}
+
+/*! Convert many small LaTeX documents with the same preamble
+ *  in a single conversion.
+ */
+void texcaller_context_convert_batch(char **info, const texcaller_context *context, const texcaller_job *job, texcaller_batch_document *documents, int documents_count)
+{
+    texcaller_context temporary_context;
+    int *pending;
+    int pending_count = 0;
+    int batches = 0;
+    int batched = 0;
+    int alone = 0;
+    int converted = 0;
+    int i;
     *info = NULL;
-    /* check arguments */
-    if        (strcmp(result_format, "DVI") == 0 && strcmp(source_format, "TeX") == 0) {
-        cmd = "tex";
-    } else if (strcmp(result_format, "DVI") == 0 && strcmp(source_format, "LaTeX") == 0) {
-        cmd = "latex";
-    } else if (strcmp(result_format, "PDF") == 0 && strcmp(source_format, "TeX") == 0) {
-        cmd = "pdftex";
-    } else if (strcmp(result_format, "PDF") == 0 && strcmp(source_format, "LaTeX") == 0) {
-        cmd = "pdflatex";
-    } else if (strcmp(result_format, "PDF") == 0 && strcmp(source_format, "XeTeX") == 0) {
-        cmd = "xetex";
-    } else if (strcmp(result_format, "PDF") == 0 && strcmp(source_format, "XeLaTeX") == 0) {
-        cmd = "xelatex";
-    } else if (strcmp(result_format, "PDF") == 0 && strcmp(source_format, "LuaTeX") == 0) {
-        cmd = "luatex";
-    } else if (strcmp(result_format, "PDF") == 0 && strcmp(source_format, "LuaLaTeX") == 0) {
-        cmd = "lualatex";
-    } else {
-        *info = sprintf_alloc("Unable to convert from \"%s\" to \"%s\".",
-                              source_format, result_format);
-        goto cleanup;
+    for (i = 0; i < documents_count; i++) {
+        documents[i].result = NULL;
+        documents[i].result_size = 0;
+        documents[i].info = NULL;
     }
-    if (max_runs < 2) {
-        *info = sprintf_alloc("Argument max_runs is %i, but must be >= 2.",
-                              max_runs);
-        goto cleanup;
+    if (context == NULL) {
+        context_init_temporary(&temporary_context, NULL);
+        context = &temporary_context;
     }
-    /* create temporary directory */
-    tmpdir = getenv("TMPDIR");
-    if (tmpdir == NULL || strcmp(tmpdir, "") == 0) {
-        tmpdir = "/tmp";
+    if (   job->result_format != TEXCALLER_PDF
+        || job->source_codec != TEXCALLER_IDENTITY || job->result_codec != TEXCALLER_IDENTITY
+        || job->source_fd != -1 || job->source_path != NULL) {
+        *info = sprintf_alloc(job->result_format != TEXCALLER_PDF
+                              ? "Batches are only supported for PDF results."
+                              : "Batches are only supported for uncompressed sources in memory and results.");
+        for (i = 0; i < documents_count; i++) {
+            documents[i].info = sprintf_alloc("%s", *info);
+        }
+        return;
     }
-    dir_template = sprintf_alloc("%s/texcaller-temp-XXXXXX", tmpdir);
-    if (dir_template == NULL) {
-        goto cleanup;
+    pending = (int *)malloc(documents_count * sizeof(int));
+    if (pending == NULL) {
+        return;
     }
-    dir = mkdtemp(dir_template);
-    if (dir == NULL) {
-        *info = sprintf_alloc("Unable to create temporary directory from template \"%s\": %s.",
-                              dir_template, strerror(errno));
-        goto cleanup;
+    /* remote workers convert each document on its own,
+       as do documents whose labels or link targets would collide */
+    if (   context->options.workers == NULL
+        && find_string(job->source, job->source_size, "hyperref") == NULL) {
+        for (i = 0; i < documents_count; i++) {
+            if (find_string(documents[i].body, documents[i].body_size, "\\label") == NULL) {
+                pending[pending_count++] = i;
+            }
+        }
+    }
+    while (pending_count > 0) {
+        char *error;
+        int position;
+        const int status = convert_batch_once(&error, &position, context, job, documents, pending, pending_count);
+        batches++;
+        if (status == 0) {
+            batched += pending_count;
+            pending_count = 0;
+        } else if (position >= 0) {
+            /* retry the failed document alone, and the others without it */
+            free(error);
+            convert_batch_document(context, job, &documents[pending[position]]);
+            alone++;
+            pending_count--;
+            memmove(&pending[position], &pending[position + 1], (pending_count - position) * sizeof(int));
+        } else if (position == -2) {
+            /* the preamble fails every document */
+            for (i = 0; i < pending_count; i++) {
+                documents[pending[i]].info = sprintf_alloc("%s", error == NULL ? "Out of memory." : error);
+            }
+            free(error);
+            pending_count = 0;
+        } else {
+            free(error);
+            break;
+        }
+    }
+    /* convert the remaining documents one by one */
+    for (i = 0; i < documents_count; i++) {
+        if (documents[i].result == NULL && documents[i].info == NULL) {
+            convert_batch_document(context, job, &documents[i]);
+            alone++;
+        }
+        if (documents[i].result != NULL) {
+            converted++;
+        }
+    }
+    free(pending);
+    *info = sprintf_alloc("Generated %i of %i documents."
+                          " Converted %i documents in %i batch runs and %i alone.",
+                          converted, documents_count, batched, batches, alone);
+}
+
+/*! Start an asynchronous conversion.
+ */
+texcaller_conversion *texcaller_conversion_start(const texcaller_context *context, const texcaller_job *job)
+{
+    texcaller_context temporary_context;
+    texcaller_conversion *conversion = (texcaller_conversion *)malloc(sizeof(texcaller_conversion));
+    if (conversion == NULL) {
+        return NULL;
+    }
+    if (context == NULL) {
+        context_init_temporary(&temporary_context, NULL);
+        context = &temporary_context;
+    }
+    conversion_begin(conversion, context, job, 1, NULL, 0);
+    return conversion;
+}
+
+/*! Get the file descriptor to watch for an asynchronous conversion.
+ */
+int texcaller_conversion_fd(const texcaller_conversion *conversion)
+{
+    return conversion->finished ? -1 : conversion->fd;
+}
+
+/*! Continue an asynchronous conversion.
+ */
+int texcaller_conversion_step(texcaller_conversion *conversion)
+{
+    if (conversion->finished) {
+        return 1;
+    }
+    /* try again to acquire a jobserver token */
+    if (conversion->awaiting_token) {
+        close(conversion->fd);
+        conversion->fd = -1;
+        conversion_spawn(conversion);
+        return conversion->finished;
+    }
+    /* read the TeX interpreter's output until it exits */
+    if (conversion_read(conversion) == 0) {
+        return 0;
+    }
+    conversion_continue(conversion);
+    return conversion->finished;
+}
+
+/*! Wait for an asynchronous conversion to finish.
+ */
+void texcaller_conversion_wait(texcaller_conversion *conversion)
+{
+    while (!texcaller_conversion_step(conversion)) {
+        struct pollfd pfd;
+        pfd.fd = conversion->fd;
+        pfd.events = POLLIN;
+        /* EINTR just leads to another step */
+        poll(&pfd, 1, -1);
+    }
+}
+
+/*! Finish an asynchronous conversion.
+ */
+void texcaller_conversion_finish(texcaller_conversion *conversion, char **result, size_t *result_size, char **info)
+{
+    conversion_end(conversion, result, result_size, info);
+    free(conversion);
+}
+
+/*! Listen for requests of remote clients.
+ */
+int texcaller_worker_listen(char **error, const char *address)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_size;
+    const int enabled = 1;
+    int fd;
+    if (resolve_address(error, &addr, &addr_size, address, 1) != 0) {
+        return -1;
+    }
+    fd = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        *error = sprintf_alloc("Unable to create socket for address \"%s\": %s.",
+                               address, strerror(errno));
+        return -1;
+    }
+    if (addr.ss_family == AF_UNIX) {
+        /* remove the socket of a previous worker */
+        const char *path = ((struct sockaddr_un *)&addr)->sun_path;
+        struct stat st;
+        if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(path);
+        }
+    } else {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+    }
+    if (   bind(fd, (const struct sockaddr *)&addr, addr_size) != 0
+        || listen(fd, SOMAXCONN) != 0) {
+        *error = sprintf_alloc("Unable to listen on address \"%s\": %s.",
+                               address, strerror(errno));
+        close(fd);
+        return -1;
     }
-    source_filename = sprintf_alloc("%s/texput.tex", dir);
-    if (source_filename == NULL) {
+    return fd;
+}
+
+/*! Serve a single request of a remote client.
+ */
+int texcaller_worker_serve(char **error, const texcaller_context *context, int fd)
+{
+    unsigned char header[REMOTE_REQUEST_HEADER_SIZE];
+    texcaller_context request_context;
+    texcaller_job job;
+    unsigned long value;
+    size_t secret_size;
+    char secret[REMOTE_MAX_NAME_SIZE];
+    size_t tenant_size;
+    char *tenant = NULL;
+    char *source = NULL;
+    char *result = NULL;
+    size_t result_size = 0;
+    char *info = NULL;
+    int status = -1;
+    *error = NULL;
+    set_socket_timeout(fd, context->options.worker_timeout);
+    /* receive request */
+    if (recv_all(fd, (char *)header, REMOTE_REQUEST_HEADER_SIZE) != 0) {
+        *error = sprintf_alloc("Unable to receive request: %s.",
+                               strerror(errno));
         goto cleanup;
     }
-    aux_filename = sprintf_alloc("%s/texput.aux", dir);
-    if (aux_filename == NULL) {
+    secret_size = get_uint32(header + 24);
+    tenant_size = get_uint32(header + 28);
+    if (   memcmp(header, REMOTE_MAGIC, 4) != 0
+        || secret_size > REMOTE_MAX_NAME_SIZE || tenant_size > REMOTE_MAX_NAME_SIZE) {
+        *error = sprintf_alloc("Invalid request.");
         goto cleanup;
     }
-    log_filename = sprintf_alloc("%s/texput.log", dir);
-    if (log_filename == NULL) {
+    if (recv_all(fd, secret, secret_size) != 0) {
+        *error = sprintf_alloc("Unable to receive request: %s.",
+                               strerror(errno));
         goto cleanup;
     }
-    if (strcmp(result_format, "DVI") == 0) {
-        result_filename = sprintf_alloc("%s/texput.dvi", dir);
-    } else {
-        result_filename = sprintf_alloc("%s/texput.pdf", dir);
+    /* authenticate before allocating anything */
+    if (context->options.worker_secret != NULL
+        ? !secret_matches(secret, secret_size, context->options.worker_secret)
+        : !socket_peer_is_local(fd)) {
+        *error = sprintf_alloc("Rejected request of an unauthenticated client.");
+        remote_respond(fd, NULL, 0, "Request rejected by remote worker, because the client is not authenticated.");
+        goto cleanup;
     }
-    if (result_filename == NULL) {
+    texcaller_job_init(&job);
+    /* invalid formats are reported by the conversion */
+    value = get_uint32(header + 4);
+    job.source_format = (texcaller_source_format)(value < SOURCE_FORMATS_COUNT ? value : SOURCE_FORMATS_COUNT);
+    value = get_uint32(header + 8);
+    job.result_format = (texcaller_result_format)(value < RESULT_FORMATS_COUNT ? value : RESULT_FORMATS_COUNT);
+    value = get_uint32(header + 12);
+    job.max_runs = value < 1000 ? (int)value : 1000;
+    request_context = *context;
+    request_context.options.workers = NULL;
+    request_context.workers = NULL;
+    request_context.workers_count = 0;
+    value = get_uint32(header + 16);
+    request_context.options.priority = value < 1000 ? (int)value : 1000;
+    value = get_uint32(header + 20);
+    request_context.options.tenant_weight = value < 1000 ? (int)value : 1000;
+    job.source_size = get_uint32(header + 32);
+    tenant = (char *)malloc(tenant_size + 1);
+    if (tenant == NULL) {
         goto cleanup;
     }
-    /* create source file */
-    if (write_file(&error, source_filename, source, source_size) != 0) {
-        *info = error;
+    if (recv_all(fd, tenant, tenant_size) != 0) {
+        *error = sprintf_alloc("Unable to receive request: %s.",
+                               strerror(errno));
         goto cleanup;
     }
-    /* run command as often as necessary */
-    for (runs = 1; runs <= max_runs; runs++) {
-        pid_t pid;
-        pid = fork();
-        if (pid == -1) {
-            *info = sprintf_alloc("Unable to fork child process: %s.",
-                                  strerror(errno));
-            goto cleanup;
-        }
-        /* child process */
-        if (pid == 0) {
-            /* run command within the temporary directory */
-            if (chdir(dir) != 0) {
-                exit(1);
-            }
-            /* prevent access to stdin, stdout and stderr */
-            fclose(stdin);
-            fclose(stdout);
-            fclose(stderr);
-            /* execute command */
-            execlp(cmd,
-                   cmd,
-                   "-interaction=batchmode",
-                   "-halt-on-error",
-                   "-file-line-error",
-                   "-no-shell-escape",
-                   "texput.tex",
-                   NULL);
-            /* exit if execlp() failed */
-            exit(1);
-        }
-        /* wait for child process */
-        for (;;) {
-            int status;
-            pid_t wpid = waitpid(pid, &status, 0);
-            if (wpid == -1) {
-                *info = sprintf_alloc("Unable to wait for child process: %s.",
-                                      strerror(errno));
-                goto cleanup;
-            }
-            if (WIFSIGNALED(status)) {
-                *info = sprintf_alloc("Command \"%s\" was terminated by signal %i.",
-                                      cmd, (int)WTERMSIG(status));
-                goto cleanup;
-            }
-            if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-                *info = sprintf_alloc("Command \"%s\" terminated with exit status %i.",
-                                      cmd, (int)WEXITSTATUS(status));
+    tenant[tenant_size] = '\0';
+    request_context.options.tenant = tenant_size == 0 ? NULL : tenant;
+    if (job.source_size > context->options.worker_max_source_size) {
+        /* skip the source, so that the client receives the response */
+        char skipped[4096];
+        size_t remaining;
+        size_t skipped_size;
+        for (remaining = job.source_size; remaining > 0; remaining -= skipped_size) {
+            skipped_size = remaining < sizeof(skipped) ? remaining : sizeof(skipped);
+            if (recv_all(fd, skipped, skipped_size) != 0) {
+                *error = sprintf_alloc("Unable to receive request: %s.",
+                                       strerror(errno));
                 goto cleanup;
             }
-            if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-                break;
-            }
         }
-        /* read new aux file, saving old one */
-        free(aux_old);
-        aux_old      = aux;
-        aux_old_size = aux_size;
-        read_file(&aux, &aux_size, &error, aux_filename);
-        /* tolerate missing aux file */
-        free(error);
-        /* check whether aux file stabilized,
-           which is also true if there isn't and wasn't any aux file */
-        if (aux_size == aux_old_size && memcmp(aux, aux_old, aux_size) == 0) {
-            read_file(result, result_size, &error, result_filename);
-            if (*result == NULL) {
-                *info = error;
-                goto cleanup;
-            }
-            *info = sprintf_alloc("Generated %s (%lu bytes)"
-                                  " from %s (%lu bytes) after %i runs.",
-                                  result_format, (unsigned long)*result_size,
-                                  source_format, (unsigned long)source_size, runs);
+        info = sprintf_alloc("Source of %lu bytes exceeds the limit of %lu bytes of the remote worker.",
+                             (unsigned long)job.source_size, (unsigned long)context->options.worker_max_source_size);
+    } else {
+        source = (char *)malloc(job.source_size + 1);
+        if (source == NULL) {
             goto cleanup;
         }
-    }
-    /* aux file didn't stabilize */
-    *info = sprintf_alloc("Output didn't stabilize after %i runs.",
-                          max_runs);
-    goto cleanup;
-    /* cleanup all used resources */
-cleanup:
-    if (log_filename != NULL) {
-        char *log;
-        size_t log_size;
-        read_file(&log, &log_size, &error, log_filename);
-        free(error);
-        if (log != NULL) {
-            if (*info == NULL) {
-                *info = log;
-            } else {
-                char *info_old = *info;
-                *info = sprintf_alloc("%s\n\n%s", info_old, log);
-                free(info_old);
-                free(log);
-            }
+        if (recv_all(fd, source, job.source_size) != 0) {
+            *error = sprintf_alloc("Unable to receive request: %s.",
+                                   strerror(errno));
+            goto cleanup;
         }
+        job.source = source;
+        /* convert locally */
+        texcaller_context_convert(&result, &result_size, &info, &request_context, &job);
     }
-    if (dir != NULL && remove_directory_recursively(&error, dir) != 0) {
-        free(*result);
-        *result = NULL;
-        *result_size = 0;
-        free(*info);
-        *info = error;
+    if (result_size > 0xffffffffUL) {
+        free(result);
+        result = NULL;
+        result_size = 0;
+        free(info);
+        info = sprintf_alloc("Result is too large for remote clients.");
     }
-    free(dir_template);
-    free(source_filename);
-    free(aux_filename);
-    free(log_filename);
-    free(result_filename);
-    free(aux);
-    free(aux_old);
+    /* send response */
+    if (remote_respond(fd, result, result_size, info) != 0) {
+        *error = sprintf_alloc("Unable to send response: %s.",
+                               strerror(errno));
+        goto cleanup;
+    }
+    status = 0;
+    goto cleanup;
+cleanup:
+    free(tenant);
+    free(source);
+    free(result);
+    free(info);
+    return status;
 }
 
 /*! Escape a string for direct use in LaTeX.
@@ -520,40 +8460,64 @@ cleanup:
 char *texcaller_escape_latex(const char *s)
 {
     char *escaped_string;
-    size_t i;
+    const size_t size = strlen(s);
     size_t length;
-    size_t pos;
     /* calculate result length */
-    length = 0;
-    for (i = 0; s[i] != '\0'; i++) {
-        const char *escaped_char = escape_latex_char(s[i]);
-        if (escaped_char == NULL) {
-            length++;
-        } else {
-            length += strlen(escaped_char);
-        }
-    }
+    length = escape_latex(NULL, s, size, 0);
     /* allocate memory for result */
     escaped_string = (char *)malloc(length + 1);
     if (escaped_string == NULL) {
         return NULL;
     }
     /* calculate result */
-    pos = 0;
-    for (i = 0; s[i] != '\0'; i++) {
-        const char *escaped_char = escape_latex_char(s[i]);
-        if (escaped_char == NULL) {
-            escaped_string[pos++] = s[i];
-        } else {
-            const size_t length = strlen(escaped_char);
-            memcpy(escaped_string + pos, escaped_char, length);
-            pos += length;
-        }
+    escape_latex(escaped_string, s, size, 0);
+    escaped_string[length] = '\0';
+    return escaped_string;
+}
+
+/*! Escape a string for direct use in a LaTeX document of a certain format.
+ */
+char *texcaller_escape_latex_for(const char *s, const char *source_format)
+{
+    char *escaped_string;
+    const size_t size = strlen(s);
+    size_t length;
+    int unicode_macros;
+    if (strcmp(source_format, "LaTeX") == 0) {
+        unicode_macros = 1;
+    } else if (strcmp(source_format, "XeLaTeX") == 0 || strcmp(source_format, "LuaLaTeX") == 0) {
+        unicode_macros = 0;
+    } else {
+        return NULL;
+    }
+    /* calculate result length */
+    length = escape_latex(NULL, s, size, unicode_macros);
+    /* allocate memory for result */
+    escaped_string = (char *)malloc(length + 1);
+    if (escaped_string == NULL) {
+        return NULL;
     }
-    escaped_string[pos] = '\0';
+    /* calculate result */
+    escape_latex(escaped_string, s, size, unicode_macros);
+    escaped_string[length] = '\0';
     return escaped_string;
 }
 
+/*! Escape a buffer for direct use in LaTeX, without allocating memory.
+ */
+size_t texcaller_escape_latex_buffer(char *result, const char *s, size_t size, const char *source_format)
+{
+    int unicode_macros;
+    if (source_format == NULL || strcmp(source_format, "XeLaTeX") == 0 || strcmp(source_format, "LuaLaTeX") == 0) {
+        unicode_macros = 0;
+    } else if (strcmp(source_format, "LaTeX") == 0) {
+        unicode_macros = 1;
+    } else {
+        return (size_t)-1;
+    }
+    return escape_latex(result, s, size, unicode_macros);
+}
+
 /*!  @} */
 
 #ifdef __cplusplus
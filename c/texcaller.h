@@ -214,7 +214,7 @@ cc -o example example.c `pkg-config texcaller --cflags --libs`
  *  However, don't hard code that into your build system!
  *
  *  \code
-cc -o example example.c -ltexcaller
+cc -o example example.c -ltexcaller -pthread
  *  \endcode
  *
  *  @{
@@ -222,7 +222,8 @@ cc -o example example.c -ltexcaller
 
 /*! Convert a TeX or LaTeX source to DVI or PDF.
  *
- *  This function is reentrant.
+ *  This function is reentrant and thread-safe,
+ *  that is, it may be called concurrently from multiple threads.
  *  Temporary files are always cleaned up.
  *  The TeX interpreter is automatically re-run as often as necessary
  *  until the output becomes stable.
@@ -234,6 +235,20 @@ cc -o example example.c -ltexcaller
  *  Instead, all important information is simply collected
  *  in the \c info string.
  *
+ *  The interpreter is started via \c posix_spawn() where possible,
+ *  otherwise via \c fork(),
+ *  in which case the child process calls only async-signal-safe functions
+ *  before \c exec(),
+ *  so this is safe in multi-threaded processes, too.
+ *  All files opened by this library are marked close-on-exec,
+ *  so they don't leak into commands started by other threads.
+ *  The \c TMPDIR and \c PATH environment variables
+ *  are read only once, on first use.
+ *  Note that the calling process must not reap child processes
+ *  it didn't start itself,
+ *  e.g. via \c waitpid(-1, ...) in a \c SIGCHLD handler
+ *  or by ignoring \c SIGCHLD.
+ *
  *  \param result
  *      will be set to a newly allocated buffer that contains
  *      the generated document,
@@ -278,6 +293,1223 @@ cc -o example example.c -ltexcaller
  */
 void texcaller_convert(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs);
 
+/*! Priority class for interactive conversions,
+ *  such as previews a user is waiting for.
+ */
+#define TEXCALLER_PRIORITY_INTERACTIVE 0
+
+/*! Priority class for normal conversions (the default).
+ */
+#define TEXCALLER_PRIORITY_NORMAL 1
+
+/*! Priority class for bulk conversions nobody is waiting for.
+ */
+#define TEXCALLER_PRIORITY_BATCH 2
+
+/*! An additional output of texcaller_convert_with_options(),
+ *  such as a preview image of a page.
+ *
+ *  See texcaller_options::outputs.
+ */
+typedef struct texcaller_output
+{
+    /*! Format of the output,
+     *  must be one of:
+     *  - \c "PNG" (via \c pdftocairo, or \c dvipng for DVI results)
+     *  - \c "SVG" (via \c pdftocairo, or \c dvisvgm for DVI results)
+     */
+    const char *format;
+
+    /*! Page to convert, starting at 1.
+     */
+    int page;
+
+    /*! Resolution in DPI for \c "PNG", or 0 for the default of 150 DPI.
+     */
+    int resolution;
+
+    /*! Will be set to a newly allocated buffer that contains
+     *  the generated output,
+     *  or \c NULL if the conversion failed.
+     */
+    char *result;
+
+    /*! Will be set to the size of \c result,
+     *  or 0 if \c result is \c NULL.
+     */
+    size_t result_size;
+} texcaller_output;
+
+/*! A part of a document, included via <tt>\\include{name}</tt>.
+ *
+ *  See texcaller_options::parts.
+ */
+typedef struct texcaller_part
+{
+    /*! Name of the part, as passed to <tt>\\include</tt>.
+     *  It must not be empty, start with a dot
+     *  or contain a slash.
+     */
+    const char *name;
+
+    /*! Source of the part,
+     *  which is written to \c name<tt>.tex</tt>
+     *  next to the main document.
+     */
+    const char *source;
+
+    /*! Size of \c source.
+     */
+    size_t source_size;
+} texcaller_part;
+
+/*! Additional options for texcaller_convert_with_options().
+ *
+ *  Always initialize this structure with texcaller_options_init()
+ *  before setting any fields,
+ *  so that fields added in future versions get sensible defaults.
+ */
+typedef struct texcaller_options
+{
+    /*! Directory for remembering which files the TeX interpreter reads,
+     *  or \c NULL (the default) to disable prefetching.
+     *
+     *  If set, the TeX interpreter is run with \c -recorder,
+     *  and the input files it reported
+     *  (such as \c .sty, \c .tfm, \c .pfb and \c .fmt files)
+     *  are remembered in this directory,
+     *  separately for each command and document preamble.
+     *  Before the next conversion with the same command and preamble,
+     *  these files are prefetched into the page cache
+     *  via \c posix_fadvise(),
+     *  so that the TeX interpreter doesn't have to wait for
+     *  cold storage file by file.
+     *  Each list keeps the 1024 files read most recently.
+     *  The info reports how many files were prefetched,
+     *  how much of them wasn't cached yet,
+     *  and how many of them the TeX interpreter actually read.
+     *
+     *  The directory must exist and be writable.
+     *  It may be shared by concurrent conversions and processes.
+     */
+    const char *prefetch_dir;
+
+    /*! Directory for keeping auxiliary files of previous conversions,
+     *  or \c NULL (the default) to disable seeding.
+     *
+     *  If set, the final \c .aux, \c .toc and \c .out files
+     *  of each successful conversion are kept in this directory,
+     *  keyed by the command and the structure of the document,
+     *  that is, the sequence of its control words
+     *  (such as \c \\section or \c \\label)
+     *  regardless of the text in between.
+     *  The next conversion of a document with the same key
+     *  starts with these files instead of an empty directory.
+     *  Since the usual check for a stabilized \c .aux file still applies,
+     *  the result is the same as without seeding,
+     *  but documents generated from the same template
+     *  often need one TeX run less.
+     *
+     *  The directory must exist and be writable.
+     *  It may be shared by concurrent conversions and processes.
+     */
+    const char *seed_dir;
+
+    /*! Additional outputs to generate from the result document,
+     *  or \c NULL (the default) for none.
+     *
+     *  These are generated from the same temporary directory
+     *  after the TeX interpreter's output has stabilized,
+     *  so the document is typeset only once for all outputs.
+     *  The necessary conversion tools are run in parallel.
+     *  If any of them fails, the whole conversion fails,
+     *  and \c result as well as all \c outputs[i].result
+     *  are set to \c NULL.
+     *  Otherwise, the caller has to free all \c outputs[i].result.
+     */
+    texcaller_output *outputs;
+
+    /*! Number of elements in \c outputs,
+     *  0 by default.
+     */
+    int outputs_count;
+
+    /*! Parts of the document, or \c NULL (the default) for none.
+     *
+     *  The main document includes these
+     *  via <tt>\\include{name}</tt> after <tt>\\begin{document}</tt>.
+     *  The TeX interpreter is run until the \c .aux files
+     *  of the main document and of all parts have stabilized.
+     *  See \c parallel_parts to compile the parts in parallel.
+     */
+    const texcaller_part *parts;
+
+    /*! Number of elements in \c parts,
+     *  0 by default.
+     */
+    int parts_count;
+
+    /*! Whether to remove the temporary directory in the background,
+     *  0 (the default) or 1.
+     *
+     *  If set, the temporary directory is moved into a trash directory
+     *  within the same \c TMPDIR,
+     *  and removed by a background thread,
+     *  so the caller doesn't have to wait for that.
+     *  The background thread also cleans up
+     *  the trash and temporary directories
+     *  left behind by crashed processes.
+     *  Note that errors during background removal can't be reported.
+     */
+    int deferred_cleanup;
+
+    /*! Whether to reuse emptied temporary directories,
+     *  0 (the default) or 1.
+     *
+     *  If set, the temporary directory is cleaned up
+     *  as with \c deferred_cleanup,
+     *  but afterwards kept for reuse by later conversions
+     *  within the same process,
+     *  which saves creating and removing a directory per conversion.
+     */
+    int recycle_workspaces;
+
+    /*! Priority class of this conversion,
+     *  one of \c TEXCALLER_PRIORITY_INTERACTIVE,
+     *  \c TEXCALLER_PRIORITY_NORMAL (the default)
+     *  or \c TEXCALLER_PRIORITY_BATCH.
+     *
+     *  When conversions have to wait for the scheduler
+     *  (see texcaller_scheduler_configure()),
+     *  all waiting conversions of a higher priority class
+     *  are started before any of a lower priority class.
+     */
+    int priority;
+
+    /*! Name of the tenant on whose behalf this conversion runs,
+     *  or \c NULL (the default) for the anonymous tenant.
+     *
+     *  Within the same priority class,
+     *  the scheduler shares the available slots
+     *  fairly between tenants according to their \c tenant_weight,
+     *  so a tenant with many waiting conversions
+     *  can't starve the others.
+     */
+    const char *tenant;
+
+    /*! Weight of the tenant, must be ≥ 1, 1 by default.
+     *
+     *  A tenant with weight 2 gets twice as many slots
+     *  as a tenant with weight 1.
+     */
+    int tenant_weight;
+
+    /*! Comma-separated list of remote worker addresses,
+     *  or \c NULL (the default) to convert locally.
+     *
+     *  Each address is either <tt>unix:PATH</tt> for a Unix domain socket,
+     *  or <tt>HOST:PORT</tt> for TCP,
+     *  where an IPv6 \c HOST is enclosed in brackets.
+     *  The workers are processes that serve conversions
+     *  via texcaller_worker_serve(),
+     *  such as <tt>texcaller \--listen ADDRESS</tt>
+     *  (see \ref shell).
+     *
+     *  If set, the source is sent to the worker
+     *  with the fewest pending conversions of this process,
+     *  and if that's a tie, to the one that reported the shortest queue.
+     *  If the worker can't be reached within a few seconds,
+     *  drops the connection or exceeds \c worker_timeout,
+     *  the conversion is retried on the next worker,
+     *  and the failed worker is avoided for a few seconds.
+     *  Failed conversions are not retried,
+     *  because they would fail on any worker.
+     *
+     *  The \c priority, \c tenant and \c tenant_weight
+     *  are passed on to the worker's scheduler,
+     *  whereas all other options are those of the worker.
+     *  Additional \c outputs, \c parts and codecs are not supported.
+     */
+    const char *workers;
+
+    /*! Seconds to wait for each send and receive on a worker connection,
+     *  or 0 to wait forever.
+     *  The default is 300.
+     *
+     *  This applies to clients, where a response only arrives
+     *  once the worker has finished the conversion,
+     *  so it must exceed the longest expected conversion,
+     *  as well as to texcaller_worker_serve(),
+     *  where it bounds how long a slow client may hold a connection.
+     */
+    int worker_timeout;
+
+    /*! Shared secret that authenticates clients to workers,
+     *  or \c NULL (the default) for none.
+     *
+     *  Clients send it along with each request,
+     *  and texcaller_worker_serve() rejects requests
+     *  that don't carry the worker's secret.
+     *  Without a secret, a worker only serves clients
+     *  connected via a Unix domain socket or the loopback interface.
+     *  The secret is sent in plain text,
+     *  so TCP workers belong in a trusted network or behind a tunnel.
+     */
+    const char *worker_secret;
+
+    /*! Maximum size of a source accepted by texcaller_worker_serve(),
+     *  in bytes.
+     *  The default is 64 MiB.
+     *
+     *  Larger requests are answered with a failed conversion
+     *  before the worker allocates any memory for them.
+     */
+    size_t worker_max_source_size;
+
+    /*! Whether to generate the PDF only in the last TeX run,
+     *  0 (the default) or 1.
+     *
+     *  If set, the TeX interpreter runs with \c -draftmode
+     *  (or \c -no-pdf for XeTeX)
+     *  until the \c .aux file has stabilized,
+     *  which skips embedding images and fonts,
+     *  and then once more to generate the PDF.
+     *  The result is the same as without draft mode,
+     *  but since that final run is an additional one
+     *  (not counted in \c max_runs),
+     *  this only pays off for documents
+     *  that are expensive to write out.
+     *  DVI results are not affected.
+     */
+    int draft_mode;
+
+    /*! Directory for the font caches of the TeX interpreters,
+     *  or \c NULL (the default) to use the caches of the user.
+     *
+     *  If set, \c TEXMFVAR, \c TEXMFCACHE and \c XDG_CACHE_HOME
+     *  of the TeX interpreters point into this directory,
+     *  so the font name database of LuaTeX (luaotfload)
+     *  and the fontconfig cache of XeTeX
+     *  are built once and then shared by all conversions,
+     *  regardless of the user and \c HOME of the calling process.
+     *  Note that formats generated by the user via \c fmtutil
+     *  are not found this way,
+     *  but the system-wide formats are.
+     *
+     *  Building the caches may take minutes.
+     *  Until the first conversion of a TeX interpreter succeeds,
+     *  its conversions using this directory wait for each other,
+     *  so that the caches are built only once.
+     *  To keep this off the latency path, call texcaller_warm_up()
+     *  before the first conversion.
+     *  The info message of each conversion
+     *  reports whether it built the caches.
+     *
+     *  The directory must exist and be writable.
+     *  It may be shared by concurrent conversions and processes.
+     */
+    const char *cache_dir;
+
+    /*! Whether to profile the TeX runs,
+     *  0 (the default) or 1.
+     *
+     *  If set, the TeX interpreter runs in \c nonstopmode
+     *  instead of \c batchmode,
+     *  and its terminal output is traced while it runs,
+     *  to measure the time spent on each package, class, font
+     *  and other file it reads.
+     *  On success, the info message ends with a report
+     *  of the files that took the most time,
+     *  and of the time each TeX run spent in the preamble
+     *  and in the document body.
+     *
+     *  The times are wall-clock times
+     *  and only as precise as the TeX interpreter
+     *  flushes its terminal output,
+     *  so they are meant to find the expensive parts of a preamble,
+     *  not to benchmark them.
+     *  Conversions on remote \c workers are not profiled.
+     */
+    int profile;
+
+    /*! Whether to compile the \c parts in parallel,
+     *  0 (the default) or 1.
+     *
+     *  If set, a LaTeX document with at least two \c parts
+     *  is first run once as a whole in draft mode,
+     *  to collect the cross-references and page numbers
+     *  of all parts in the \c .aux files.
+     *  Then each part is compiled in its own temporary directory,
+     *  starting from these \c .aux files,
+     *  with <tt>\\includeonly</tt> set to that part,
+     *  so it is typeset with the correct page numbers
+     *  and references into the other parts.
+     *  All these compilations run concurrently,
+     *  subject to the scheduler and the jobserver,
+     *  along with two single runs without any parts
+     *  which tell the number of pages of the front and back matter.
+     *  Finally, the PDF pages of all parts
+     *  are assembled into the result via \c qpdf,
+     *  which has to be in \c PATH.
+     *
+     *  This takes more CPU time than a serial compilation,
+     *  but on a multi-core host the wall time
+     *  is close to that of the largest part.
+     *  Pages between two <tt>\\include</tt> directives
+     *  are not supported,
+     *  and changes of the page count of the front matter
+     *  after the first run may shift the assembled pages,
+     *  so this is meant for documents that consist of
+     *  a short front matter followed by many large parts.
+     *  Documents with fewer than two parts,
+     *  DVI results, additional \c outputs
+     *  and \c profile are compiled serially.
+     */
+    int parallel_parts;
+
+    /*! Number of pages to typeset as a quick preview,
+     *  or 0 (the default) to typeset the whole document.
+     *
+     *  If set, the TeX interpreter is stopped
+     *  as soon as this many pages have been shipped out,
+     *  and the result only contains these pages,
+     *  so the latency doesn't depend on the length of the document.
+     *  Only a single TeX run is done, unless \c preview_reruns is set,
+     *  so cross-references may be unresolved,
+     *  unless \c seed_dir provides the auxiliary files
+     *  of a previous complete conversion.
+     *  \c draft_mode is ignored.
+     *  If the document has been stopped early,
+     *  the info message says "Truncated preview after N pages."
+     *  and the \c texcaller_truncated_previews_total metric is increased
+     *  (see texcaller_metrics_snapshot()),
+     *  and neither prefetch lists nor seeds are updated.
+     *  Documents with exactly this number of pages
+     *  count as truncated as well.
+     *  Parts are compiled serially.
+     */
+    int preview_pages;
+
+    /*! Whether to run the TeX interpreter in preview mode
+     *  until the \c .aux file has stabilized,
+     *  as for complete documents,
+     *  0 (the default) or 1,
+     *  see \c preview_pages.
+     */
+    int preview_reruns;
+
+    /*! Compression of the \c source,
+     *  \c "identity" (the same as \c NULL, the default),
+     *  \c "gzip" or \c "zstd",
+     *  see texcaller_job::source_codec.
+     */
+    const char *source_codec;
+
+    /*! Compression of the \c result,
+     *  \c "identity" (the same as \c NULL, the default),
+     *  \c "gzip" or \c "zstd",
+     *  see texcaller_job::result_codec.
+     */
+    const char *result_codec;
+} texcaller_options;
+
+/*! Build the font caches before the first conversion.
+ *
+ *  This function is reentrant and thread-safe.
+ *  It converts a small document that looks up fonts by name
+ *  with the TeX interpreter for \c source_format,
+ *  which builds the caches in texcaller_options::cache_dir,
+ *  or the caches of the user if that is \c NULL.
+ *  Remote workers are not affected,
+ *  as they have their own caches.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param info
+ *      Will be set to a newly allocated string that contains
+ *      the info message of the conversion,
+ *      including its duration,
+ *      or the error message on failure.
+ *      The caller has to free it.
+ *      When out of memory, \c info will be set to \c NULL.
+ *
+ *  \param source_format
+ *      source format of the subsequent conversions,
+ *      see texcaller_convert()
+ *
+ *  \param options
+ *      options of the subsequent conversions,
+ *      or \c NULL for the default values
+ */
+int texcaller_warm_up(char **info, const char *source_format, const texcaller_options *options);
+
+/*! Initialize \c options with the default values.
+ *
+ *  With these, texcaller_convert_with_options()
+ *  behaves exactly like texcaller_convert().
+ *
+ *  \param options
+ *      the options to initialize
+ */
+void texcaller_options_init(texcaller_options *options);
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, using additional options.
+ *
+ *  This function is reentrant and thread-safe.
+ *  It works like texcaller_convert(),
+ *  but takes an additional argument:
+ *
+ *  \param options
+ *      additional options, initialized via texcaller_options_init(),
+ *      or \c NULL for the default values
+ *
+ *  All other parameters and the result
+ *  are the same as for texcaller_convert().
+ *
+ *  For many conversions with the same options,
+ *  texcaller_context_convert() avoids repeating the setup.
+ */
+void texcaller_convert_with_options(char **result, size_t *result_size, char **info, const char *source, size_t source_size, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options);
+
+/*! Convert a TeX or LaTeX source read from a file descriptor.
+ *
+ *  This function is reentrant and thread-safe.
+ *  It works like texcaller_convert_with_options(),
+ *  but reads the source from the current position of \c source_fd
+ *  until end of file,
+ *  without holding it in memory,
+ *  so it is meant for large sources in files or pipes,
+ *  see texcaller_job::source_fd.
+ *
+ *  \param source_fd
+ *      file descriptor to read the source from, which is not closed
+ *
+ *  All other parameters and the result
+ *  are the same as for texcaller_convert_with_options().
+ */
+void texcaller_convert_fd(char **result, size_t *result_size, char **info, int source_fd, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options);
+
+/*! Convert a TeX or LaTeX source file.
+ *
+ *  This function is reentrant and thread-safe.
+ *  It works like texcaller_convert_fd(),
+ *  but takes the path of the source file,
+ *  which is hard linked into the temporary directory where possible,
+ *  see texcaller_job::source_path.
+ *
+ *  \param source_path
+ *      path of the source file
+ *
+ *  All other parameters and the result
+ *  are the same as for texcaller_convert_with_options().
+ */
+void texcaller_convert_path(char **result, size_t *result_size, char **info, const char *source_path, const char *source_format, const char *result_format, int max_runs, const texcaller_options *options);
+
+/*! Source format of a ::texcaller_job.
+ */
+typedef enum texcaller_source_format
+{
+    TEXCALLER_TEX,      /*!< same as \c "TeX" */
+    TEXCALLER_LATEX,    /*!< same as \c "LaTeX" */
+    TEXCALLER_XETEX,    /*!< same as \c "XeTeX" */
+    TEXCALLER_XELATEX,  /*!< same as \c "XeLaTeX" */
+    TEXCALLER_LUATEX,   /*!< same as \c "LuaTeX" */
+    TEXCALLER_LUALATEX  /*!< same as \c "LuaLaTeX" */
+} texcaller_source_format;
+
+/*! Result format of a ::texcaller_job.
+ */
+typedef enum texcaller_result_format
+{
+    TEXCALLER_DVI,  /*!< same as \c "DVI" */
+    TEXCALLER_PDF   /*!< same as \c "PDF" */
+} texcaller_result_format;
+
+/*! Compression of the source or the result of a ::texcaller_job.
+ */
+typedef enum texcaller_codec
+{
+    TEXCALLER_IDENTITY,  /*!< same as \c "identity", uncompressed */
+    TEXCALLER_GZIP,      /*!< same as \c "gzip" */
+    TEXCALLER_ZSTD       /*!< same as \c "zstd" */
+} texcaller_codec;
+
+/*! A single conversion for texcaller_context_convert().
+ *
+ *  Always initialize this structure with texcaller_job_init()
+ *  before setting any fields,
+ *  so that fields added in future versions get sensible defaults.
+ */
+typedef struct texcaller_job
+{
+    /*! The source to convert, \c NULL by default.
+     */
+    const char *source;
+
+    /*! Size of \c source, 0 by default.
+     */
+    size_t source_size;
+
+    /*! Format of \c source, \c TEXCALLER_LATEX by default.
+     */
+    texcaller_source_format source_format;
+
+    /*! Format of the result,
+     *  \c TEXCALLER_PDF by default.
+     *  \c TEXCALLER_DVI is only supported
+     *  for \c TEXCALLER_TEX and \c TEXCALLER_LATEX.
+     */
+    texcaller_result_format result_format;
+
+    /*! Maximum number of TeX runs,
+     *  must be ≥ 2, 5 by default.
+     */
+    int max_runs;
+
+    /*! Additional outputs to generate from the result document,
+     *  or \c NULL (the default) for none,
+     *  see texcaller_options::outputs.
+     */
+    texcaller_output *outputs;
+
+    /*! Number of elements in \c outputs,
+     *  0 by default.
+     */
+    int outputs_count;
+
+    /*! Parts of the document, or \c NULL (the default) for none,
+     *  see texcaller_options::parts.
+     */
+    const texcaller_part *parts;
+
+    /*! Number of elements in \c parts,
+     *  0 by default.
+     */
+    int parts_count;
+
+    /*! Compression of \c source,
+     *  \c TEXCALLER_IDENTITY by default.
+     *
+     *  A compressed source is written to the temporary directory as it is,
+     *  and decompressed right into the file read by the TeX interpreter
+     *  via \c gzip or \c zstd, which has to be in \c PATH,
+     *  so the uncompressed source is never held in memory.
+     *  The texcaller_options::prefetch_dir and texcaller_options::seed_dir
+     *  are ignored for compressed sources,
+     *  because they need the uncompressed source.
+     *  The \c parts are always uncompressed.
+     */
+    texcaller_codec source_codec;
+
+    /*! Compression of the result,
+     *  \c TEXCALLER_IDENTITY by default.
+     *
+     *  The result file is compressed via \c gzip or \c zstd,
+     *  which has to be in \c PATH,
+     *  before it is read into memory,
+     *  so the uncompressed result is never held in memory.
+     *  Additional outputs are never compressed.
+     *
+     *  Codecs other than \c TEXCALLER_IDENTITY
+     *  are not supported by remote workers, batches
+     *  and asynchronous conversions,
+     *  and disable texcaller_options::parallel_parts.
+     */
+    texcaller_codec result_codec;
+
+    /*! File descriptor to read the source from,
+     *  instead of \c source,
+     *  or -1 (the default).
+     *
+     *  The source is read from the current position until end of file
+     *  straight into the temporary directory,
+     *  so it is never held in memory.
+     *  A regular file read from its beginning is shared via a reflink
+     *  on filesystems that support it,
+     *  and otherwise copied by the kernel via \c copy_file_range(),
+     *  whereas pipes and sockets are copied in small chunks.
+     *  The file descriptor is not closed.
+     *
+     *  As with compressed sources (see \c source_codec),
+     *  texcaller_options::prefetch_dir and texcaller_options::seed_dir
+     *  are ignored,
+     *  and batches are not supported.
+     *  Remote workers and texcaller_options::parallel_parts
+     *  need the source in memory, so they read it first.
+     */
+    int source_fd;
+
+    /*! Path of the source file,
+     *  instead of \c source,
+     *  or \c NULL (the default).
+     *
+     *  The file is hard linked into the temporary directory
+     *  if it is on the same filesystem and the link is permitted,
+     *  which doesn't copy anything.
+     *  Otherwise, it is copied like \c source_fd.
+     *  In either case, the file must not be modified during the conversion.
+     *  Takes precedence over \c source_fd.
+     */
+    const char *source_path;
+} texcaller_job;
+
+/*! Initialize \c job with the default values.
+ *
+ *  \param job
+ *      the job to initialize
+ */
+void texcaller_job_init(texcaller_job *job);
+
+/*! Settings shared by multiple conversions,
+ *  created by texcaller_context_create().
+ */
+typedef struct texcaller_context texcaller_context;
+
+/*! Create a context for multiple conversions.
+ *
+ *  All setup that doesn't depend on the actual document
+ *  is done here once,
+ *  instead of once per conversion as in texcaller_convert_with_options().
+ *  In particular, all TeX interpreters are searched in \c PATH,
+ *  so later conversions run them directly by their full path.
+ *  Interpreters that are not installed
+ *  are reported by conversions that would need them.
+ *  Changes to \c PATH or to the installed TeX distribution
+ *  take effect only for contexts created afterwards.
+ *
+ *  A context is not modified by conversions,
+ *  so it may be shared by any number of threads
+ *  until it is destroyed.
+ *
+ *  This function is thread-safe.
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param options
+ *      options of all conversions within this context,
+ *      initialized via texcaller_options_init(),
+ *      or \c NULL for the default values.
+ *      The strings are copied, so they may be freed afterwards.
+ *      Additional outputs and parts have to be set per ::texcaller_job instead,
+ *      so texcaller_options::outputs_count
+ *      and texcaller_options::parts_count must be 0.
+ *
+ *  \return
+ *      the new context,
+ *      to be freed via texcaller_context_destroy(),
+ *      or \c NULL on failure.
+ */
+texcaller_context *texcaller_context_create(char **error, const texcaller_options *options);
+
+/*! Destroy a context created by texcaller_context_create().
+ *
+ *  \param context
+ *      the context to destroy, or \c NULL
+ */
+void texcaller_context_destroy(texcaller_context *context);
+
+/*! Convert a TeX or LaTeX source to DVI or PDF within a context.
+ *
+ *  This function is reentrant and thread-safe.
+ *  It works like texcaller_convert_with_options(),
+ *  with the options of the \c context,
+ *  but the document and its formats given by \c job.
+ *
+ *  \param result
+ *      see texcaller_convert()
+ *
+ *  \param result_size
+ *      see texcaller_convert()
+ *
+ *  \param info
+ *      see texcaller_convert()
+ *
+ *  \param context
+ *      the context, created by texcaller_context_create(),
+ *      or \c NULL for the default options
+ *
+ *  \param job
+ *      the conversion, initialized via texcaller_job_init()
+ */
+void texcaller_context_convert(char **result, size_t *result_size, char **info, const texcaller_context *context, const texcaller_job *job);
+
+/*! A document of a batch, see texcaller_context_convert_batch().
+ */
+typedef struct texcaller_batch_document
+{
+    /*! Body of the document,
+     *  without <tt>\\begin{document}</tt> and <tt>\\end{document}</tt>.
+     */
+    const char *body;
+
+    /*! Size of \c body.
+     */
+    size_t body_size;
+
+    /*! Will be set to a newly allocated buffer that contains
+     *  the PDF of this document,
+     *  or \c NULL if its conversion failed.
+     */
+    char *result;
+
+    /*! Will be set to the size of \c result,
+     *  or 0 if \c result is \c NULL.
+     */
+    size_t result_size;
+
+    /*! Will be set to a newly allocated string
+     *  that contains the info message of this document,
+     *  see texcaller_convert(),
+     *  or \c NULL when out of memory.
+     */
+    char *info;
+} texcaller_batch_document;
+
+/*! Convert many small LaTeX documents with the same preamble
+ *  in a single conversion.
+ *
+ *  This function is reentrant and thread-safe.
+ *  It is meant for many short documents from the same template,
+ *  such as letters,
+ *  whose conversion time is dominated by starting the TeX interpreter
+ *  and loading the preamble.
+ *  All bodies are typeset one after another
+ *  as a single document with the shared preamble,
+ *  and the resulting PDF is split into one PDF per document
+ *  via \c qpdf, which has to be in \c PATH.
+ *
+ *  Each body starts on a new page within its own group,
+ *  so local definitions don't leak into the next document,
+ *  and with all LaTeX counters and the page numbering
+ *  as they were at <tt>\\begin{document}</tt>,
+ *  so footnotes, equations, sections and pages
+ *  are numbered as if the document had been converted alone.
+ *  The pages of each body are counted as they are shipped out,
+ *  so bodies may change the page numbering,
+ *  e.g. via <tt>\\pagenumbering</tt> or a \c titlepage.
+ *  Bodies containing <tt>\\label</tt>,
+ *  whose labels would collide with those of other bodies,
+ *  are converted alone,
+ *  as are all documents if the preamble loads \c hyperref,
+ *  whose link targets would collide.
+ *  Other global definitions within the bodies
+ *  are not undone between the documents.
+ *
+ *  If the batch fails,
+ *  the document containing the error is converted alone,
+ *  which yields its own info message,
+ *  and the batch is retried without it.
+ *  If the error can't be attributed to a document,
+ *  all remaining documents are converted one by one.
+ *  An error in the preamble fails all documents.
+ *
+ *  \param info
+ *      will be set to a newly allocated string
+ *      that summarizes the batch,
+ *      or \c NULL when out of memory
+ *
+ *  \param context
+ *      the context, created by texcaller_context_create(),
+ *      or \c NULL for the default options
+ *
+ *  \param job
+ *      the conversion, initialized via texcaller_job_init(),
+ *      whose \c source is the preamble shared by all documents,
+ *      up to but excluding <tt>\\begin{document}</tt>,
+ *      and whose result format must be \c TEXCALLER_PDF
+ *
+ *  \param documents
+ *      the documents,
+ *      whose \c result, \c result_size and \c info will be set
+ *      and have to be freed by the caller
+ *
+ *  \param documents_count
+ *      number of elements in \c documents
+ */
+void texcaller_context_convert_batch(char **info, const texcaller_context *context, const texcaller_job *job, texcaller_batch_document *documents, int documents_count);
+
+/*! A conversion in progress,
+ *  started by texcaller_conversion_start().
+ */
+typedef struct texcaller_conversion texcaller_conversion;
+
+/*! Start an asynchronous conversion.
+ *
+ *  This is meant for event loops,
+ *  which run many conversions without a thread per conversion.
+ *  It works like texcaller_context_convert(),
+ *  but returns right after starting the first TeX run.
+ *  The event loop watches texcaller_conversion_fd() for readability,
+ *  which happens when the TeX interpreter exits,
+ *  and then calls texcaller_conversion_step()
+ *  to start the next TeX run if necessary.
+ *  When the conversion has finished,
+ *  or to cancel it,
+ *  the event loop calls texcaller_conversion_finish().
+ *
+ *  Asynchronous conversions are queued by the scheduler
+ *  (see texcaller_scheduler_configure())
+ *  along with all other conversions, by priority and tenant,
+ *  but without blocking:
+ *  While waiting, texcaller_conversion_fd() becomes readable
+ *  when it's their turn to start the first TeX run.
+ *  Additional outputs, codecs and remote workers are not supported.
+ *
+ *  This function is thread-safe.
+ *  Each conversion must only be used by one thread at a time.
+ *
+ *  \param context
+ *      the context, created by texcaller_context_create(),
+ *      or \c NULL for the default options.
+ *      It is only used by this function,
+ *      so it may be destroyed while the conversion is in progress.
+ *
+ *  \param job
+ *      the conversion, initialized via texcaller_job_init().
+ *      The source is copied into the temporary directory right away.
+ *
+ *  \return
+ *      the conversion in progress,
+ *      to be freed via texcaller_conversion_finish(),
+ *      or \c NULL when out of memory.
+ *      Errors are reported by texcaller_conversion_finish().
+ */
+texcaller_conversion *texcaller_conversion_start(const texcaller_context *context, const texcaller_job *job);
+
+/*! Get the file descriptor to watch for an asynchronous conversion.
+ *
+ *  This is the read end of a pipe connected to the TeX interpreter's stdout,
+ *  which becomes readable when the TeX interpreter exits.
+ *  It is a different file descriptor for each TeX run,
+ *  so it has to be queried again after each texcaller_conversion_step().
+ *
+ *  \param conversion
+ *      the conversion
+ *
+ *  \return
+ *      the file descriptor,
+ *      or -1 if the conversion has finished
+ */
+int texcaller_conversion_fd(const texcaller_conversion *conversion);
+
+/*! Continue an asynchronous conversion.
+ *
+ *  This never blocks.
+ *  Call it whenever texcaller_conversion_fd() is readable.
+ *
+ *  \param conversion
+ *      the conversion
+ *
+ *  \return
+ *      1 if the conversion has finished, 0 otherwise
+ */
+int texcaller_conversion_step(texcaller_conversion *conversion);
+
+/*! Wait for an asynchronous conversion to finish.
+ *
+ *  This blocks until the last TeX run exits,
+ *  starting further TeX runs as needed,
+ *  like texcaller_conversion_step() in a loop
+ *  that waits for texcaller_conversion_fd().
+ *  Afterwards, call texcaller_conversion_finish().
+ *
+ *  \param conversion
+ *      the conversion
+ */
+void texcaller_conversion_wait(texcaller_conversion *conversion);
+
+/*! Finish an asynchronous conversion.
+ *
+ *  If the conversion hasn't finished yet,
+ *  it is cancelled,
+ *  that is, the TeX interpreter is killed.
+ *  In any case, the temporary directory is cleaned up
+ *  and \c conversion is freed.
+ *
+ *  \param conversion
+ *      the conversion
+ *
+ *  \param result
+ *      see texcaller_convert()
+ *
+ *  \param result_size
+ *      see texcaller_convert()
+ *
+ *  \param info
+ *      see texcaller_convert()
+ */
+void texcaller_conversion_finish(texcaller_conversion *conversion, char **result, size_t *result_size, char **info);
+
+/*! Configure the scheduler for concurrent conversions
+ *  within the current process.
+ *
+ *  By default, the scheduler is disabled,
+ *  so all conversions start immediately.
+ *  Otherwise, at most \c max_running conversions run at the same time,
+ *  and further conversions wait in a queue,
+ *  ordered by their texcaller_options::priority
+ *  and shared fairly between their texcaller_options::tenant.
+ *  The time spent waiting and running is reported in the \c info string.
+ *
+ *  This function is thread-safe.
+ *
+ *  \param max_running
+ *      maximum number of conversions running at the same time,
+ *      or 0 to disable the scheduler
+ *
+ *  \param max_queued
+ *      maximum number of waiting conversions,
+ *      or 0 for no limit.
+ *      If the queue is full, further conversions fail immediately.
+ */
+void texcaller_scheduler_configure(int max_running, int max_queued);
+
+/*! Configure the jobserver for concurrent TeX runs of all processes.
+ *
+ *  Whereas the scheduler limits the conversions within a process,
+ *  the jobserver limits the TeX runs of all processes using it,
+ *  such as database backends, command line invocations and workers.
+ *  Each TeX run waits for a token of the jobserver,
+ *  and returns it when the TeX interpreter has exited.
+ *  The time spent waiting is reported as part of the queue time.
+ *  Asynchronous conversions (see texcaller_conversion_start())
+ *  must not block, so while no token is available,
+ *  their texcaller_conversion_fd() becomes readable
+ *  when it's worth trying again.
+ *
+ *  Unless this function is called,
+ *  the jobserver is given by the environment variable
+ *  \c TEXCALLER_JOBSERVER, if set,
+ *  which is useful for processes that can't call this function,
+ *  such as the \ref postgresql.
+ *  An invalid value of \c TEXCALLER_JOBSERVER
+ *  fails the next conversion with its error message,
+ *  after which the jobserver is disabled.
+ *
+ *  Like GNU make,
+ *  each process owns an implicit token
+ *  when using the jobserver of make, a pipe or a FIFO.
+ *  With these, tokens of crashed processes are lost,
+ *  whereas the slots of a directory are freed
+ *  as soon as their holders die.
+ *
+ *  This function is thread-safe.
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param jobserver
+ *      one of:
+ *      - \c NULL to disable the jobserver (the default)
+ *      - \c "make" for the jobserver of GNU make
+ *        given by <tt>\--jobserver-auth</tt> in \c MAKEFLAGS,
+ *        so conversions within <tt>make -j N</tt>
+ *        share its \c N job slots with the other commands.
+ *        The command has to be marked as recursive via \c + in the makefile
+ *        unless make passes a FIFO.
+ *        Within make without <tt>-j</tt>,
+ *        at most one TeX run of this process runs at a time,
+ *        and outside of make, the jobserver is disabled.
+ *      - <tt>fifo:PATH</tt> for a FIFO
+ *        that contains one byte per token,
+ *        as used by GNU make ≥ 4.4
+ *      - <tt>slots:DIRECTORY:LIMIT</tt> for a directory
+ *        of \c LIMIT slot files,
+ *        such as <tt>slots:/run/texcaller:8</tt>,
+ *        each of which is locked via \c flock() while held.
+ *        The directory and the slot files are created if necessary,
+ *        so they have to be accessible by all processes
+ *        that use the jobserver.
+ */
+int texcaller_jobserver_configure(char **error, const char *jobserver);
+
+/*! A sample of the process-wide metrics,
+ *  see texcaller_metrics_snapshot().
+ */
+typedef struct texcaller_metric
+{
+    /*! Name of the metric,
+     *  following the Prometheus conventions,
+     *  such as \c "texcaller_conversions_total"
+     *  or \c "texcaller_conversion_seconds_bucket".
+     */
+    const char *name;
+
+    /*! Labels of the sample in the Prometheus text format,
+     *  such as <tt>le="0.5"</tt>,
+     *  or the empty string.
+     */
+    char labels[96];
+
+    /*! Value of the sample.
+     */
+    double value;
+} texcaller_metric;
+
+/*! Take a snapshot of the process-wide metrics.
+ *
+ *  This function is reentrant and thread-safe.
+ *  Every conversion of the calling process is recorded,
+ *  including the internal conversions
+ *  of parallel parts and batches,
+ *  at a cost of a few atomic additions per conversion.
+ *  The samples are:
+ *
+ *  - \c texcaller_conversions_total:
+ *    conversions by \c source_format, \c result_format
+ *    and \c outcome (\c succeeded, \c failed or \c cancelled)
+ *  - \c texcaller_runs_bucket, \c _sum and \c _count:
+ *    histogram of the TeX runs per successful local conversion
+ *  - \c texcaller_conversion_seconds_bucket, \c _sum and \c _count:
+ *    histogram of the latency of all conversions,
+ *    including the time waiting for the scheduler
+ *  - \c texcaller_queue_seconds_total:
+ *    time spent waiting for the scheduler
+ *  - \c texcaller_source_bytes_total and \c texcaller_result_bytes_total:
+ *    size of all sources and results
+ *  - \c texcaller_cleanup_failures_total:
+ *    temporary directories that couldn't be removed
+ *  - \c texcaller_remote_failures_total:
+ *    failed attempts to convert on a remote worker,
+ *    such as unreachable workers
+ *  - \c texcaller_truncated_previews_total:
+ *    previews that have been stopped early,
+ *    see texcaller_options::preview_pages
+ *
+ *  The histogram buckets are cumulative,
+ *  as in the Prometheus text format.
+ *
+ *  \param count
+ *      will be set to the number of samples
+ *
+ *  \return
+ *      a newly allocated array of the samples,
+ *      to be freed via \c free(),
+ *      or \c NULL when out of memory.
+ */
+texcaller_metric *texcaller_metrics_snapshot(int *count);
+
+/*! Format the process-wide metrics for Prometheus.
+ *
+ *  This function is reentrant and thread-safe.
+ *  It formats texcaller_metrics_snapshot()
+ *  in the Prometheus text exposition format,
+ *  including \c HELP and \c TYPE lines.
+ *
+ *  \return
+ *      a newly allocated string,
+ *      to be freed via \c free(),
+ *      or \c NULL when out of memory.
+ */
+char *texcaller_metrics_prometheus(void);
+
+/*! Listen for requests of remote clients.
+ *
+ *  This prepares a socket for worker processes
+ *  that accept connections on it
+ *  and pass them to texcaller_worker_serve().
+ *  A stale Unix domain socket at the same path is replaced.
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *
+ *  \param address
+ *      the address to listen on,
+ *      see texcaller_options::workers.
+ *      An empty \c HOST is rejected,
+ *      so listening on all interfaces needs an explicit
+ *      <tt>0.0.0.0:PORT</tt> or <tt>[::]:PORT</tt>,
+ *      and clients on other hosts are only served
+ *      with a texcaller_options::worker_secret.
+ *
+ *  \return
+ *      the listening socket, marked close-on-exec,
+ *      or -1 on failure.
+ */
+int texcaller_worker_listen(char **error, const char *address);
+
+/*! Serve a single request of a remote client.
+ *
+ *  This reads a conversion request from a connected socket,
+ *  converts it locally within \c context,
+ *  and writes the response back to the socket.
+ *  The socket is not closed.
+ *
+ *  The protocol is as simple as possible,
+ *  so that clients can be written in any language.
+ *  A client connects, sends a request,
+ *  receives the response and disconnects.
+ *  All integers are unsigned 32 bit integers in network byte order.
+ *  A request consists of:
+ *
+ *  - the 4 bytes \c "TXC2"
+ *  - the source format, see ::texcaller_source_format
+ *  - the result format, see ::texcaller_result_format
+ *  - \c max_runs
+ *  - the priority class, see texcaller_options::priority
+ *  - the tenant weight, see texcaller_options::tenant_weight
+ *  - the size of the secret, 0 for none, at most 4096
+ *  - the size of the tenant name, 0 for the anonymous tenant, at most 4096
+ *  - the size of the source
+ *  - the secret, see texcaller_options::worker_secret
+ *  - the tenant name
+ *  - the source
+ *
+ *  A response consists of:
+ *
+ *  - the 4 bytes \c "TXC2"
+ *  - 0 if the conversion succeeded, 1 if it failed
+ *  - the number of conversions that are running or waiting
+ *    on the worker (see texcaller_scheduler_configure())
+ *  - the size of the result, 0 if the conversion failed
+ *  - the size of the info string, 0 if the worker was out of memory
+ *  - the result
+ *  - the info string, without a terminating null byte
+ *
+ *  Requests without the right secret are rejected,
+ *  and sources larger than texcaller_options::worker_max_source_size
+ *  are skipped and answered with a failed conversion.
+ *  The socket gets the send and receive timeouts
+ *  of texcaller_options::worker_timeout.
+ *
+ *  This function is thread-safe,
+ *  so requests may be served by multiple threads in parallel.
+ *
+ *  \param error
+ *      On failure, \c error will be set to a newly allocated string
+ *      that contains the error message.
+ *      On success, or when out of memory,
+ *      \c error will be set to \c NULL.
+ *      Note that failed conversions are reported to the client,
+ *      so they don't count as failure here,
+ *      unlike rejected requests.
+ *
+ *  \param context
+ *      the context of the conversion, created by texcaller_context_create().
+ *      Its texcaller_options::workers is ignored.
+ *
+ *  \param fd
+ *      the connected socket
+ *
+ *  \return
+ *      0 on success, -1 on failure
+ */
+int texcaller_worker_serve(char **error, const texcaller_context *context, int fd);
+
 /*! Escape a string for direct use in LaTeX.
  *
  *  That is, all LaTeX special characters are replaced
@@ -313,6 +1545,90 @@ Téxt → {''}with{''} \$peciäl \textless{}characters\textgreater{}
  */
 char *texcaller_escape_latex(const char *s);
 
+/*! Escape a string for direct use in a LaTeX document of a certain format.
+ *
+ *  Like texcaller_escape_latex(),
+ *  all LaTeX special characters are replaced
+ *  with proper LaTeX elements.
+ *  In addition, for \c "LaTeX" documents
+ *  (which are typeset by pdfLaTeX),
+ *  unicode characters such as
+ *  “ ” – — € µ ≤ or accented letters
+ *  are replaced by LaTeX macros where possible,
+ *  so they don't depend on the \c inputenc package.
+ *  Some of these macros need the T1 font encoding:
+ *
+ *  \code
+\usepackage[T1]{fontenc}
+ *  \endcode
+ *
+ *  For example, the following string:
+ *
+ *  \verbatim
+Téxt → "with" $peciäl <characters>
+\endverbatim
+ *
+ *  is escaped for \c "LaTeX" to:
+ *
+ *  \verbatim
+T\'{e}xt \ensuremath{\rightarrow} {''}with{''} \$peci\"{a}l \textless{}characters\textgreater{}
+\endverbatim
+ *
+ *  Invalid UTF-8 sequences and characters without a LaTeX macro
+ *  remain as they are.
+ *
+ *  This function is reentrant.
+ *
+ *  \param s
+ *      the UTF-8 string to escape
+ *
+ *  \param source_format
+ *      format of the LaTeX document, must be one of:
+ *      - \c "LaTeX" (unicode characters are replaced by LaTeX macros)
+ *      - \c "XeLaTeX" (unicode characters remain as they are)
+ *      - \c "LuaLaTeX" (unicode characters remain as they are)
+ *
+ *  \return
+ *      a newly allocated string containing the escaped value,
+ *      or \c NULL when out of memory or \c source_format is not supported.
+ */
+char *texcaller_escape_latex_for(const char *s, const char *source_format);
+
+/*! Escape a buffer for direct use in LaTeX, without allocating memory.
+ *
+ *  This works like texcaller_escape_latex()
+ *  or texcaller_escape_latex_for(),
+ *  but on a buffer that may contain \c '\\0' characters
+ *  and isn't necessarily terminated by one.
+ *  It is meant to be called twice,
+ *  first to calculate the size of the escaped value,
+ *  then to write it into a large enough buffer,
+ *  such as the end of a growing string.
+ *
+ *  This function is reentrant.
+ *
+ *  \param result
+ *      buffer that receives the escaped value,
+ *      or \c NULL to only calculate its size.
+ *      No \c '\\0' is added.
+ *
+ *  \param s
+ *      the UTF-8 buffer to escape
+ *
+ *  \param size
+ *      size of \c s
+ *
+ *  \param source_format
+ *      \c NULL to escape like texcaller_escape_latex(),
+ *      or the format of the LaTeX document
+ *      as for texcaller_escape_latex_for()
+ *
+ *  \return
+ *      the size of the escaped value,
+ *      or <tt>(size_t)-1</tt> if \c source_format is not supported
+ */
+size_t texcaller_escape_latex_buffer(char *result, const char *s, size_t size, const char *source_format);
+
 /*! @} */
 
 #ifdef __cplusplus
@@ -324,6 +1640,25 @@ char *texcaller_escape_latex(const char *s);
 #include <string>
 #include <stdexcept>
 
+#if __cplusplus >= 201703L
+#include <exception>
+#include <functional>
+#include <future>
+#include <string_view>
+#include <thread>
+#include <utility>
+#endif
+
+/*! Dynamic exception specification of the C++ wrappers,
+ *  which is omitted since C++11,
+ *  as it is deprecated there and removed in C++17.
+ */
+#if __cplusplus >= 201103L
+#define TEXCALLER_THROWS(exceptions)
+#else
+#define TEXCALLER_THROWS(exceptions) throw exceptions
+#endif
+
 namespace texcaller
 {
 
@@ -346,9 +1681,50 @@ namespace texcaller
 c++ -o example example.cxx `pkg-config texcaller --cflags --libs`
  *  \endcode
  *
+ *  With C++17, there are additional wrappers
+ *  that take \c std::string_view arguments,
+ *  return a move-only texcaller::document instead of copying the result,
+ *  convert asynchronously via \c std::future or a callback,
+ *  and escape by appending to an existing \c std::string:
+ *
+ *  \include example17.cxx
+ *
  *  @{
  */
 
+/*! Implementation details of the C++ wrappers.
+ */
+namespace detail
+{
+
+/*! Set the formats of a job by their names.
+ *
+ *  \exception std::domain_error
+ *      the conversion is not supported.
+ */
+inline void set_job_formats(texcaller_job &job, const char *source_format, size_t source_format_size, const char *result_format, size_t result_format_size) TEXCALLER_THROWS((std::domain_error))
+{
+    static const char *const source_formats[] = {"TeX", "LaTeX", "XeTeX", "XeLaTeX", "LuaTeX", "LuaLaTeX"};
+    static const char *const result_formats[] = {"DVI", "PDF"};
+    const std::string source_format_string(source_format, source_format_size);
+    const std::string result_format_string(result_format, result_format_size);
+    int source_index = 0;
+    int result_index = 0;
+    while (source_index < 6 && source_format_string != source_formats[source_index]) {
+        source_index++;
+    }
+    while (result_index < 2 && result_format_string != result_formats[result_index]) {
+        result_index++;
+    }
+    if (source_index == 6 || result_index == 2) {
+        throw std::domain_error("Unable to convert from \"" + source_format_string + "\" to \"" + result_format_string + "\".");
+    }
+    job.source_format = static_cast<texcaller_source_format>(source_index);
+    job.result_format = static_cast<texcaller_result_format>(result_index);
+}
+
+}
+
 /*! Convert a TeX or LaTeX source to DVI or PDF.
  *
  *  This is a simple wrapper around \ref texcaller_convert.
@@ -386,7 +1762,7 @@ c++ -o example example.cxx `pkg-config texcaller --cflags --libs`
  *      the TeX interpreter exited with an error,
  *      or the output didn't stabilize after \c max_runs runs.
  */
-inline void convert(std::string &result, std::string &info, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs) throw(std::domain_error, std::runtime_error)
+inline void convert(std::string &result, std::string &info, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs) TEXCALLER_THROWS((std::domain_error, std::runtime_error))
 {
     char *c_result;
     size_t c_result_size;
@@ -407,6 +1783,123 @@ inline void convert(std::string &result, std::string &info, const std::string &s
     free(c_result);
 }
 
+/*! An asynchronous conversion of a TeX or LaTeX source to DVI or PDF.
+ *
+ *  This is a simple wrapper around \ref texcaller_conversion_start
+ *  and related functions,
+ *  meant to be driven by an event loop.
+ */
+class conversion
+{
+public:
+    /*! Start an asynchronous conversion.
+     *
+     *  The parameters are the same as for texcaller::convert().
+     */
+    conversion(const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs) TEXCALLER_THROWS((std::domain_error, std::runtime_error))
+    {
+        texcaller_job job;
+        ::texcaller_job_init(&job);
+        detail::set_job_formats(job, source_format.data(), source_format.size(), result_format.data(), result_format.size());
+        job.source = source.data();
+        job.source_size = source.size();
+        job.max_runs = max_runs;
+        c_conversion = ::texcaller_conversion_start(NULL, &job);
+        if (c_conversion == NULL) {
+            throw std::runtime_error("Out of memory.");
+        }
+    }
+
+    /*! Cancel the conversion, unless it has been finished.
+     */
+    ~conversion()
+    {
+        cancel();
+    }
+
+    /*! Get the file descriptor to watch for readability.
+     *
+     *  \return
+     *      the file descriptor, or -1 if the conversion has finished
+     */
+    int fd() const
+    {
+        return c_conversion == NULL ? -1 : ::texcaller_conversion_fd(c_conversion);
+    }
+
+    /*! Continue the conversion when fd() is readable.
+     *
+     *  \return
+     *      whether the conversion has finished
+     */
+    bool step()
+    {
+        return c_conversion == NULL || ::texcaller_conversion_step(c_conversion) != 0;
+    }
+
+    /*! Block until the conversion has finished,
+     *  so finish() returns its result.
+     */
+    void wait()
+    {
+        if (c_conversion != NULL) {
+            ::texcaller_conversion_wait(c_conversion);
+        }
+    }
+
+    /*! Get the result of a finished conversion.
+     *
+     *  If the conversion hasn't finished yet, it is cancelled.
+     *  The parameters and exceptions are the same as for texcaller::convert().
+     */
+    void finish(std::string &result, std::string &info) TEXCALLER_THROWS((std::domain_error, std::runtime_error))
+    {
+        char *c_result;
+        size_t c_result_size;
+        char *c_info;
+        if (c_conversion == NULL) {
+            throw std::runtime_error("Conversion has already been finished.");
+        }
+        ::texcaller_conversion_finish(c_conversion, &c_result, &c_result_size, &c_info);
+        c_conversion = NULL;
+        if (c_info == NULL) {
+            free(c_result);
+            throw std::runtime_error("Out of memory.");
+        }
+        if (c_result == NULL) {
+            const std::string error_info(c_info);
+            free(c_info);
+            throw std::domain_error(error_info);
+        }
+        info.assign(c_info);
+        free(c_info);
+        result.assign(c_result, c_result_size);
+        free(c_result);
+    }
+
+    /*! Cancel the conversion, killing the TeX interpreter,
+     *  unless it has been finished.
+     */
+    void cancel()
+    {
+        char *c_result;
+        size_t c_result_size;
+        char *c_info;
+        if (c_conversion != NULL) {
+            ::texcaller_conversion_finish(c_conversion, &c_result, &c_result_size, &c_info);
+            c_conversion = NULL;
+            free(c_result);
+            free(c_info);
+        }
+    }
+
+private:
+    conversion(const conversion &);
+    conversion &operator=(const conversion &);
+
+    texcaller_conversion *c_conversion;
+};
+
 /*! Escape a string for direct use in LaTeX.
  *
  *  This is a simple wrapper around \ref texcaller_escape_latex.
@@ -417,7 +1910,7 @@ inline void convert(std::string &result, std::string &info, const std::string &s
  *  \return
  *      the escaped value
  */
-inline std::string escape_latex(const std::string &s) throw(std::runtime_error)
+inline std::string escape_latex(const std::string &s) TEXCALLER_THROWS((std::runtime_error))
 {
     char *c_result = ::texcaller_escape_latex(s.c_str());
     if (c_result == NULL) {
@@ -428,6 +1921,257 @@ inline std::string escape_latex(const std::string &s) throw(std::runtime_error)
     return result;
 }
 
+/*! Escape a string for direct use in a LaTeX document of a certain format.
+ *
+ *  This is a simple wrapper around \ref texcaller_escape_latex_for.
+ *
+ *  \param s
+ *      the UTF-8 string to escape
+ *
+ *  \param source_format
+ *      format of the LaTeX document, must be one of:
+ *      - \c "LaTeX"
+ *      - \c "XeLaTeX"
+ *      - \c "LuaLaTeX"
+ *
+ *  \return
+ *      the escaped value
+ *
+ *  \exception std::domain_error
+ *      the source format is not supported.
+ */
+inline std::string escape_latex(const std::string &s, const std::string &source_format) TEXCALLER_THROWS((std::domain_error, std::runtime_error))
+{
+    if (source_format != "LaTeX" && source_format != "XeLaTeX" && source_format != "LuaLaTeX") {
+        throw std::domain_error("Unable to escape for \"" + source_format + "\".");
+    }
+    char *c_result = ::texcaller_escape_latex_for(s.c_str(), source_format.c_str());
+    if (c_result == NULL) {
+        throw std::runtime_error("Out of memory.");
+    }
+    const std::string result(c_result);
+    free(c_result);
+    return result;
+}
+
+#if __cplusplus >= 201703L
+
+/*! A generated document.
+ *
+ *  This owns the buffers allocated by the C library,
+ *  so the document is never copied.
+ *  It can be moved, but not copied.
+ */
+class document
+{
+public:
+    /*! Create an empty document, without info.
+     */
+    document() noexcept
+        : c_result(nullptr), c_result_size(0), c_info(nullptr)
+    {
+    }
+
+    /*! Take ownership of the buffers returned by \ref texcaller_convert.
+     */
+    document(char *result, size_t result_size, char *info) noexcept
+        : c_result(result), c_result_size(result_size), c_info(info)
+    {
+    }
+
+    document(document &&other) noexcept
+        : c_result(other.c_result), c_result_size(other.c_result_size), c_info(other.c_info)
+    {
+        other.c_result = nullptr;
+        other.c_result_size = 0;
+        other.c_info = nullptr;
+    }
+
+    document &operator=(document &&other) noexcept
+    {
+        if (this != &other) {
+            free(c_result);
+            free(c_info);
+            c_result = std::exchange(other.c_result, nullptr);
+            c_result_size = std::exchange(other.c_result_size, 0);
+            c_info = std::exchange(other.c_info, nullptr);
+        }
+        return *this;
+    }
+
+    document(const document &) = delete;
+    document &operator=(const document &) = delete;
+
+    ~document()
+    {
+        free(c_result);
+        free(c_info);
+    }
+
+    /*! Get the generated document. */
+    const char *data() const noexcept
+    {
+        return c_result;
+    }
+
+    /*! Get the size of the generated document. */
+    size_t size() const noexcept
+    {
+        return c_result_size;
+    }
+
+    /*! Get the generated document as a view. */
+    std::string_view view() const noexcept
+    {
+        return std::string_view(c_result, c_result_size);
+    }
+
+    /*! Get additional information such as TeX warnings. */
+    std::string_view info() const noexcept
+    {
+        return c_info == nullptr ? std::string_view() : std::string_view(c_info);
+    }
+
+private:
+    char *c_result;
+    size_t c_result_size;
+    char *c_info;
+};
+
+/*! Convert a TeX or LaTeX source to DVI or PDF, without copying.
+ *
+ *  This is a simple wrapper around \ref texcaller_context_convert.
+ *  The parameters and exceptions are the same as for
+ *  the classic texcaller::convert(),
+ *  but neither the source nor the result are copied.
+ *
+ *  \param context
+ *      the context, created by texcaller_context_create(),
+ *      or \c nullptr for the default options
+ *
+ *  \return
+ *      the generated document
+ */
+inline document convert(std::string_view source, std::string_view source_format, std::string_view result_format, int max_runs, const texcaller_context *context = nullptr)
+{
+    texcaller_job job;
+    char *c_result;
+    size_t c_result_size;
+    char *c_info;
+    ::texcaller_job_init(&job);
+    detail::set_job_formats(job, source_format.data(), source_format.size(), result_format.data(), result_format.size());
+    job.source = source.data();
+    job.source_size = source.size();
+    job.max_runs = max_runs;
+    ::texcaller_context_convert(&c_result, &c_result_size, &c_info, context, &job);
+    if (c_info == nullptr) {
+        free(c_result);
+        throw std::runtime_error("Out of memory.");
+    }
+    if (c_result == nullptr) {
+        const std::string error_info(c_info);
+        free(c_info);
+        throw std::domain_error(error_info);
+    }
+    return document(c_result, c_result_size, c_info);
+}
+
+/*! Convert a TeX or LaTeX source to DVI or PDF in a separate thread.
+ *
+ *  The parameters are the same as for texcaller::convert(),
+ *  except that the source is passed by value,
+ *  since it has to outlive the call.
+ *  Move it in to avoid copying.
+ *  The \c context, if any, must outlive the conversion.
+ *
+ *  \return
+ *      a future of the generated document,
+ *      which rethrows the exceptions of texcaller::convert()
+ */
+inline std::future<document> convert_async(std::string source, std::string source_format, std::string result_format, int max_runs, const texcaller_context *context = nullptr)
+{
+    return std::async(std::launch::async,
+                      [source = std::move(source), source_format = std::move(source_format),
+                       result_format = std::move(result_format), max_runs, context]() {
+                          return convert(source, source_format, result_format, max_runs, context);
+                      });
+}
+
+/*! Convert a TeX or LaTeX source to DVI or PDF in a separate thread,
+ *  calling back when finished.
+ *
+ *  This works like the future-based texcaller::convert_async(),
+ *  but calls \c callback from the conversion's thread
+ *  with the generated document and a null \c std::exception_ptr,
+ *  or on failure with an empty document and the exception.
+ *
+ *  The \c context has no default here,
+ *  so a trailing \c nullptr always selects the future-based overload.
+ */
+inline void convert_async(std::string source, std::string source_format, std::string result_format, int max_runs, std::function<void(document, std::exception_ptr)> callback, const texcaller_context *context)
+{
+    std::thread([source = std::move(source), source_format = std::move(source_format),
+                 result_format = std::move(result_format), max_runs, callback = std::move(callback), context]() {
+        document result;
+        std::exception_ptr error;
+        try {
+            result = convert(source, source_format, result_format, max_runs, context);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        callback(std::move(result), error);
+    }).detach();
+}
+
+/*! Escape a string for direct use in LaTeX,
+ *  appending to another string.
+ *
+ *  This is a simple wrapper around \ref texcaller_escape_latex_buffer,
+ *  which escapes directly into \c result,
+ *  so building a document from many escaped values
+ *  needs no temporary strings.
+ *
+ *  \param result
+ *      the string to append the escaped value to
+ *
+ *  \param s
+ *      the string to escape
+ */
+inline void escape_latex_append(std::string &result, std::string_view s)
+{
+    const size_t size = ::texcaller_escape_latex_buffer(nullptr, s.data(), s.size(), nullptr);
+    const size_t old_size = result.size();
+    result.resize(old_size + size);
+    ::texcaller_escape_latex_buffer(result.data() + old_size, s.data(), s.size(), nullptr);
+}
+
+/*! Escape a string for direct use in a LaTeX document of a certain format,
+ *  appending to another string.
+ *
+ *  The parameters are the same as for escape_latex_append(),
+ *  and \c source_format is the same as for texcaller::escape_latex().
+ *
+ *  \exception std::domain_error
+ *      the source format is not supported.
+ */
+inline void escape_latex_append(std::string &result, std::string_view s, std::string_view source_format)
+{
+    const char *c_source_format =
+        source_format == "LaTeX" ? "LaTeX"
+        : source_format == "XeLaTeX" ? "XeLaTeX"
+        : source_format == "LuaLaTeX" ? "LuaLaTeX"
+        : nullptr;
+    if (c_source_format == nullptr) {
+        throw std::domain_error("Unable to escape for \"" + std::string(source_format) + "\".");
+    }
+    const size_t size = ::texcaller_escape_latex_buffer(nullptr, s.data(), s.size(), c_source_format);
+    const size_t old_size = result.size();
+    result.resize(old_size + size);
+    ::texcaller_escape_latex_buffer(result.data() + old_size, s.data(), s.size(), c_source_format);
+}
+
+#endif
+
 /*! @} */
 
 }
@@ -0,0 +1,47 @@
+<?php
+
+$names = array('first', 'second', 'third');
+
+// start all conversions at once
+$conversions = array();
+foreach ($names as $name) {
+    $latex = '\documentclass{article}
+\begin{document}
+Hello '.$name.' world!
+\end{document}';
+    $conversions[$name] = new TexcallerConversion($latex, 'LaTeX', 'PDF', 5);
+}
+
+// wait for any TeX run to exit, while other I/O could be done as well
+$pdfs = array();
+while ($conversions) {
+    $read = array();
+    foreach ($conversions as $name => $conversion) {
+        if ($conversion->step()) {
+            $pdf = '';
+            $info = '';
+            $conversion->result($pdf, $info);
+            $pdfs[$name] = $pdf;
+            unset($conversions[$name]);
+        } else {
+            $read[] = $conversion->stream();
+        }
+    }
+    $write = null;
+    $except = null;
+    if ($read) {
+        stream_select($read, $write, $except, null);
+    }
+}
+
+ksort($pdfs);
+foreach ($pdfs as $name => $pdf) {
+    printf("%-8s %s ... %s\n", $name.':', substr($pdf, 0, 5), substr($pdf, -6));
+}
+
+// or simply wait for a single conversion
+$conversion = new TexcallerConversion('\documentclass{article}\begin{document}Hello world!\end{document}', 'LaTeX', 'PDF', 5);
+$pdf = '';
+$info = '';
+$conversion->result($pdf, $info);
+printf("single:  %s ... %s\n", substr($pdf, 0, 5), substr($pdf, -6));
@@ -0,0 +1,14 @@
+--TEST--
+run example_async.php
+--FILE--
+<?php
+require 'example_async.php';
+--EXPECT--
+first:   %PDF- ... %%EOF
+
+second:  %PDF- ... %%EOF
+
+third:   %PDF- ... %%EOF
+
+single:  %PDF- ... %%EOF
+
@@ -30,3 +30,20 @@ select
         || '\end{document}',
         'LaTeX', 'PDF', 5
     );
+
+-- generate a gzip compressed PDF, e.g. to store it as it is
+select
+    texcaller_convert_compressed(convert_to(latex_source, 'UTF8'), 'LaTeX', 'PDF', 5, 'identity', 'gzip')
+from
+    documents
+where
+    name = 'hello';
+
+-- generate a table of all documents, escaping each cell
+select
+    '\begin{tabular}{ll}' || texcaller_latex_rows(name, latex_source order by name) || '\end{tabular}'
+from
+    documents;
+
+-- inspect the metrics of this backend, e.g. the outcomes of its conversions
+select labels, value from texcaller_stats() where name = 'texcaller_conversions_total' and value > 0;
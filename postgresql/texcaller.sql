@@ -1,9 +1,52 @@
 \echo Use "CREATE EXTENSION texcaller" to load this file. \quit
 
 create function
-texcaller_convert(source text, source_format text, result_format text, max_runs integer) returns bytea stable strict
+texcaller_convert(source text, source_format text, result_format text, max_runs integer) returns bytea stable strict parallel restricted
 language c as '$libdir/texcaller', 'postgresql_texcaller_convert';
 
 create function
-texcaller_escape_latex(s text) returns text immutable strict
+texcaller_convert(source text, source_format text, result_format text, max_runs integer, priority text, tenant text) returns bytea stable strict parallel restricted
+language c as '$libdir/texcaller', 'postgresql_texcaller_convert_scheduled';
+
+create function
+texcaller_convert_compressed(source bytea, source_format text, result_format text, max_runs integer, source_codec text, result_codec text) returns bytea stable strict parallel restricted
+language c as '$libdir/texcaller', 'postgresql_texcaller_convert_compressed';
+
+create function
+texcaller_escape_latex(s text) returns text immutable strict parallel safe
 language c as '$libdir/texcaller', 'postgresql_texcaller_escape_latex';
+
+create function
+texcaller_stats(out name text, out labels text, out value double precision) returns setof record volatile parallel restricted
+language c as '$libdir/texcaller', 'postgresql_texcaller_stats';
+
+create function
+texcaller_latex_rows_transfn(state internal, cells text[]) returns internal immutable parallel safe
+language c as '$libdir/texcaller', 'postgresql_texcaller_latex_rows_transfn';
+
+create function
+texcaller_latex_rows_finalfn(state internal) returns text immutable parallel safe
+language c as '$libdir/texcaller', 'postgresql_texcaller_latex_rows_finalfn';
+
+create function
+texcaller_latex_rows_combinefn(state internal, other internal) returns internal immutable parallel safe
+language c as '$libdir/texcaller', 'postgresql_texcaller_latex_rows_combinefn';
+
+create function
+texcaller_latex_rows_serialfn(state internal) returns bytea immutable strict parallel safe
+language c as '$libdir/texcaller', 'postgresql_texcaller_latex_rows_serialfn';
+
+create function
+texcaller_latex_rows_deserialfn(serialized bytea, state internal) returns internal immutable strict parallel safe
+language c as '$libdir/texcaller', 'postgresql_texcaller_latex_rows_deserialfn';
+
+create aggregate
+texcaller_latex_rows(variadic cells text[]) (
+    sfunc = texcaller_latex_rows_transfn,
+    stype = internal,
+    finalfunc = texcaller_latex_rows_finalfn,
+    combinefunc = texcaller_latex_rows_combinefn,
+    serialfunc = texcaller_latex_rows_serialfn,
+    deserialfunc = texcaller_latex_rows_deserialfn,
+    parallel = safe
+);
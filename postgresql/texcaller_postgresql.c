@@ -7,6 +7,10 @@
  *  \dontinclude texcaller.sql
  *  \skipline (
  *  \skipline (
+ *  \skipline (
+ *  \skipline (
+ *  \skipline (
+ *  \skipline texcaller_latex_rows(variadic
  *
  *  \par Description
  *
@@ -26,6 +30,39 @@
  *  additional processing information is provided via
  *  <a href="http://www.postgresql.org/docs/current/static/plpgsql-errors-and-messages.html">NOTICE</a>s.
  *
+ *  The optional \c priority (\c 'interactive', \c 'normal' or \c 'batch')
+ *  and \c tenant arguments are passed to the scheduler,
+ *  see texcaller_options::priority and texcaller_options::tenant.
+ *
+ *  \c texcaller_convert_compressed takes a compressed \c source
+ *  and returns a compressed result,
+ *  each with a \c 'identity', \c 'gzip' or \c 'zstd' codec,
+ *  see texcaller_options::source_codec and texcaller_options::result_codec.
+ *  The uncompressed source and result are only ever stored
+ *  in the temporary directory,
+ *  so large documents stay compressed in the backend's memory.
+ *
+ *  \c texcaller_escape_latex is parallel safe,
+ *  so it doesn't prevent parallel scans,
+ *  and returns its argument as it is when nothing needs to be escaped.
+ *  \c texcaller_convert is parallel restricted,
+ *  because its NOTICEs must be sent by the leader process.
+ *
+ *  The aggregate \c texcaller_latex_rows
+ *  escapes its arguments like \c texcaller_escape_latex,
+ *  joins them via <tt>&</tt> to a row of a LaTeX table,
+ *  and joins the rows via <tt>\\\\</tt>,
+ *  where \c NULL cells are empty.
+ *  Each cell is escaped right into the aggregated text,
+ *  so no temporary text is created per cell.
+ *  Like \c string_agg, it supports parallel aggregation,
+ *  so the order of the rows is only defined
+ *  if given via <tt>order by</tt>.
+ *
+ *  \c texcaller_stats returns the metrics
+ *  of the current backend process,
+ *  one row per sample of texcaller_metrics_snapshot().
+ *
  *  \par Example
  *
  *  \include example.sql
@@ -33,17 +70,33 @@
 
 #include <postgres.h>
 #include <executor/executor.h>
+#include <funcapi.h>
+#include <lib/stringinfo.h>
+#include <libpq/pqformat.h>
+#include <utils/array.h>
 #include <utils/builtins.h>
 
 #include "../c/texcaller.h"
 
 PG_MODULE_MAGIC;
 
+/* internal function of texcaller.c, which is included at the end */
+static size_t escape_latex(char *result, const char *s, size_t size, int unicode_macros);
+
 Datum postgresql_texcaller_convert(PG_FUNCTION_ARGS);
+Datum postgresql_texcaller_convert_scheduled(PG_FUNCTION_ARGS);
+Datum postgresql_texcaller_convert_compressed(PG_FUNCTION_ARGS);
 Datum postgresql_texcaller_escape_latex(PG_FUNCTION_ARGS);
+Datum postgresql_texcaller_latex_rows_transfn(PG_FUNCTION_ARGS);
+Datum postgresql_texcaller_latex_rows_finalfn(PG_FUNCTION_ARGS);
+Datum postgresql_texcaller_latex_rows_combinefn(PG_FUNCTION_ARGS);
+Datum postgresql_texcaller_latex_rows_serialfn(PG_FUNCTION_ARGS);
+Datum postgresql_texcaller_latex_rows_deserialfn(PG_FUNCTION_ARGS);
+Datum postgresql_texcaller_stats(PG_FUNCTION_ARGS);
 
-PG_FUNCTION_INFO_V1(postgresql_texcaller_convert);
-Datum postgresql_texcaller_convert(PG_FUNCTION_ARGS)
+/*! Common implementation of all variants of texcaller_convert().
+ */
+static Datum convert_with_options(PG_FUNCTION_ARGS, const texcaller_options *options)
 {
     char *native_result;
     size_t native_result_size;
@@ -53,15 +106,16 @@ Datum postgresql_texcaller_convert(PG_FUNCTION_ARGS)
     char *result_format;
     int max_runs;
     bytea *result;
-    /* load arguments */
-    source = PG_GETARG_TEXT_P(0);
+    /* load arguments, without copying short values */
+    source = PG_GETARG_TEXT_PP(0);
     source_format = text_to_cstring(PG_GETARG_TEXT_P(1));
     result_format = text_to_cstring(PG_GETARG_TEXT_P(2));
     max_runs = PG_GETARG_INT32(3);
     /* call function */
-    texcaller_convert(&native_result, &native_result_size, &info,
-                      VARDATA(source), VARSIZE(source) - VARHDRSZ,
-                      source_format, result_format, max_runs);
+    texcaller_convert_with_options(&native_result, &native_result_size, &info,
+                                   VARDATA_ANY(source), VARSIZE_ANY_EXHDR(source),
+                                   source_format, result_format, max_runs,
+                                   options);
     /* free arguments */
     pfree(source_format);
     pfree(result_format);
@@ -86,28 +140,267 @@ Datum postgresql_texcaller_convert(PG_FUNCTION_ARGS)
     PG_RETURN_BYTEA_P(result);
 }
 
+PG_FUNCTION_INFO_V1(postgresql_texcaller_convert);
+Datum postgresql_texcaller_convert(PG_FUNCTION_ARGS)
+{
+    return convert_with_options(fcinfo, NULL);
+}
+
+PG_FUNCTION_INFO_V1(postgresql_texcaller_convert_scheduled);
+Datum postgresql_texcaller_convert_scheduled(PG_FUNCTION_ARGS)
+{
+    texcaller_options options;
+    char *priority;
+    Datum result;
+    texcaller_options_init(&options);
+    /* load arguments */
+    priority = text_to_cstring(PG_GETARG_TEXT_P(4));
+    if (strcmp(priority, "interactive") == 0) {
+        options.priority = TEXCALLER_PRIORITY_INTERACTIVE;
+    } else if (strcmp(priority, "normal") == 0) {
+        options.priority = TEXCALLER_PRIORITY_NORMAL;
+    } else if (strcmp(priority, "batch") == 0) {
+        options.priority = TEXCALLER_PRIORITY_BATCH;
+    } else {
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("Invalid priority \"%s\", must be 'interactive', 'normal' or 'batch'.",
+                        priority)));
+    }
+    pfree(priority);
+    options.tenant = text_to_cstring(PG_GETARG_TEXT_P(5));
+    /* call function */
+    result = convert_with_options(fcinfo, &options);
+    /* free arguments */
+    pfree((char *)options.tenant);
+    return result;
+}
+
+PG_FUNCTION_INFO_V1(postgresql_texcaller_convert_compressed);
+Datum postgresql_texcaller_convert_compressed(PG_FUNCTION_ARGS)
+{
+    texcaller_options options;
+    Datum result;
+    texcaller_options_init(&options);
+    /* load arguments */
+    options.source_codec = text_to_cstring(PG_GETARG_TEXT_P(4));
+    options.result_codec = text_to_cstring(PG_GETARG_TEXT_P(5));
+    /* call function */
+    result = convert_with_options(fcinfo, &options);
+    /* free arguments */
+    pfree((char *)options.source_codec);
+    pfree((char *)options.result_codec);
+    return result;
+}
+
 PG_FUNCTION_INFO_V1(postgresql_texcaller_escape_latex);
 Datum postgresql_texcaller_escape_latex(PG_FUNCTION_ARGS)
 {
-    char *s;
-    char *native_result;
+    text *s;
+    size_t size;
+    size_t length;
     text *result;
-    /* load arguments */
-    s = text_to_cstring(PG_GETARG_TEXT_P(0));
-    /* call function */
-    native_result = texcaller_escape_latex(s);
+    /* load arguments, without copying short values */
+    s = PG_GETARG_TEXT_PP(0);
+    size = VARSIZE_ANY_EXHDR(s);
+    /* calculate result length */
+    length = escape_latex(NULL, VARDATA_ANY(s), size, 0);
+    /* every replacement is longer than the replaced character,
+       so nothing needs to be escaped if the length is unchanged */
+    if (length == size) {
+        PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+    }
+    /* calculate result */
+    result = (text *)palloc(VARHDRSZ + length);
+    SET_VARSIZE(result, VARHDRSZ + length);
+    escape_latex(VARDATA(result), VARDATA_ANY(s), size, 0);
     /* free arguments */
-    pfree(s);
+    PG_FREE_IF_COPY(s, 0);
     /* return result */
-    if (native_result == NULL) {
-        ereport(ERROR,
-                (errcode(ERRCODE_OUT_OF_MEMORY),
-                 errmsg("Out of memory.")));
+    PG_RETURN_TEXT_P(result);
+}
+
+/*! Separator between the cells of a row of texcaller_latex_rows(). */
+#define LATEX_ROWS_CELL_SEPARATOR " & "
+
+/*! Separator between the rows of texcaller_latex_rows(). */
+#define LATEX_ROWS_ROW_SEPARATOR " \\\\\n"
+
+/*! State of the texcaller_latex_rows() aggregate.
+ */
+typedef struct latex_rows_state
+{
+    /*! the escaped rows so far */
+    StringInfoData rows;
+    /*! number of rows so far, as the rows may be empty */
+    int64 count;
+} latex_rows_state;
+
+/*! Create an empty state of texcaller_latex_rows()
+ *  in the aggregate's memory context.
+ */
+static latex_rows_state *latex_rows_create(FunctionCallInfo fcinfo)
+{
+    MemoryContext aggcontext;
+    MemoryContext oldcontext;
+    latex_rows_state *state;
+    if (!AggCheckCallContext(fcinfo, &aggcontext)) {
+        elog(ERROR, "texcaller_latex_rows called in non-aggregate context");
+    }
+    oldcontext = MemoryContextSwitchTo(aggcontext);
+    state = (latex_rows_state *)palloc(sizeof(latex_rows_state));
+    initStringInfo(&state->rows);
+    state->count = 0;
+    MemoryContextSwitchTo(oldcontext);
+    return state;
+}
+
+PG_FUNCTION_INFO_V1(postgresql_texcaller_latex_rows_transfn);
+Datum postgresql_texcaller_latex_rows_transfn(PG_FUNCTION_ARGS)
+{
+    latex_rows_state *state;
+    ArrayIterator iterator;
+    Datum cell;
+    bool isnull;
+    int i;
+    state = PG_ARGISNULL(0) ? latex_rows_create(fcinfo) : (latex_rows_state *)PG_GETARG_POINTER(0);
+    if (PG_ARGISNULL(1)) {
+        PG_RETURN_POINTER(state);
+    }
+    if (state->count > 0) {
+        appendStringInfoString(&state->rows, LATEX_ROWS_ROW_SEPARATOR);
+    }
+    state->count++;
+    /* escape each cell right into the state */
+    iterator = array_create_iterator(PG_GETARG_ARRAYTYPE_P(1), 0, NULL);
+    for (i = 0; array_iterate(iterator, &cell, &isnull); i++) {
+        text *s;
+        size_t size;
+        size_t length;
+        if (i > 0) {
+            appendStringInfoString(&state->rows, LATEX_ROWS_CELL_SEPARATOR);
+        }
+        if (isnull) {
+            continue;
+        }
+        s = DatumGetTextPP(cell);
+        size = VARSIZE_ANY_EXHDR(s);
+        length = escape_latex(NULL, VARDATA_ANY(s), size, 0);
+        enlargeStringInfo(&state->rows, (int)length);
+        escape_latex(state->rows.data + state->rows.len, VARDATA_ANY(s), size, 0);
+        state->rows.len += (int)length;
+        state->rows.data[state->rows.len] = '\0';
+    }
+    array_free_iterator(iterator);
+    PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(postgresql_texcaller_latex_rows_finalfn);
+Datum postgresql_texcaller_latex_rows_finalfn(PG_FUNCTION_ARGS)
+{
+    latex_rows_state *state;
+    if (PG_ARGISNULL(0)) {
         PG_RETURN_NULL();
     }
-    result = cstring_to_text(native_result);
-    free(native_result);
-    PG_RETURN_TEXT_P(result);
+    state = (latex_rows_state *)PG_GETARG_POINTER(0);
+    PG_RETURN_TEXT_P(cstring_to_text_with_len(state->rows.data, state->rows.len));
+}
+
+PG_FUNCTION_INFO_V1(postgresql_texcaller_latex_rows_combinefn);
+Datum postgresql_texcaller_latex_rows_combinefn(PG_FUNCTION_ARGS)
+{
+    latex_rows_state *state;
+    latex_rows_state *other;
+    if (PG_ARGISNULL(1)) {
+        if (PG_ARGISNULL(0)) {
+            PG_RETURN_NULL();
+        }
+        PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+    }
+    other = (latex_rows_state *)PG_GETARG_POINTER(1);
+    state = PG_ARGISNULL(0) ? latex_rows_create(fcinfo) : (latex_rows_state *)PG_GETARG_POINTER(0);
+    if (other->count > 0) {
+        if (state->count > 0) {
+            appendStringInfoString(&state->rows, LATEX_ROWS_ROW_SEPARATOR);
+        }
+        appendBinaryStringInfo(&state->rows, other->rows.data, other->rows.len);
+        state->count += other->count;
+    }
+    PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(postgresql_texcaller_latex_rows_serialfn);
+Datum postgresql_texcaller_latex_rows_serialfn(PG_FUNCTION_ARGS)
+{
+    latex_rows_state *state;
+    StringInfoData buffer;
+    state = (latex_rows_state *)PG_GETARG_POINTER(0);
+    pq_begintypsend(&buffer);
+    pq_sendint64(&buffer, state->count);
+    pq_sendbytes(&buffer, state->rows.data, state->rows.len);
+    PG_RETURN_BYTEA_P(pq_endtypsend(&buffer));
+}
+
+PG_FUNCTION_INFO_V1(postgresql_texcaller_latex_rows_deserialfn);
+Datum postgresql_texcaller_latex_rows_deserialfn(PG_FUNCTION_ARGS)
+{
+    latex_rows_state *state;
+    bytea *serialized;
+    StringInfoData buffer;
+    serialized = PG_GETARG_BYTEA_PP(0);
+    state = latex_rows_create(fcinfo);
+    /* read the serialized state without copying it */
+    buffer.data = VARDATA_ANY(serialized);
+    buffer.len = VARSIZE_ANY_EXHDR(serialized);
+    buffer.maxlen = 0;
+    buffer.cursor = 0;
+    state->count = pq_getmsgint64(&buffer);
+    appendBinaryStringInfo(&state->rows, buffer.data + buffer.cursor, buffer.len - buffer.cursor);
+    PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(postgresql_texcaller_stats);
+Datum postgresql_texcaller_stats(PG_FUNCTION_ARGS)
+{
+    FuncCallContext *funcctx;
+    texcaller_metric *metrics;
+    Datum values[3];
+    bool nulls[3] = {false, false, false};
+    HeapTuple tuple;
+    if (SRF_IS_FIRSTCALL()) {
+        MemoryContext oldcontext;
+        TupleDesc tupdesc;
+        texcaller_metric *snapshot;
+        int count;
+        funcctx = SRF_FIRSTCALL_INIT();
+        oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+        if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+            ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                            errmsg("texcaller_stats must be called in a context that accepts a record")));
+        }
+        funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+        /* copy the snapshot into memory that lives across calls */
+        snapshot = texcaller_metrics_snapshot(&count);
+        if (snapshot == NULL) {
+            ereport(ERROR, (errcode(ERRCODE_OUT_OF_MEMORY), errmsg("out of memory")));
+        }
+        metrics = (texcaller_metric *)palloc(sizeof(texcaller_metric) * (count + 1));
+        memcpy(metrics, snapshot, sizeof(texcaller_metric) * count);
+        free(snapshot);
+        funcctx->user_fctx = metrics;
+        funcctx->max_calls = count;
+        MemoryContextSwitchTo(oldcontext);
+    }
+    funcctx = SRF_PERCALL_SETUP();
+    if (funcctx->call_cntr >= funcctx->max_calls) {
+        SRF_RETURN_DONE(funcctx);
+    }
+    metrics = (texcaller_metric *)funcctx->user_fctx + funcctx->call_cntr;
+    values[0] = CStringGetTextDatum(metrics->name);
+    values[1] = CStringGetTextDatum(metrics->labels);
+    values[2] = Float8GetDatum(metrics->value);
+    tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+    SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
 }
 
 #include "../c/texcaller.c"
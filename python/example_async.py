@@ -0,0 +1,19 @@
+# coding: UTF-8
+
+from __future__ import division, print_function, unicode_literals
+
+import asyncio
+import texcaller
+
+latex = r'''\documentclass{article}
+\begin{document}
+Hello world!
+\end{document}'''
+
+async def main():
+    pdf, info = await texcaller.convert_async(latex, 'LaTeX', 'PDF', 5)
+    print('PDF size:     %.1f KB' % (len(pdf) / 1024))
+    results = await texcaller.convert_many_async([(latex, 'LaTeX', 'PDF', 5)] * 10)
+    print('Converted %i documents concurrently.' % len(results))
+
+asyncio.run(main())
@@ -0,0 +1,15 @@
+cat >hello_workers.tex <<'EOF2'
+\documentclass{article}
+\begin{document}
+Hello remote world!
+\end{document}
+EOF2
+
+texcaller --listen unix:worker1.sock --jobs 2 &
+worker1=$!
+texcaller --listen unix:worker2.sock --jobs 2 &
+worker2=$!
+trap 'kill $worker1 $worker2' EXIT
+sleep 1
+
+texcaller --workers unix:worker1.sock,unix:worker2.sock LaTeX PDF 5 <hello_workers.tex >hello_workers.pdf
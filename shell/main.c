@@ -5,13 +5,18 @@
  *  \par Synopsis
  *
  *  \code
-texcaller SRC_FORMAT DEST_FORMAT MAX_RUNS <SRC >DEST
+texcaller [OPTIONS] SRC_FORMAT DEST_FORMAT MAX_RUNS <SRC >DEST
+texcaller [OPTIONS] --listen ADDRESS
  *  \endcode
  *
  *  \par Example
  *
  *  \include example.sh
  *
+ *  \par Example with remote workers
+ *
+ *  \include example_workers.sh
+ *
  *  \par Description
  *
  *  The \c texcaller binary is a simple command line tool
@@ -26,64 +31,480 @@ texcaller SRC_FORMAT DEST_FORMAT MAX_RUNS <SRC >DEST
  *  No temporary files are left behind.
  *  Information and error messages are reported to standard error.
  *  The exit code is 0 on success and 1 on failure.
+ *
+ *  With <tt>\--listen</tt>, it runs as a worker process instead,
+ *  serving conversions of remote clients
+ *  (see texcaller_options::workers)
+ *  until it is terminated.
+ *  Failed requests are reported to standard error.
+ *
+ *  Clients and workers on different hosts share a secret
+ *  via the \c TEXCALLER_WORKER_SECRET environment variable
+ *  (see texcaller_options::worker_secret),
+ *  which keeps it out of the process list.
+ *
+ *  \par Options
+ *
+ *  - <tt>\--prefetch-dir DIR</tt>
+ *    remember the input files of the TeX interpreter in \c DIR,
+ *    and prefetch them before subsequent runs
+ *    (see texcaller_options::prefetch_dir)
+ *
+ *  - <tt>\--seed-dir DIR</tt>
+ *    keep the auxiliary files of successful conversions in \c DIR,
+ *    and start structurally identical documents with them
+ *    (see texcaller_options::seed_dir)
+ *
+ *  - <tt>\--draft-mode on|off</tt>
+ *    generate the PDF only in the last TeX run
+ *    (see texcaller_options::draft_mode)
+ *
+ *  - <tt>\--cache-dir DIR</tt>
+ *    keep the font caches of the TeX interpreters in \c DIR
+ *    (see texcaller_options::cache_dir)
+ *
+ *  - <tt>\--warm-up FORMAT,...</tt>
+ *    build the font caches for these source formats first,
+ *    e.g. before serving conversions as a worker process
+ *    (see texcaller_warm_up())
+ *
+ *  - <tt>\--profile on|off</tt>
+ *    report the time spent on each file read by the TeX interpreter
+ *    (see texcaller_options::profile)
+ *
+ *  - <tt>\--part FILE</tt>
+ *    pass \c FILE as a part of the document,
+ *    to be included via <tt>\\include{NAME}</tt>,
+ *    where \c NAME is the file name without directory and \c .tex extension
+ *    (see texcaller_options::parts)
+ *
+ *  - <tt>\--parallel-parts on|off</tt>
+ *    compile the parts in parallel
+ *    (see texcaller_options::parallel_parts)
+ *
+ *  - <tt>\--preview N</tt>
+ *    stop after the first \c N pages, in a single TeX run
+ *    (see texcaller_options::preview_pages)
+ *
+ *  - <tt>\--input-codec identity|gzip|zstd</tt>
+ *    read a compressed source from stdin
+ *    (see texcaller_options::source_codec)
+ *
+ *  - <tt>\--output-codec identity|gzip|zstd</tt>
+ *    write a compressed result to stdout
+ *    (see texcaller_options::result_codec)
+ *
+ *  - <tt>\--priority interactive|normal|batch</tt>
+ *    priority class of the conversion
+ *    (see texcaller_options::priority)
+ *
+ *  - <tt>\--tenant NAME</tt>
+ *    tenant on whose behalf the conversion runs
+ *    (see texcaller_options::tenant)
+ *
+ *  - <tt>\--jobserver make|fifo:PATH|slots:DIR:LIMIT</tt>
+ *    limit the concurrent TeX runs of all processes using this jobserver,
+ *    e.g. <tt>\--jobserver make</tt> to share the job slots
+ *    of <tt>make -j</tt>
+ *    (see texcaller_jobserver_configure())
+ *
+ *  - <tt>\--metrics FILE</tt>
+ *    write the metrics in the Prometheus text format to \c FILE
+ *    after the conversion, or after each connection as a worker process,
+ *    e.g. for the textfile collector of the Prometheus node exporter
+ *    (see texcaller_metrics_prometheus())
+ *
+ *  - <tt>\--workers ADDRESS,...</tt>
+ *    convert on one of these remote workers
+ *    (see texcaller_options::workers)
+ *
+ *  - <tt>\--worker-timeout SECONDS</tt>
+ *    give up on a worker connection after \c SECONDS without progress,
+ *    0 for never
+ *    (see texcaller_options::worker_timeout)
+ *
+ *  - <tt>\--listen ADDRESS</tt>
+ *    run as a worker process, listening on \c ADDRESS,
+ *    which is either <tt>unix:PATH</tt> or <tt>[HOST]:PORT</tt>
+ *    (see texcaller_worker_listen())
+ *
+ *  - <tt>\--jobs N</tt>
+ *    run at most \c N conversions at the same time as a worker process,
+ *    defaults to the number of processors
+ *    (see texcaller_scheduler_configure())
+ *
+ *  - <tt>\--connections N</tt>
+ *    serve at most \c N connections at the same time as a worker process,
+ *    defaults to 4 times the \c N of <tt>\--jobs</tt>,
+ *    further clients wait in the listen queue
+ *
+ *  - <tt>\--max-source-size BYTES</tt>
+ *    reject larger sources as a worker process
+ *    (see texcaller_options::worker_max_source_size)
  */
 
 #include "texcaller.h"
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
-int main(int argc, char *argv[])
+static int usage(void)
 {
-    const char *source_format;
-    const char *result_format;
-    int max_runs;
+    fprintf(stderr, "Usage: texcaller [OPTIONS] SRC_FORMAT DEST_FORMAT MAX_RUNS <SRC >DEST\n"
+                    "       texcaller [OPTIONS] --listen ADDRESS\n"
+                    "\n"
+                    "Options:\n"
+                    "  --prefetch-dir DIR   prefetch input files recorded in DIR\n"
+                    "  --seed-dir DIR       seed auxiliary files from DIR\n"
+                    "  --draft-mode on|off  generate the PDF only in the last run\n"
+                    "  --cache-dir DIR      keep font caches in DIR\n"
+                    "  --warm-up FORMATS    build font caches for these source formats first\n");
+    fprintf(stderr, "  --profile on|off     report the time spent per input file\n"
+                    "  --part FILE          pass FILE as a part of the document\n"
+                    "  --parallel-parts on|off  compile the parts in parallel\n"
+                    "  --preview N          stop after the first N pages\n"
+                    "  --input-codec CODEC  identity, gzip or zstd compressed source\n"
+                    "  --output-codec CODEC identity, gzip or zstd compressed result\n");
+    fprintf(stderr, "  --priority CLASS     interactive, normal or batch\n"
+                    "  --tenant NAME        tenant on whose behalf to convert\n"
+                    "  --jobserver SERVER   make, fifo:PATH or slots:DIR:LIMIT\n"
+                    "  --metrics FILE       write Prometheus metrics to FILE\n"
+                    "  --workers ADDRESSES  convert on one of these remote workers\n"
+                    "  --listen ADDRESS     serve conversions of remote clients\n"
+                    "  --jobs N             maximum number of conversions of a worker\n");
+    fprintf(stderr, "  --worker-timeout SECONDS  timeout of worker connections\n"
+                    "  --connections N      maximum number of connections of a worker\n"
+                    "  --max-source-size BYTES  maximum source size of a worker\n");
+    return 1;
+}
 
-    char *source;
-    size_t source_size;
+static int read_part(texcaller_part *part, char *filename)
+{
+    FILE *file;
+    char *source = NULL;
+    size_t source_size = 0;
     size_t read_size;
     const size_t source_size_increment = 4096;
+    char *name;
+    char *extension;
 
-    char *result;
-    size_t result_size;
-    char *info;
-
-    /* command line arguments */
-    if (argc != 4) {
-        fprintf(stderr, "Usage: texcaller SRC_FORMAT DEST_FORMAT MAX_RUNS <SRC >DEST\n");
-        return 1;
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to open part \"%s\": %s.\n", filename, strerror(errno));
+        return -1;
     }
-    source_format = argv[1];
-    result_format = argv[2];
-    max_runs = atoi(argv[3]);
-
-    /* stdin -> source */
-    source_size = 0;
-    source = NULL;
     do {
         char *new_source = realloc(source, source_size + source_size_increment);
         if (new_source == NULL) {
             free(source);
+            fclose(file);
             fprintf(stderr, "Out of memory.\n");
-            return 1;
+            return -1;
         }
         source = new_source;
-        read_size = fread(source + source_size, 1, source_size_increment, stdin);
+        read_size = fread(source + source_size, 1, source_size_increment, file);
         source_size += read_size;
     } while (read_size == source_size_increment);
-    if (ferror(stdin)) {
+    if (ferror(file)) {
         free(source);
-        fprintf(stderr, "Unable to read from stdin: %s.\n", strerror(errno));
+        fclose(file);
+        fprintf(stderr, "Unable to read part \"%s\": %s.\n", filename, strerror(errno));
+        return -1;
+    }
+    fclose(file);
+
+    /* name as used by \include */
+    name = strrchr(filename, '/');
+    name = name == NULL ? filename : name + 1;
+    extension = strrchr(name, '.');
+    if (extension != NULL && strcmp(extension, ".tex") == 0) {
+        *extension = '\0';
+    }
+    part->name = name;
+    part->source = source;
+    part->source_size = source_size;
+    return 0;
+}
+
+static const char *metrics_filename;
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void write_metrics(void)
+{
+    char *metrics;
+    char *tmp_filename;
+    FILE *file;
+
+    if (metrics_filename == NULL) {
+        return;
+    }
+    metrics = texcaller_metrics_prometheus();
+    tmp_filename = malloc(strlen(metrics_filename) + sizeof(".tmp"));
+    if (metrics == NULL || tmp_filename == NULL) {
+        free(metrics);
+        free(tmp_filename);
+        fprintf(stderr, "Out of memory.\n");
+        return;
+    }
+    sprintf(tmp_filename, "%s.tmp", metrics_filename);
+
+    /* replace atomically, so collectors never read a partial file */
+    pthread_mutex_lock(&metrics_mutex);
+    file = fopen(tmp_filename, "w");
+    if (   file == NULL
+        || fputs(metrics, file) == EOF
+        || fclose(file) != 0
+        || rename(tmp_filename, metrics_filename) != 0) {
+        fprintf(stderr, "Unable to write metrics to \"%s\": %s.\n", metrics_filename, strerror(errno));
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+    free(metrics);
+    free(tmp_filename);
+}
+
+static texcaller_context *worker_context;
+static pthread_mutex_t connections_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t connections_cond = PTHREAD_COND_INITIALIZER;
+static int connections_count = 0;
+
+static void *worker_thread(void *arg)
+{
+    const int fd = (int)(long)arg;
+    char *error;
+    if (texcaller_worker_serve(&error, worker_context, fd) != 0) {
+        fprintf(stderr, "%s\n", error == NULL ? "Out of memory." : error);
+        free(error);
+    }
+    close(fd);
+    write_metrics();
+    pthread_mutex_lock(&connections_mutex);
+    connections_count--;
+    pthread_cond_signal(&connections_cond);
+    pthread_mutex_unlock(&connections_mutex);
+    return NULL;
+}
+
+static int worker(const char *address, int jobs, int connections, const texcaller_options *options)
+{
+    pthread_attr_t attr;
+    char *error;
+    int listen_fd;
+
+    texcaller_scheduler_configure(jobs, 0);
+    worker_context = texcaller_context_create(&error, options);
+    if (worker_context == NULL) {
+        fprintf(stderr, "%s\n", error == NULL ? "Out of memory." : error);
+        free(error);
+        return 1;
+    }
+    listen_fd = texcaller_worker_listen(&error, address);
+    if (listen_fd == -1) {
+        fprintf(stderr, "%s\n", error == NULL ? "Out of memory." : error);
+        free(error);
+        texcaller_context_destroy(worker_context);
+        return 1;
+    }
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (;;) {
+        pthread_t thread;
+        int fd;
+        /* leave further clients in the listen queue */
+        pthread_mutex_lock(&connections_mutex);
+        while (connections_count >= connections) {
+            pthread_cond_wait(&connections_cond, &connections_mutex);
+        }
+        pthread_mutex_unlock(&connections_mutex);
+        fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            fprintf(stderr, "Unable to accept connection: %s.\n", strerror(errno));
+            return 1;
+        }
+        pthread_mutex_lock(&connections_mutex);
+        connections_count++;
+        pthread_mutex_unlock(&connections_mutex);
+        if (pthread_create(&thread, &attr, worker_thread, (void *)(long)fd) != 0) {
+            fprintf(stderr, "Unable to create thread.\n");
+            close(fd);
+            pthread_mutex_lock(&connections_mutex);
+            connections_count--;
+            pthread_mutex_unlock(&connections_mutex);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    texcaller_options options;
+    const char *listen_address = NULL;
+    char *warm_up_formats = NULL;
+    int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int connections = 0;
+    int arg;
+    const char *source_format;
+    const char *result_format;
+    int max_runs;
+
+    char *result;
+    size_t result_size;
+    char *info;
+
+    texcaller_part *parts;
+    int i;
+
+    /* command line options */
+    texcaller_options_init(&options);
+    parts = malloc(argc * sizeof(texcaller_part));
+    if (parts == NULL) {
+        fprintf(stderr, "Out of memory.\n");
         return 1;
     }
+    options.parts = parts;
+    options.worker_secret = getenv("TEXCALLER_WORKER_SECRET");
+    for (arg = 1; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+        if (arg + 1 == argc) {
+            return usage();
+        }
+        if (strcmp(argv[arg], "--prefetch-dir") == 0) {
+            options.prefetch_dir = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--seed-dir") == 0) {
+            options.seed_dir = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--draft-mode") == 0) {
+            if (strcmp(argv[arg + 1], "on") == 0) {
+                options.draft_mode = 1;
+            } else if (strcmp(argv[arg + 1], "off") == 0) {
+                options.draft_mode = 0;
+            } else {
+                return usage();
+            }
+        } else if (strcmp(argv[arg], "--cache-dir") == 0) {
+            options.cache_dir = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--warm-up") == 0) {
+            warm_up_formats = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--profile") == 0) {
+            if (strcmp(argv[arg + 1], "on") == 0) {
+                options.profile = 1;
+            } else if (strcmp(argv[arg + 1], "off") == 0) {
+                options.profile = 0;
+            } else {
+                return usage();
+            }
+        } else if (strcmp(argv[arg], "--part") == 0) {
+            if (read_part(&parts[options.parts_count], argv[arg + 1]) != 0) {
+                return 1;
+            }
+            options.parts_count++;
+        } else if (strcmp(argv[arg], "--parallel-parts") == 0) {
+            if (strcmp(argv[arg + 1], "on") == 0) {
+                options.parallel_parts = 1;
+            } else if (strcmp(argv[arg + 1], "off") == 0) {
+                options.parallel_parts = 0;
+            } else {
+                return usage();
+            }
+        } else if (strcmp(argv[arg], "--preview") == 0) {
+            options.preview_pages = atoi(argv[arg + 1]);
+            if (options.preview_pages < 1) {
+                return usage();
+            }
+        } else if (strcmp(argv[arg], "--input-codec") == 0) {
+            options.source_codec = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--output-codec") == 0) {
+            options.result_codec = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--priority") == 0) {
+            if (strcmp(argv[arg + 1], "interactive") == 0) {
+                options.priority = TEXCALLER_PRIORITY_INTERACTIVE;
+            } else if (strcmp(argv[arg + 1], "normal") == 0) {
+                options.priority = TEXCALLER_PRIORITY_NORMAL;
+            } else if (strcmp(argv[arg + 1], "batch") == 0) {
+                options.priority = TEXCALLER_PRIORITY_BATCH;
+            } else {
+                return usage();
+            }
+        } else if (strcmp(argv[arg], "--tenant") == 0) {
+            options.tenant = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--jobserver") == 0) {
+            if (texcaller_jobserver_configure(&info, argv[arg + 1]) != 0) {
+                fprintf(stderr, "%s\n", info == NULL ? "Out of memory." : info);
+                free(info);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--metrics") == 0) {
+            metrics_filename = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--workers") == 0) {
+            options.workers = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--listen") == 0) {
+            listen_address = argv[arg + 1];
+        } else if (strcmp(argv[arg], "--jobs") == 0) {
+            jobs = atoi(argv[arg + 1]);
+            if (jobs < 1) {
+                return usage();
+            }
+        } else if (strcmp(argv[arg], "--worker-timeout") == 0) {
+            options.worker_timeout = atoi(argv[arg + 1]);
+            if (options.worker_timeout < 0) {
+                return usage();
+            }
+        } else if (strcmp(argv[arg], "--connections") == 0) {
+            connections = atoi(argv[arg + 1]);
+            if (connections < 1) {
+                return usage();
+            }
+        } else if (strcmp(argv[arg], "--max-source-size") == 0) {
+            options.worker_max_source_size = strtoul(argv[arg + 1], NULL, 10);
+        } else {
+            return usage();
+        }
+    }
+
+    /* font caches */
+    if (warm_up_formats != NULL) {
+        const char *format;
+        for (format = strtok(warm_up_formats, ","); format != NULL; format = strtok(NULL, ",")) {
+            const int failed = texcaller_warm_up(&info, format, &options) != 0;
+            fprintf(stderr, "%s\n", info == NULL ? "Out of memory." : info);
+            free(info);
+            if (failed) {
+                return 1;
+            }
+        }
+    }
+
+    /* worker process */
+    if (listen_address != NULL) {
+        if (   arg != argc || options.workers != NULL || options.parts_count > 0
+            || options.source_codec != NULL || options.result_codec != NULL) {
+            return usage();
+        }
+        return worker(listen_address, jobs, connections > 0 ? connections : 4 * jobs, &options);
+    }
+
+    /* command line arguments */
+    if (argc - arg != 3) {
+        return usage();
+    }
+    source_format = argv[arg];
+    result_format = argv[arg + 1];
+    max_runs = atoi(argv[arg + 2]);
 
-    /* run tex */
-    texcaller_convert(&result, &result_size, &info,
-                      source, source_size, source_format, result_format, max_runs);
+    /* run tex, streaming stdin into the temporary directory */
+    texcaller_convert_fd(&result, &result_size, &info,
+                         STDIN_FILENO, source_format, result_format, max_runs,
+                         &options);
 
     /* cleanup */
-    free(source);
+    write_metrics();
+    for (i = 0; i < options.parts_count; i++) {
+        free((char *)parts[i].source);
+    }
+    free(parts);
 
     /* info -> stderr */
     fprintf(stderr, "%s\n", info == NULL ? "Out of memory." : info);
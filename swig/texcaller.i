@@ -7,7 +7,10 @@
  *  \code
 import texcaller
 texcaller.convert(source, source_format, result_format, max_runs)  # returns a pair (result, info)
+await texcaller.convert_async(source, source_format, result_format, max_runs)  # returns a pair (result, info)
+await texcaller.convert_many_async(jobs)  # returns a list of pairs (result, info)
 texcaller.escape_latex(s)
+texcaller.escape_latex(s, source_format)
  *  \endcode
  *
  *  \par Description
@@ -25,6 +28,22 @@ texcaller.escape_latex(s)
  *
  *  \include example.py
  *
+ *  \par Asynchronous conversions
+ *
+ *  In <a href="https://docs.python.org/3/library/asyncio.html">asyncio</a>
+ *  based programs,
+ *  \c convert_async() returns a future instead of blocking,
+ *  and \c convert_many_async() returns a future of a list of results,
+ *  suitable for \c asyncio.gather().
+ *  No thread is needed per conversion,
+ *  because the TeX interpreter is watched by the event loop
+ *  (see texcaller_conversion_start()).
+ *  When the future is cancelled, the TeX interpreter is killed.
+ *  These conversions wait for the scheduler without blocking the event loop
+ *  (see texcaller_scheduler_configure()).
+ *
+ *  \include example_async.py
+ *
  *  \par Beware of \c \\u
  *
  *  Unfortunately,
@@ -60,9 +79,68 @@ texcaller.escape_latex(s)
         val = (result, info.decode('UTF-8'))
 %}
 
+%pythonappend conversion::finish %{
+    if str is bytes:
+        (result, info) = val
+        val = (result, info.decode('UTF-8'))
+%}
+
+%pythoncode %{
+def convert_async(source, source_format, result_format, max_runs, loop=None):
+    """Convert a TeX or LaTeX source to DVI or PDF within an asyncio event loop.
+
+    Returns a future of the pair (result, info), like convert().
+    Cancelling the future kills the TeX interpreter.
+    """
+    import asyncio
+    if loop is None:
+        loop = asyncio.get_running_loop()
+    future = loop.create_future()
+    job = conversion(source, source_format, result_format, max_runs)
+    watched = [-1]
+
+    def watch():
+        watched[0] = job.fd()
+        if watched[0] != -1:
+            loop.add_reader(watched[0], step)
+            return
+        try:
+            future.set_result(job.finish())
+        except Exception as e:
+            future.set_exception(e)
+
+    def step():
+        loop.remove_reader(watched[0])
+        watched[0] = -1
+        if future.done():
+            return
+        job.step()
+        watch()
+
+    def done(future):
+        if watched[0] != -1:
+            loop.remove_reader(watched[0])
+            watched[0] = -1
+        job.cancel()
+
+    future.add_done_callback(done)
+    watch()
+    return future
+
+def convert_many_async(jobs, loop=None):
+    """Convert many TeX or LaTeX sources within an asyncio event loop.
+
+    Each job is a tuple (source, source_format, result_format, max_runs).
+    Returns a future of the list of pairs (result, info),
+    as asyncio.gather() does.
+    """
+    import asyncio
+    return asyncio.gather(*[convert_async(*job, loop=loop) for job in jobs])
+%}
+
 %pythonprepend escape_latex %{
     if str is bytes:
-        s = s.encode('UTF-8')
+        args = tuple(arg.encode('UTF-8') for arg in args)
 %}
 %pythonappend escape_latex %{
     if str is bytes:
@@ -80,6 +158,7 @@ texcaller.escape_latex(s)
 require 'texcaller'
 Texcaller.convert(source, source_format, result_format, max_runs)  # returns a pair [result, info]
 Texcaller.escape_latex(s)
+Texcaller.escape_latex(s, source_format)
  *  \endcode
  *
  *  \par Description
@@ -109,7 +188,14 @@ Texcaller.escape_latex(s)
  *
  *  \code
 texcaller_convert(&$result, &$info, $source, $source_format, $result_format, $max_runs)
+$conversion = new TexcallerConversion($source, $source_format, $result_format, $max_runs)
+$conversion->stream()  // returns a stream for stream_select(), or NULL when finished
+$conversion->step()    // returns whether the conversion has finished
+$conversion->wait()
+$conversion->result(&$result, &$info)
+$conversion->cancel()
 texcaller_escape_latex($s)
+texcaller_escape_latex($s, $source_format)
  *  \endcode
  *
  *  \par Description
@@ -126,6 +212,29 @@ texcaller_escape_latex($s)
  *  \par Example
  *
  *  \include example.php
+ *
+ *  \par Non-blocking conversions
+ *
+ *  A \c TexcallerConversion starts the TeX interpreter right away
+ *  and returns without waiting for it,
+ *  so a single request can run several conversions at once
+ *  and do other I/O in the meantime
+ *  (see texcaller_conversion_start()).
+ *  Its \c stream() becomes readable for \c stream_select()
+ *  when a TeX run exits,
+ *  after which \c step() starts the next TeX run if necessary.
+ *  Each TeX run has its own stream,
+ *  so call \c stream() again after each \c step().
+ *  \c wait() blocks until the conversion has finished,
+ *  and \c result() waits as well,
+ *  then returns the result and info like \c texcaller_convert().
+ *  When the object is destroyed before,
+ *  such as when the request ends early,
+ *  the TeX interpreter is killed.
+ *  These conversions wait for the scheduler without blocking,
+ *  with \c stream() becoming readable when it's their turn.
+ *
+ *  \include example_async.php
  */
 
 /*! \cond */
@@ -133,6 +242,31 @@ texcaller_escape_latex($s)
 
 %rename(texcaller_convert) texcaller::convert;
 %rename(texcaller_escape_latex) texcaller::escape_latex;
+%rename(TexcallerConversion) texcaller::conversion;
+
+%{
+#include <fcntl.h>
+#include <unistd.h>
+
+/* a file descriptor owned by the caller, returned to PHP as a stream */
+typedef int texcaller_php_stream;
+%}
+
+%typemap(out) texcaller_php_stream %{
+    if ($1 == -1) {
+        RETVAL_NULL();
+    } else {
+        php_stream *stream = php_stream_fopen_from_fd($1, "r", NULL);
+        if (stream == NULL) {
+            close($1);
+            RETVAL_NULL();
+        } else {
+            php_stream_to_zval(stream, $result);
+        }
+    }
+%}
+
+typedef int texcaller_php_stream;
 
 #endif
 /*! \endcond */
@@ -150,10 +284,43 @@ texcaller_escape_latex($s)
 
 %module texcaller
 
+#ifdef SWIGPHP
+%apply std::string &OUTPUT { std::string &result, std::string &info };
+%catches(std::domain_error, std::runtime_error) texcaller::conversion::result;
+
+%extend texcaller::conversion {
+    /* the stream only watches a duplicate of the descriptor,
+       so closing it doesn't interfere with the conversion */
+    texcaller_php_stream stream() const
+    {
+        const int fd = $self->fd();
+        return fd == -1 ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    }
+
+    void result(std::string &result, std::string &info)
+    {
+        $self->wait();
+        $self->finish(result, info);
+    }
+}
+#endif
+
 namespace texcaller {
 
 void convert(std::string &OUTPUT, std::string &OUTPUT, const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs) throw(std::domain_error, std::runtime_error);
+class conversion
+{
+public:
+    conversion(const std::string &source, const std::string &source_format, const std::string &result_format, int max_runs) throw(std::domain_error, std::runtime_error);
+    ~conversion();
+    int fd() const;
+    bool step();
+    void wait();
+    void finish(std::string &OUTPUT, std::string &OUTPUT) throw(std::domain_error, std::runtime_error);
+    void cancel();
+};
 std::string escape_latex(const std::string &s) throw(std::runtime_error);
+std::string escape_latex(const std::string &s, const std::string &source_format) throw(std::domain_error, std::runtime_error);
 
 }
 